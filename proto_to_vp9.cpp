@@ -8,16 +8,24 @@
 
 // TODO: Add Superframe Support
 // TODO: Add full inter-frame reference support
-// TODO: Add partition/tile tree fields
+// TODO: Add inter frame blocks to the partition tree
 // TODO: Verify that more obscure fields/messages are being written properly
 
 #include "vp9.pb.h"
 #include "vp9_constants.h"
+#include "vp9_compact.h"
+#include "vp9_bool_run.h"
+#include "vp9_bit_writer.h"
+#include "vp9_tile_layout.h"
+#include "vp9_frame_context.h"
+#include "vp9_ref_slots.h"
+#include "vp9_block_context.h"
+#include "vp9_syntax.h"
 
 class ProtoToVP9 {
 public:
   // Parser State Variables
-  std::vector<bool> bit_buffer;
+  VP9Fuzzer::BitWriter bit_buffer;
   bool Lossless = false;
   uint32_t tx_mode;
   uint32_t profile;
@@ -34,6 +42,43 @@ public:
   uint32_t MiRows = 0;
   int32_t Sb64Cols = 0;
   int32_t Sb64Rows = 0;
+  uint32_t TileColsLog2 = 0;
+  uint32_t TileRowsLog2 = 0;
+  // Tile grid of the last frame written
+  VP9Fuzzer::VP9TileLayout tile_layout;
+  // Saved probability contexts of the frames written so far
+  VP9Fuzzer::VP9FrameContextStore frame_contexts = VP9Fuzzer::MakeVP9FrameContextStore();
+  // Frame formats held by the 8 reference slots of the frames written so far
+  VP9Fuzzer::VP9RefSlots ref_slots;
+  // Frame info and neighbour contexts of the blocks written from Tile.superblock
+  VP9Fuzzer::VP9BlockFrameInfo block_frame_info;
+  VP9Fuzzer::VP9TileContext tile_context;
+  bool WriteBlocks = false;
+  // Tiles written as bytes are borrowed from Tile.partition instead of copied, GetBitBufferAsIovecs then returns
+  // the frame without copying them. The frame proto has to outlive the output
+  bool BorrowTiles = false;
+  // Frame of the last WriteVP9CompactFrame, kept for the borrowed tiles
+  VP9Frame unpacked_frame;
+  // With Incremental the sections of the last frame and the writer state before it are kept, so the Rewrite
+  // functions can write the frame again after an edit and only touch the section that changed
+  bool Incremental = false;
+  bool sections_valid = false;
+  uint64_t header_size_pos = 0;
+  uint64_t compressed_header_at = 0;
+  // Byte offset of the data of each tile in bit_buffer.bytes, its size and its entry in bit_buffer.borrowed
+  std::vector<uint64_t> tile_data_at;
+  std::vector<uint64_t> tile_data_size;
+  std::vector<int32_t> tile_borrowed;
+  std::vector<bool> tile_blocks;
+  struct SavedState {
+    VP9Fuzzer::VP9FrameContextStore frame_contexts;
+    VP9Fuzzer::VP9RefSlots ref_slots;
+    uint32_t interpolation_filter;
+    bool allow_high_precision_mv;
+  } saved_state = SavedState(); // Value-initialized, a writer is copied before its first incremental frame too
+  // Uncompressed header fields ApplyVP9FrameContext reads, of the last frame
+  std::array<uint32_t, 8> context_fields;
+  VP9Fuzzer::BitWriter header_buffer;
 
   std::string BoolBuffer;
   uint32_t BoolLowValue = 0;
@@ -43,56 +88,46 @@ public:
 
   void WriteBitUInt(uint64_t number, uint32_t bits) {
     // Writes integer bits in big endian format to the end of bit buffer
-    for (uint32_t i = bits; i --> 0;) {
-      bool number_bit = (number >> i) & 0b1;
-      // // std::cout << number_bit << std::endl;
-      bit_buffer.push_back(number_bit);
-    }
+    VP9Fuzzer::WriteBits(&bit_buffer, number, bits);
   }
 
-  void WriteBitUIntPos(uint64_t number, uint32_t bits, uint32_t pos) {
+  void WriteBitUIntPos(uint64_t number, uint32_t bits, uint64_t pos) {
     // Writes integer bits in big endian format to the bit buffer at a specific position
-    for (uint32_t i = bits; i --> 0;) {
-      bool number_bit = (number >> i) & 0b1;
-      // // std::cout << number_bit << std::endl;
-      bit_buffer[pos++] = number_bit;
-    }
+    VP9Fuzzer::WriteBitsAt(&bit_buffer, number, bits, pos);
   }
 
-  void WriteBitStringPos(std::string string, uint32_t bits, uint32_t pos) {
-    // Write bytes to bit_buffer at specific position
-    // Convert string to c bytes
-    const char* bytes = string.c_str();
-    // Write bytes to bit buffer
-    uint32_t byte_count = ceil(bits / 8.0); 
+  void WriteBitStringPos(const std::string& string, uint32_t bits, uint64_t pos) {
+    // Write bytes to bit_buffer at specific position, only the low bits % 8 bits of the first byte are written
+    // and bytes past the end of string are zero
+    uint32_t byte_count = (bits + 7) / 8;
     for (uint32_t byte_index = 0; byte_index < byte_count; byte_index++) {
-      
       uint32_t bit_limit = (byte_index > 0) ? 8 : 8 - ((byte_count * 8) - bits);
-      uint8_t current_byte = byte_index < string.size() ? bytes[byte_index] : 0;
-
-      for (uint32_t bit_index = bit_limit; bit_index --> 0;) {
-        bool bit = (current_byte >> bit_index) & 0b1;
-        bit_buffer[pos++] = bit;
-      }
+      uint8_t current_byte = byte_index < string.size() ? string[byte_index] : 0;
+      VP9Fuzzer::WriteBitsAt(&bit_buffer, current_byte, bit_limit, pos);
+      pos += bit_limit;
     }
   }
 
-  void WriteBitString(std::string string, uint32_t bits) {
-    // Write bit string to end of bit buffer
-    // Convert string to c bytes
-    const char* bytes = string.c_str();
-    // Write bytes to bit buffer
-    uint32_t byte_count = ceil(bits / 8.0);
-    for (uint32_t byte_index = 0; byte_index < byte_count; byte_index++) {
-      
-      uint32_t bit_limit = (byte_index > 0) ? 8 : 8 - ((byte_count * 8) - bits);
-      uint8_t current_byte = byte_index < string.size() ? bytes[byte_index] : 0;
+  void WriteBitString(const std::string& string, uint32_t bits) {
+    // Write bit string to end of bit buffer, only the low bits % 8 bits of the first byte are written and
+    // bytes past the end of string are zero. The whole bytes are copied in bulk
+    uint32_t byte_count = (bits + 7) / 8;
+    uint32_t byte_index = 0;
+    if (bits & 7) {
+      WriteBitUInt(string.empty() ? 0 : (uint8_t) string[0], bits & 7);
+      byte_index = 1;
+    }
+    uint32_t copied = string.size() > byte_index ? std::min<uint32_t>(string.size(), byte_count) - byte_index : 0;
+    VP9Fuzzer::AppendBytes(&bit_buffer, (const uint8_t*) string.data() + byte_index, copied);
+    VP9Fuzzer::AppendZeroBytes(&bit_buffer, byte_count - byte_index - copied);
+  }
 
-      for (uint32_t bit_index = bit_limit; bit_index --> 0;) {
-        bool bit = (current_byte >> bit_index) & 0b1;
-        bit_buffer.push_back(bit);
-      }
+  void PutBoolByte(uint8_t byte) {
+    // Tiles can be larger than the initial buffer, it doubles when full
+    if (BoolPos == BoolBuffer.size()) {
+      BoolBuffer.resize(BoolBuffer.size() * 2);
     }
+    BoolBuffer[BoolPos++] = byte;
   }
 
   void WriteBool(int32_t bit, int32_t p) {
@@ -133,7 +168,7 @@ public:
         BoolBuffer[x] += 1;
       }
 
-      BoolBuffer[BoolPos++] = (lowvalue >> (24 - offset)) & 0xff;
+      PutBoolByte((lowvalue >> (24 - offset)) & 0xff);
       lowvalue <<= offset;
       shift = count;
       lowvalue &= 0xffffff;
@@ -146,13 +181,70 @@ public:
     BoolRange = range;
   }
 
+  void WriteBoolShift(uint32_t total_shift) {
+    // Shifts the low value like the normalization in WriteBool, in steps of at most 7 bits
+    // so that every step outputs at most one byte
+    while (total_shift > 0) {
+      int count = BoolCount;
+      unsigned int lowvalue = BoolLowValue;
+      int shift = total_shift < 7 ? total_shift : 7;
+      total_shift -= shift;
+
+      count += shift;
+
+      if (count >= 0) {
+        int offset = shift - count;
+
+        if ((lowvalue << (offset - 1)) & 0x80000000) {
+          int x = BoolPos - 1;
+
+          while (x >= 0 && BoolBuffer[x] == '\xff') {
+            BoolBuffer[x] = 0;
+            x--;
+          }
+
+          BoolBuffer[x] += 1;
+        }
+
+        PutBoolByte((lowvalue >> (24 - offset)) & 0xff);
+        lowvalue <<= offset;
+        shift = count;
+        lowvalue &= 0xffffff;
+        count -= 8;
+      }
+
+      lowvalue <<= shift;
+      BoolCount = count;
+      BoolLowValue = lowvalue;
+    }
+  }
+
+  void WriteBoolZeroRun(uint32_t run, int32_t p) {
+    // Writes run zero bools at probability p, bit-exact with run calls to WriteBool(0, p)
+    // A zero never adds to the low value, so only the range and the total shift need tracking
+    const VP9Fuzzer::BoolRunTable* table = VP9Fuzzer::GetBoolRunTable(p);
+    uint32_t total_shift = 0;
+    for (uint32_t level = BOOL_RUN_LEVELS; level --> 0;) {
+      while (run >= (1u << level)) {
+        total_shift += table->shift[level][BoolRange];
+        BoolRange = table->range[level][BoolRange];
+        run -= 1u << level;
+      }
+    }
+    WriteBoolShift(total_shift);
+  }
+
   void InitBool() {
     // Stolen from bitwriter.c in libvpx
     BoolLowValue = 0;
     BoolRange = 255;
     BoolCount = -24;
     BoolPos = 0;
-    BoolBuffer = std::string(0x10000, 0);
+    // Only the bytes written so far are read back for carries, the buffer is kept between frames
+    // Compressed headers aren't cached, a key of the serialized proto costs more than encoding it
+    if (BoolBuffer.size() < 0x10000) {
+      BoolBuffer.resize(0x10000);
+    }
     WriteBool(0, 128);
   }
 
@@ -161,7 +253,7 @@ public:
 
     if ((BoolBuffer[BoolPos - 1] & 0xe0) == 0xc0) {
       // std::cout << "Superframe Index Conflict" << std::endl;
-      BoolBuffer[BoolPos++] = 0;
+      PutBoolByte(0);
     }
 
     // std::cout << "End Bool Bytes: " << BoolPos << std::endl;
@@ -172,36 +264,53 @@ public:
     for (bit = bits - 1; bit >= 0; bit--) WriteBool(1 & (number >> bit), 128);
   }
 
-  void WriteVP9SignedInteger(const VP9SignedInteger *number, uint32_t number_bits) {
+  template <const VP9Fuzzer::VP9SyntaxElement& Element>
+  void WriteVP9Element(uint64_t value) {
+    // Writes one element of vp9_syntax.h with its coding and width
+    static_assert(Element.coding == VP9Fuzzer::VP9_SYNTAX_RAW || Element.coding == VP9Fuzzer::VP9_SYNTAX_LITERAL ||
+                  Element.coding == VP9Fuzzer::VP9_SYNTAX_BOOL, "probability updates are written by their section");
+    if (Element.coding == VP9Fuzzer::VP9_SYNTAX_RAW) {
+      WriteBitUInt(value, Element.bits);
+    }
+    else if (Element.coding == VP9Fuzzer::VP9_SYNTAX_LITERAL) {
+      WriteLiteral(value, Element.bits);
+    }
+    else {
+      WriteBool(value, Element.prob);
+    }
+  }
+
+  template <const VP9Fuzzer::VP9SyntaxElement& Element>
+  void WriteVP9SignedInteger(const VP9SignedInteger *number) {
     // Writes signed number bits with the signed bit at the end
-    WriteBitString(number->value(), number_bits);
-    WriteBitUInt(number->sign(), 1);
+    WriteBitString(number->value(), Element.bits);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SIGN>(number->sign());
   }
 
   void WriteVP9FrameSyncCode(const UncompressedHeader *uncompressed_header) {
     // Write frame sync codes
-    WriteBitUInt(uncompressed_header->frame_sync_code(), 24);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_SYNC_CODE>(uncompressed_header->frame_sync_code());
   }
 
   void WriteVP9ColorConfig(const UncompressedHeader *uncompressed_header) {
     // Write the ten_or_twelve bit for certain profiles
     if (profile >= 2) {
-      WriteBitUInt(uncompressed_header->color_config().ten_or_twelve_bit(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_TEN_OR_TWELVE_BIT>(uncompressed_header->color_config().ten_or_twelve_bit());
     } 
     // Write color space info
-    WriteBitUInt(uncompressed_header->color_config().color_space(), 3);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_COLOR_SPACE>(uncompressed_header->color_config().color_space());
     // Write conditional color space info
     if (uncompressed_header->color_config().color_space() != UncompressedHeader_ColorConfig::CS_RGB) {
-      WriteBitUInt(uncompressed_header->color_config().color_range(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_COLOR_RANGE>(uncompressed_header->color_config().color_range());
       if (profile == 1 || profile == 3) {
-        WriteBitUInt(uncompressed_header->color_config().subsampling_x(), 1);
-        WriteBitUInt(uncompressed_header->color_config().subsampling_y(), 1);
-        WriteBitUInt(uncompressed_header->color_config().reserved_zero(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SUBSAMPLING_X>(uncompressed_header->color_config().subsampling_x());
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SUBSAMPLING_Y>(uncompressed_header->color_config().subsampling_y());
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>(uncompressed_header->color_config().reserved_zero());
       }
     }
     else {
       if (profile == 1 || profile == 3) {
-        WriteBitUInt(uncompressed_header->color_config().reserved_zero(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>(uncompressed_header->color_config().reserved_zero());
       }
     }
   }
@@ -217,11 +326,12 @@ public:
   void WriteVP9FrameSize(const UncompressedHeader *uncompressed_header) {
     // Write frame size
     // TODO: Maybe mutate this a bit more granularly
-    WriteBitUInt(uncompressed_header->frame_size().frame_width_minus_1(), 16);
-    WriteBitUInt(uncompressed_header->frame_size().frame_height_minus_1(), 16);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_WIDTH_MINUS_1>(uncompressed_header->frame_size().frame_width_minus_1());
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_HEIGHT_MINUS_1>(uncompressed_header->frame_size().frame_height_minus_1());
 
-    FrameWidth = uncompressed_header->frame_size().frame_width_minus_1() + 1;
-    FrameHeight = uncompressed_header->frame_size().frame_height_minus_1() + 1;
+    // Only the 16 coded bits, MiCols and MiRows size the tile layout and the block contexts
+    FrameWidth = (uncompressed_header->frame_size().frame_width_minus_1() & 0xffff) + 1;
+    FrameHeight = (uncompressed_header->frame_size().frame_height_minus_1() & 0xffff) + 1;
 
     ComputeImageSize();
   }
@@ -229,44 +339,52 @@ public:
   void WriteVP9RenderSize(const UncompressedHeader *uncompressed_header) {
     // Write render and frame size difference bit
     // TODO: Maybe mutate this a bit more granularly
-    WriteBitUInt(uncompressed_header->render_size().render_and_frame_size_different(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_AND_FRAME_SIZE_DIFFERENT>(uncompressed_header->render_size().render_and_frame_size_different());
     if (uncompressed_header->render_size().render_and_frame_size_different() == 1) {
-      WriteBitUInt(uncompressed_header->render_size().render_width_minus_1(), 16);
-      WriteBitUInt(uncompressed_header->render_size().render_height_minus_1(), 16);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_WIDTH_MINUS_1>(uncompressed_header->render_size().render_width_minus_1());
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_HEIGHT_MINUS_1>(uncompressed_header->render_size().render_height_minus_1());
     }
   }
 
   void WriteVP9FrameSizeWithRefs(const UncompressedHeader *uncompressed_header) {
     // Write frame size with refs
-    WriteBitUInt(uncompressed_header->frame_size_found_ref(), 3); // TODO: Check that this is 3 and not 1 bits
-    if (uncompressed_header->frame_size_found_ref() == 0) {
+    // The found_ref flags up to the highest set bit of the field, the reference it picks
+    uint32_t frame_size_found_ref = uncompressed_header->frame_size_found_ref() & 0x7;
+    for (uint32_t i = 0; i < VP9Fuzzer::VP9_SYNTAX_FRAME_SIZE_FOUND_REF.count; i++) {
+      uint32_t found_ref = (frame_size_found_ref >> (2 - i)) & 0x1;
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_SIZE_FOUND_REF>(found_ref);
+      if (found_ref == 1) {
+        break;
+      }
+    }
+    if (frame_size_found_ref == 0) {
       WriteVP9FrameSize(uncompressed_header);
     }
     WriteVP9RenderSize(uncompressed_header);
   }
 
   void WriteVP9ReadInterpolationFilter(const UncompressedHeader *uncompressed_header) {
-    WriteBitUInt(uncompressed_header->read_interpolation_filter().is_filter_switchable(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_IS_FILTER_SWITCHABLE>(uncompressed_header->read_interpolation_filter().is_filter_switchable());
     // Write interpolation filter if switchable
     if (uncompressed_header->read_interpolation_filter().is_filter_switchable() == 1) {
       interpolation_filter = UncompressedHeader_InterpolationFilter_SWITCHABLE;
     }
     else {
       interpolation_filter = uncompressed_header->read_interpolation_filter().raw_interpolation_filter();
-      WriteBitUInt(interpolation_filter, 2);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RAW_INTERPOLATION_FILTER>(interpolation_filter);
     }
   }
 
   void WriteVP9ReadDeltaQ(const UncompressedHeader_QuantizationParams_ReadDeltaQ read_delta_q) {
-    WriteBitUInt(read_delta_q.delta_coded(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_DELTA_CODED>(read_delta_q.delta_coded());
     if (read_delta_q.delta_coded() == 1) {
-      WriteVP9SignedInteger(&read_delta_q.delta_q(), 4);
+      WriteVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_DELTA_Q>(&read_delta_q.delta_q());
     }
   }
 
   void WriteVP9QuantizationParams(const UncompressedHeader *uncompressed_header) {
     // Write quantization params
-    WriteBitUInt(uncompressed_header->quantization_params().base_q_idx(), 8);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_BASE_Q_IDX>(uncompressed_header->quantization_params().base_q_idx());
     WriteVP9ReadDeltaQ(uncompressed_header->quantization_params().delta_q_y_dc());
     WriteVP9ReadDeltaQ(uncompressed_header->quantization_params().delta_q_uv_dc());
     WriteVP9ReadDeltaQ(uncompressed_header->quantization_params().delta_q_uv_ac());
@@ -278,26 +396,26 @@ public:
   }
 
   void WriteVP9RefDelta(VP9BitField update_ref_delta, const VP9SignedInteger* loop_filter_ref_delta) {
-    WriteBitUInt(update_ref_delta, 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_REF_DELTA>(update_ref_delta);
     // std::cout << "Update Ref Delta: " << update_ref_delta << std::endl;
     if (update_ref_delta == 1) {
-      WriteVP9SignedInteger(loop_filter_ref_delta, 6);
+      WriteVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_REF_DELTAS>(loop_filter_ref_delta);
     } 
   }
 
   void WriteVP9ModeDelta(VP9BitField update_mode_delta, const VP9SignedInteger* loop_filter_mode_delta) {
-    WriteBitUInt(update_mode_delta, 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_MODE_DELTA>(update_mode_delta);
     if (update_mode_delta) {
-      WriteVP9SignedInteger(loop_filter_mode_delta, 6);
+      WriteVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_MODE_DELTAS>(loop_filter_mode_delta);
     }
   }
 
   void WriteVP9LoopFilterParams(const UncompressedHeader *uncompressed_header) {
-    WriteBitUInt(uncompressed_header->loop_filter_params().loop_filter_level(), 6);
-    WriteBitUInt(uncompressed_header->loop_filter_params().loop_filter_sharpness(), 3);
-    WriteBitUInt(uncompressed_header->loop_filter_params().loop_filter_delta_enabled(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_LEVEL>(uncompressed_header->loop_filter_params().loop_filter_level());
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_SHARPNESS>(uncompressed_header->loop_filter_params().loop_filter_sharpness());
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_DELTA_ENABLED>(uncompressed_header->loop_filter_params().loop_filter_delta_enabled());
     if (uncompressed_header->loop_filter_params().loop_filter_delta_enabled() == 1) {
-      WriteBitUInt(uncompressed_header->loop_filter_params().loop_filter_delta_update(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_DELTA_UPDATE>(uncompressed_header->loop_filter_params().loop_filter_delta_update());
       if (uncompressed_header->loop_filter_params().loop_filter_delta_update() == 1) {
         // Write ref deltas
         for (int i = 0; i < 4; i++) {
@@ -326,56 +444,57 @@ public:
   }
 
   void WriteVP9SegmentationParamsFeature(const UncompressedHeader_SegmentationParams_Feature* feature, uint32_t seg_lvl_max) {
-    WriteBitUInt(feature->feature_enabled(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FEATURE_ENABLED>(feature->feature_enabled());
 
     if (feature->feature_enabled() == 1) {
       WriteBitString(feature->feature_value(), VP9Fuzzer::segmentation_feature_bits[seg_lvl_max]);
       if (VP9Fuzzer::segmentation_feature_signed[seg_lvl_max] == 1) {
-        WriteBitUInt(feature->feature_sign(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FEATURE_SIGN>(feature->feature_sign());
       }
     }
   }
 
+  template <const VP9Fuzzer::VP9SyntaxElement& Element>
   void WriteVP9SegmentationParamsReadProb(const VP9BitField prob_coded, uint32_t prob) {
-    WriteBitUInt(prob_coded, 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_PROB_CODED>(prob_coded);
     if (prob_coded) {
-      WriteBitUInt(prob, 8);
+      WriteVP9Element<Element>(prob);
     }
   }
 
   void WriteVP9SegmentationParams(const UncompressedHeader *uncompressed_header) {
-    WriteBitUInt(uncompressed_header->segmentation_params().segmentation_enabled(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_ENABLED>(uncompressed_header->segmentation_params().segmentation_enabled());
     if (uncompressed_header->segmentation_params().segmentation_enabled() == 1) {
-      WriteBitUInt(uncompressed_header->segmentation_params().segmentation_update_map(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_UPDATE_MAP>(uncompressed_header->segmentation_params().segmentation_update_map());
       // Write Segmentation Probabilities
       if (uncompressed_header->segmentation_params().segmentation_update_map() == 1) {
         int32_t probs_read = 0;
-        for (int i = 0; i < 7; i++) {
+        for (uint32_t i = 0; i < VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TREE_PROBS.count; i++) {
           if (probs_read < uncompressed_header->segmentation_params().prob().size()) {
             auto prob = uncompressed_header->segmentation_params().prob().at(probs_read++);
-            WriteVP9SegmentationParamsReadProb(prob.prob_coded(), prob.prob());
+            WriteVP9SegmentationParamsReadProb<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TREE_PROBS>(prob.prob_coded(), prob.prob());
           }
           else {
-            WriteVP9SegmentationParamsReadProb((VP9BitField) 0, 0);
+            WriteVP9SegmentationParamsReadProb<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TREE_PROBS>((VP9BitField) 0, 0);
           }
         }
-        WriteBitUInt(uncompressed_header->segmentation_params().segmentation_temporal_update(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TEMPORAL_UPDATE>(uncompressed_header->segmentation_params().segmentation_temporal_update());
         if (uncompressed_header->segmentation_params().segmentation_temporal_update()) {
-          for (int i = 0; i < 3; i++) {
+          for (uint32_t i = 0; i < VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_PRED_PROBS.count; i++) {
             if (probs_read < uncompressed_header->segmentation_params().prob().size()) {
               auto prob = uncompressed_header->segmentation_params().prob().at(probs_read++);
-              WriteVP9SegmentationParamsReadProb(prob.prob_coded(), prob.prob());
+              WriteVP9SegmentationParamsReadProb<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_PRED_PROBS>(prob.prob_coded(), prob.prob());
             }
             else {
-              WriteVP9SegmentationParamsReadProb((VP9BitField) 0, 0);
+              WriteVP9SegmentationParamsReadProb<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_PRED_PROBS>((VP9BitField) 0, 0);
             }
           }
         }
       }
       // Write Segmentation Features
-      WriteBitUInt(uncompressed_header->segmentation_params().segmentation_update_data(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_UPDATE_DATA>(uncompressed_header->segmentation_params().segmentation_update_data());
       if (uncompressed_header->segmentation_params().segmentation_update_data() == 1) {
-        WriteBitUInt(uncompressed_header->segmentation_params().segmentation_abs_or_delta_update(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_ABS_OR_DELTA_UPDATE>(uncompressed_header->segmentation_params().segmentation_abs_or_delta_update());
         
         // Write features
         int32_t feature_index = 0;
@@ -424,46 +543,53 @@ public:
         increment_tile_cols_log2 = uncompressed_header->tile_info().increment_tile_cols_log2().at(inc_count++);
       }
       // Write it to the packet
-      WriteBitUInt(increment_tile_cols_log2, 1);
-      if (increment_tile_cols_log2) {
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_INCREMENT_TILE_COLS_LOG2>(increment_tile_cols_log2);
+      if (increment_tile_cols_log2 & 0b1) {
         ++tile_cols_log2;
       }
       else break;
     }
     // Then write tile_rows_log2
-    WriteBitUInt(uncompressed_header->tile_info().tile_rows_log2(), 1);
-    if (uncompressed_header->tile_info().tile_rows_log2() == 1) {
-      WriteBitUInt(uncompressed_header->tile_info().increment_tile_rows_log2(), 1); 
+    uint32_t tile_rows_log2 = uncompressed_header->tile_info().tile_rows_log2() & 0b1;
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_TILE_ROWS_LOG2>(tile_rows_log2);
+    if (tile_rows_log2 == 1) {
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_INCREMENT_TILE_ROWS_LOG2>(uncompressed_header->tile_info().increment_tile_rows_log2()); 
+      tile_rows_log2 += uncompressed_header->tile_info().increment_tile_rows_log2() & 0b1;
     }
+    // The tile layout of the frame follows from what was written, not from the proto
+    TileColsLog2 = tile_cols_log2;
+    TileRowsLog2 = tile_rows_log2;
   }
 
   void WriteVP9UncompressedHeader(const UncompressedHeader *uncompressed_header) {
     // Write uncompressed header frame marker
-    WriteBitUInt(2, 2);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_MARKER>(2);
     // Write profile bits
-    profile = (uncompressed_header->profile_high_bit() << 1) + uncompressed_header->profile_low_bit();
-    WriteBitUInt(uncompressed_header->profile_low_bit(), 1);
-    WriteBitUInt(uncompressed_header->profile_high_bit(), 1);
+    profile = ((uncompressed_header->profile_high_bit() & 0x1) << 1) + (uncompressed_header->profile_low_bit() & 0x1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_PROFILE_LOW_BIT>(uncompressed_header->profile_low_bit());
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_PROFILE_HIGH_BIT>(uncompressed_header->profile_high_bit());
     // Write zero bit if needed
     if (profile == 3) {
-      WriteBitUInt(uncompressed_header->reserved_zero(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>(uncompressed_header->reserved_zero());
     }
     // Write show existing frame bit
-    WriteBitUInt(uncompressed_header->show_existing_frame(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SHOW_EXISTING_FRAME>(uncompressed_header->show_existing_frame());
     // Write existing frame info if existing frame bit is set
     if (uncompressed_header->show_existing_frame() == 1) {
-      WriteBitUInt(uncompressed_header->frame_to_show_map_idx(), 3);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_TO_SHOW_MAP_IDX>(uncompressed_header->frame_to_show_map_idx());
       header_size_in_bytes = 0;
       return;
     }
     // Write frame type
     // std::cout << "Frame Type: " << uncompressed_header->frame_type() << std::endl;
-    WriteBitUInt(uncompressed_header->frame_type(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_TYPE>(uncompressed_header->frame_type());
     // Write show frame bit
     // std::cout << "Show Frame: " << uncompressed_header->show_frame() << std::endl;
-    WriteBitUInt(uncompressed_header->show_frame(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SHOW_FRAME>(uncompressed_header->show_frame());
     // Write error resilience mode bit
-    WriteBitUInt(uncompressed_header->error_resilient_mode(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_ERROR_RESILIENT_MODE>(uncompressed_header->error_resilient_mode());
+    // Only set by this frame's sign biases, it doesn't carry over from the frame before
+    compoundReferenceAllowed = false;
     // Write certain info if frame is not a key frame
     if (uncompressed_header->frame_type() == UncompressedHeader_FrameType_KEY_FRAME) {
       FrameIsIntra = true;
@@ -477,12 +603,12 @@ public:
       uint32_t intra_only = 0;
       if (uncompressed_header->show_frame() == 0) {
         intra_only = uncompressed_header->intra_only();
-        WriteBitUInt(intra_only, 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_INTRA_ONLY>(intra_only);
       }
       FrameIsIntra = intra_only;
       // Write reset_frame_context if error_resilient_mode
       if (uncompressed_header->error_resilient_mode() == 0) {
-        WriteBitUInt(uncompressed_header->reset_frame_context(), 2);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_RESET_FRAME_CONTEXT>(uncompressed_header->reset_frame_context());
       }
       // Write conditional intra frame data
       if (intra_only == 1) {
@@ -492,30 +618,30 @@ public:
           WriteVP9ColorConfig(uncompressed_header);
         }
         // Write intra frame info
-        WriteBitUInt(uncompressed_header->refresh_frame_flags(), 8);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_FLAGS>(uncompressed_header->refresh_frame_flags());
         WriteVP9FrameSize(uncompressed_header);
         WriteVP9RenderSize(uncompressed_header);
       }
       else {
-        WriteBitUInt(uncompressed_header->refresh_frame_flags(), 8);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_FLAGS>(uncompressed_header->refresh_frame_flags());
         for (int32_t i = 0; i < 3; i++) {
           // Write frame index
           if (i < uncompressed_header->ref_frame_idx().size()) {
-            WriteBitUInt(uncompressed_header->ref_frame_idx().at(i), 3);
+            WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_IDX>(uncompressed_header->ref_frame_idx().at(i));
           }
           else {
-            WriteBitUInt(0, 3);
+            WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_IDX>(0);
           }
           // Write frame sign bias
           if (i < uncompressed_header->ref_frame_sign_bias().size()) {
-            WriteBitUInt(uncompressed_header->ref_frame_sign_bias().at(i), 1);
+            WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_SIGN_BIAS>(uncompressed_header->ref_frame_sign_bias().at(i));
             // Check if compound references are allowed
             if (i != 0 && uncompressed_header->ref_frame_sign_bias().at(i) != uncompressed_header->ref_frame_sign_bias().at(0)) {
               compoundReferenceAllowed = true;
             }
           }
           else {
-            WriteBitUInt(0, 1);
+            WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_SIGN_BIAS>(0);
             // Check if compound references are allowed
             if (i != 0 && uncompressed_header->ref_frame_sign_bias().size() > 0 && uncompressed_header->ref_frame_sign_bias().at(0) != 0) {
               compoundReferenceAllowed = true;
@@ -524,17 +650,29 @@ public:
         }
         WriteVP9FrameSizeWithRefs(uncompressed_header);
         allow_high_precision_mv = uncompressed_header->allow_high_precision_mv();
-        WriteBitUInt(allow_high_precision_mv, 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_ALLOW_HIGH_PRECISION_MV>(allow_high_precision_mv);
         WriteVP9ReadInterpolationFilter(uncompressed_header);
       }
     }
+    // Size from the frame or its reference slot, the tile info depends on it. The slots follow the
+    // refresh_frame_flags actually written
+    const VP9Fuzzer::VP9FrameFormat& frame_format = VP9Fuzzer::ResolveVP9FrameFormat(&ref_slots, *uncompressed_header);
+    FrameWidth = frame_format.width;
+    FrameHeight = frame_format.height;
+    ComputeImageSize();
+    if (uncompressed_header->frame_type() == UncompressedHeader_FrameType_KEY_FRAME) {
+      VP9Fuzzer::RefreshVP9RefSlots(&ref_slots, 0xff);
+    }
+    else {
+      VP9Fuzzer::RefreshVP9RefSlots(&ref_slots, uncompressed_header->refresh_frame_flags());
+    }
     // Write frame context data if error resilient mode is on
     if (uncompressed_header->error_resilient_mode() == 0) {
-      WriteBitUInt(uncompressed_header->refresh_frame_flags(), 1);
-      WriteBitUInt(uncompressed_header->frame_parallel_decoding_mode(), 1);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_CONTEXT>(uncompressed_header->refresh_frame_context());
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_PARALLEL_DECODING_MODE>(uncompressed_header->frame_parallel_decoding_mode());
     }
     // Write frame_context_idx
-    WriteBitUInt(uncompressed_header->frame_context_idx(), 2);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_CONTEXT_IDX>(uncompressed_header->frame_context_idx());
     // Write final header data
     WriteVP9LoopFilterParams(uncompressed_header);
     WriteVP9QuantizationParams(uncompressed_header);
@@ -543,137 +681,147 @@ public:
     // Write header size
     // TODO: Maybe try something more interesting here
     // header_size_in_bytes = uncompressed_header->header_size_in_bytes();
-    // WriteBitUInt(header_size_in_bytes, 16);
+    // WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_HEADER_SIZE_IN_BYTES>(header_size_in_bytes);
   }
 
+  template <bool FrameLossless>
   void WriteVP9ReadTxMode(const CompressedHeader *compressed_header) {
-    if (Lossless == true) {
+    if (FrameLossless) {
       tx_mode = CompressedHeader_TxMode_ONLY_4X4;
     }
     else {
-      tx_mode = compressed_header->read_tx_mode().tx_mode();
-      WriteLiteral(tx_mode, 2);
+      // The coded bits of a mutated tx_mode, it indexes tables up to TX_MODE_SELECT
+      tx_mode = compressed_header->read_tx_mode().tx_mode() & 0x3;
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_TX_MODE>(tx_mode);
       if (tx_mode == CompressedHeader_TxMode_ALLOW_32X32) {
-        WriteLiteral(compressed_header->read_tx_mode().tx_mode_select(), 1);
-        tx_mode += (uint32_t) compressed_header->read_tx_mode().tx_mode_select();
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_TX_MODE_SELECT>(compressed_header->read_tx_mode().tx_mode_select());
+        tx_mode += (uint32_t) compressed_header->read_tx_mode().tx_mode_select() & 0x1;
       }
     }
   }
 
-  void WriteVP9Uniform(uint32_t v) {
-    // for v field in decode_term_subexp
-    const int l = 8;
-    const int m = (1 << l) - 191;
-    if (v < m) {
-      WriteLiteral(v, l - 1);
-    } else {
-      WriteLiteral(m + ((v - m) >> 1), l - 1);
-      WriteLiteral((v - m) & 1, 1);
-    }
-  }
-
   void WriteVP9DecodeTermSubexp(const CompressedHeader_DecodeTermSubexp *decode_term_subexp) {
-    WriteLiteral(decode_term_subexp->bit_1(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_1>(decode_term_subexp->bit_1());
     if (decode_term_subexp->bit_1() == 0) {
-      WriteLiteral(decode_term_subexp->sub_exp_val(), 4);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL>(decode_term_subexp->sub_exp_val());
       return;
     }
-    WriteLiteral(decode_term_subexp->bit_2(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_2>(decode_term_subexp->bit_2());
     if (decode_term_subexp->bit_2() == 0) {
-      WriteLiteral(decode_term_subexp->sub_exp_val_minus_16(), 4);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL_MINUS_16>(decode_term_subexp->sub_exp_val_minus_16());
       return;
     }
-    WriteLiteral(decode_term_subexp->bit_3(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_3>(decode_term_subexp->bit_3());
     if (decode_term_subexp->bit_3() == 0) {
-      WriteLiteral(decode_term_subexp->sub_exp_val_minus_32(), 5);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL_MINUS_32>(decode_term_subexp->sub_exp_val_minus_32());
       return;
     }
-    WriteVP9Uniform(decode_term_subexp->v());
+    // decode_uniform, the 7 bits of v and the extra bit_4 when v >= 65
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_V>(decode_term_subexp->v());
     if (decode_term_subexp->v() < 65) {
       return;
     }
-    WriteLiteral(decode_term_subexp->bit_4(), 1);
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_4>(decode_term_subexp->bit_4());
   }
 
-  void WriteVP9DiffUpdateProb(CompressedHeader_DiffUpdateProb *diff_update_prob) {
+  void WriteVP9DiffUpdateProb(const CompressedHeader_DiffUpdateProb *diff_update_prob, int32_t prob) {
     // Write Update Prob bit
-    WriteBool(diff_update_prob->update_prob(), 252);
+    WriteBool(diff_update_prob->update_prob(), prob);
     // Write term subexp if we want to update probs
     if (diff_update_prob->update_prob() == 1) {
       WriteVP9DecodeTermSubexp(&diff_update_prob->decode_term_subexp());
     }
   }
 
-  void WriteVP9DiffUpdateProbs(const google::protobuf::RepeatedPtrField<CompressedHeader_DiffUpdateProb> *diff_update_probs, int32_t max_writes) {
-    // Writes (0 < n < max_writes) count of DiffUpdateProb objects to the VP9 frame
+  template <const VP9Fuzzer::VP9SyntaxElement& Element>
+  void WriteVP9DiffUpdateProbs(const google::protobuf::RepeatedPtrField<CompressedHeader_DiffUpdateProb> *diff_update_probs,
+                               const google::protobuf::RepeatedPtrField<CompressedHeader_SparseDiffUpdateProb> *sparse_diff_update_probs,
+                               int32_t first_index = 0) {
+    // Writes the Element.count DiffUpdateProb objects of a section starting at loop index first_index to the VP9 frame
+    // A SparseDiffUpdateProb overrides the DiffUpdateProb at its index, every other index is a zero update flag.
+    // The count is a compile time constant, the sparse table only has to be cleared for the indexes written
+    static_assert(Element.coding == VP9Fuzzer::VP9_SYNTAX_DIFF_UPDATE, "not a diff_update_prob() loop");
+    const int32_t max_writes = Element.count;
+    const CompressedHeader_DecodeTermSubexp* sparse_updates[max_writes] = {};
+    for (const CompressedHeader_SparseDiffUpdateProb &sparse_diff_update_prob : *sparse_diff_update_probs) {
+      int64_t sparse_index = (int64_t) sparse_diff_update_prob.index() - first_index;
+      if (sparse_index >= 0 && sparse_index < max_writes) {
+        sparse_updates[sparse_index] = &sparse_diff_update_prob.decode_term_subexp();
+      }
+    }
+    // Zero update flags are batched into runs and written in one step
+    uint32_t zero_run = 0;
     for (int32_t i = 0; i < max_writes; i++) {
-      // Check if we have a diff_update_prob object to write
-      if (i < diff_update_probs->size()) {
-        // Get diff update probability object at index
-        CompressedHeader_DiffUpdateProb diff_update_prob = diff_update_probs->at(i);
-        // Write the object
-        WriteVP9DiffUpdateProb(&diff_update_prob);
-        // // std::cout << "Diff Bool Bytes: " << BoolPos << std::endl;
-
+      int32_t index = first_index + i;
+      // Write the sparse update if we have one for this index
+      if (sparse_updates[i] != nullptr) {
+        WriteBoolZeroRun(zero_run, Element.prob);
+        zero_run = 0;
+        WriteBool(1, Element.prob);
+        WriteVP9DecodeTermSubexp(sparse_updates[i]);
+      }
+      // Check if we have an updating diff_update_prob object to write
+      else if (index < diff_update_probs->size() && diff_update_probs->Get(index).update_prob() != 0) {
+        // Write the diff update probability object at index
+        WriteBoolZeroRun(zero_run, Element.prob);
+        zero_run = 0;
+        WriteVP9DiffUpdateProb(&diff_update_probs->Get(index), Element.prob);
       }
-      // If we have no more diff_update_prob objects to write, just write empty objects
+      // Non-updating and missing diff_update_prob objects are both a zero update flag
       else {
-        WriteLiteral(0, 1);
+        zero_run++;
       }
     }
+    WriteBoolZeroRun(zero_run, Element.prob);
   }
 
-  void WriteVP9TxModeProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->tx_mode_probs().diff_update_prob(), 12);
+  template <const VP9Fuzzer::VP9SyntaxElement& Element, typename Section>
+  void WriteVP9ProbsSection(const Section& section) {
+    // Sections that are a single diff_update_prob() loop
+    WriteVP9DiffUpdateProbs<Element>(&section.diff_update_prob(), &section.sparse_diff_update_prob());
   }
 
+  bool IsVP9SectionPresent(const VP9Fuzzer::VP9SyntaxElement& element, bool frame_is_intra) {
+    // Condition of a compressed header element of vp9_syntax.h, from the header written so far. frame_is_intra is
+    // passed by the writers of a frame class so the conditions fold
+    VP9Fuzzer::VP9SyntaxState state = {tx_mode, frame_is_intra, interpolation_filter, compoundReferenceAllowed,
+                                       reference_mode, allow_high_precision_mv};
+    return VP9Fuzzer::IsVP9SyntaxPresent(element.condition, state);
+  }
+
+  template <bool FrameLossless>
   void WriteVP9ReadCoefProbs(const CompressedHeader *compressed_header) {
-    // Loop write count for tx_size max size
-    for (int32_t txSz = VP9Fuzzer::TX_4X4; txSz <= VP9Fuzzer::tx_mode_to_biggest_tx_size[tx_mode]; txSz++) {
+    // Loop write count for tx_size max size, lossless frames only have 4x4 transforms
+    const int32_t max_tx_size = FrameLossless ? (int32_t) VP9Fuzzer::TX_4X4 : VP9Fuzzer::tx_mode_to_biggest_tx_size[tx_mode];
+    for (int32_t txSz = VP9Fuzzer::TX_4X4; txSz <= max_tx_size; txSz++) {
       // Check if we have a ReadCoefsProbsLoop object for this iteration
       if (txSz < compressed_header->read_coef_probs().read_coef_probs().size()) {
         // If so, grab the object
-        auto loop_obj = compressed_header->read_coef_probs().read_coef_probs().at(txSz);
+        const auto &loop_obj = compressed_header->read_coef_probs().read_coef_probs(txSz);
         // Write the update_probs indicator bit
         // std::cout << "Update Read Coef Probs: " << loop_obj.update_probs() << std::endl;
-        WriteLiteral(loop_obj.update_probs(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_PROBS>(loop_obj.update_probs());
         if (loop_obj.update_probs() == 1) {
           // Write diff_update_probs objects
-          WriteVP9DiffUpdateProbs(&loop_obj.diff_update_prob(), 396);
+          WriteVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COEF_PROBS>(&loop_obj.diff_update_prob(), &loop_obj.sparse_diff_update_prob());
         }
       }
       // Otherwise just write 1 0b0 bit to indicate we don't want to update probs
       else {
-        WriteLiteral(0, 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_PROBS>(0);
       }
     }
   }
 
-  void WriteVP9ReadSkipProb(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_skip_prob().diff_update_prob(), 3);
-  }
-
-  void WriteVP9ReadInterModeProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_inter_mode_probs().diff_update_prob(), 21);
-  }
-
-  void WriteVP9ReadInterpFilterProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_interp_filter_probs().diff_update_prob(), 14);
-  }
-
-  void WriteVP9ReadIsInterProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_is_inter_probs().diff_update_prob(), 4);
-  }
-
   void WriteVP9FrameReferenceMode(const CompressedHeader *compressed_header) {
-    if (compoundReferenceAllowed == 1) {
-      WriteLiteral(compressed_header->frame_reference_mode().non_single_reference(), 1);
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_NON_SINGLE_REFERENCE, false)) {
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_NON_SINGLE_REFERENCE>(compressed_header->frame_reference_mode().non_single_reference());
       // Set reference mode state variable
       if (compressed_header->frame_reference_mode().non_single_reference() == 0) {
         reference_mode = VP9Fuzzer::SINGLE_REFERENCE;
       }
       else {
-        WriteLiteral(compressed_header->frame_reference_mode().reference_select(), 1);
+        WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_REFERENCE_SELECT>(compressed_header->frame_reference_mode().reference_select());
         if (compressed_header->frame_reference_mode().reference_select() == 0) {
           reference_mode = VP9Fuzzer::COMPOUND_REFERENCE;
         }
@@ -688,146 +836,440 @@ public:
   }
 
   void WriteVP9FrameReferenceModeProbs(const CompressedHeader *compressed_header) {
-    // TODO: Make this write sequential diff_update_prob objects instead of the same ones
-    if (reference_mode == VP9Fuzzer::REFERENCE_MODE_SELECT) {
-      WriteVP9DiffUpdateProbs(&compressed_header->frame_reference_mode_probs().diff_update_prob(), 5);
+    // Loops continue each other's indexes, same as the reader
+    auto diff_update_probs = &compressed_header->frame_reference_mode_probs().diff_update_prob();
+    auto sparse_diff_update_probs = &compressed_header->frame_reference_mode_probs().sparse_diff_update_prob();
+    int32_t written_count = 0;
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB, false)) {
+      WriteVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+      written_count += VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB.count;
     }
-    if (reference_mode != VP9Fuzzer::COMPOUND_REFERENCE) {
-      WriteVP9DiffUpdateProbs(&compressed_header->frame_reference_mode_probs().diff_update_prob(), 5);
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB, false)) {
+      WriteVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+      written_count += VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB.count;
     }
-    if (reference_mode != VP9Fuzzer::SINGLE_REFERENCE) {
-      WriteVP9DiffUpdateProbs(&compressed_header->frame_reference_mode_probs().diff_update_prob(), 5);
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB, false)) {
+      WriteVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+      written_count += VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB.count;
     }
   }
 
-  void WriteVP9ReadYModeProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_y_mode_probs().diff_update_prob(), 36);
-  }
-
-  void WriteVP9ReadPartitionProbs(const CompressedHeader *compressed_header) {
-    WriteVP9DiffUpdateProbs(&compressed_header->read_partition_probs().diff_update_prob(), 48);
-  }
-
   void WriteVP9MvProbsLoop(VP9BitField update_mv_prob, uint32_t mv_prob) {
-    WriteBool(update_mv_prob, 252);
+    WriteBool(update_mv_prob, VP9Fuzzer::VP9_SYNTAX_MV_PROBS.prob);
     if (update_mv_prob == 1) {
-      WriteLiteral(mv_prob, 7);
+      WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_MV_PROB>(mv_prob);
     }
   }
 
+  template <bool HighPrecisionMv>
   void WriteVP9MvProbs(const CompressedHeader *compressed_header) {
-    // First 3 loop stacks
+    // The mv_probs loops, plus the high precision ones
+    const uint32_t prob = VP9Fuzzer::VP9_SYNTAX_MV_PROBS.prob;
     std::size_t mv_probs_size = compressed_header->mv_probs().mv_probs().size();
-    for (uint32_t i = 0; i < 45; i++) {
-      // Write mv prob loop objects if we have one
-      if (i < mv_probs_size) {
-        CompressedHeader_MvProbs_MvProbsLoop mv_probs_loop = compressed_header->mv_probs().mv_probs().at(i);
+    const uint32_t mv_probs_count = VP9Fuzzer::VP9_SYNTAX_MV_PROBS.count + (HighPrecisionMv ? VP9Fuzzer::VP9_SYNTAX_MV_HP_PROBS.count : 0);
+    // Zero update flags are batched into runs and written in one step
+    uint32_t zero_run = 0;
+    for (uint32_t i = 0; i < mv_probs_count; i++) {
+      // Write mv prob loop objects if we have an updating one
+      if (i < mv_probs_size && compressed_header->mv_probs().mv_probs(i).update_mv_prob() != 0) {
+        const CompressedHeader_MvProbs_MvProbsLoop &mv_probs_loop = compressed_header->mv_probs().mv_probs(i);
+        WriteBoolZeroRun(zero_run, prob);
+        zero_run = 0;
         WriteVP9MvProbsLoop(mv_probs_loop.update_mv_prob(), mv_probs_loop.mv_prob());
       }
       // Otherwise write an empty one
       else {
-        WriteVP9MvProbsLoop((VP9BitField) 0, 0);
+        zero_run++;
       }
     }
-    // Last conditional loop
-    if (allow_high_precision_mv) {
-      for (uint32_t i = 45; i < (45 + 4); i++) { 
-        // Write mv prob loop objects if we have one
-        if (i < mv_probs_size) {
-          CompressedHeader_MvProbs_MvProbsLoop mv_probs_loop = compressed_header->mv_probs().mv_probs().at(i);
-          WriteVP9MvProbsLoop(mv_probs_loop.update_mv_prob(), mv_probs_loop.mv_prob());
+    WriteBoolZeroRun(zero_run, prob);
+  }
+
+  void WriteVP9CompressedHeader(const CompressedHeader *compressed_header) {
+    // Picks the writer of the frame class once per frame, the parts of the header it doesn't have are compiled out.
+    // Profile and error_resilient_mode stay runtime branches, only the uncompressed header tests them
+    if (FrameIsIntra) {
+      Lossless ? WriteVP9CompressedHeaderFor<true, true>(compressed_header)
+               : WriteVP9CompressedHeaderFor<true, false>(compressed_header);
+    }
+    else {
+      Lossless ? WriteVP9CompressedHeaderFor<false, true>(compressed_header)
+               : WriteVP9CompressedHeaderFor<false, false>(compressed_header);
+    }
+  }
+
+  template <bool FrameIntra, bool FrameLossless>
+  void WriteVP9CompressedHeaderFor(const CompressedHeader *compressed_header) {
+    // Sections are written when their condition in vp9_syntax.h holds, the same ones the reader reads
+    WriteVP9ReadTxMode<FrameLossless>(compressed_header);
+    if (!FrameLossless && IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_TX_MODE_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_TX_MODE_PROBS>(compressed_header->tx_mode_probs());
+    }
+    WriteVP9ReadCoefProbs<FrameLossless>(compressed_header);
+    WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_SKIP_PROB>(compressed_header->read_skip_prob());
+
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_INTER_MODE_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_INTER_MODE_PROBS>(compressed_header->read_inter_mode_probs());
+    }
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_INTERP_FILTER_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_INTERP_FILTER_PROBS>(compressed_header->read_interp_filter_probs());
+    }
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_IS_INTER_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_IS_INTER_PROBS>(compressed_header->read_is_inter_probs());
+    }
+    // frame_reference_mode() and its probs pick their elements themselves
+    if (!FrameIntra) {
+      WriteVP9FrameReferenceMode(compressed_header);
+      WriteVP9FrameReferenceModeProbs(compressed_header);
+    }
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_Y_MODE_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_Y_MODE_PROBS>(compressed_header->read_y_mode_probs());
+    }
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_PARTITION_PROBS, FrameIntra)) {
+      WriteVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_PARTITION_PROBS>(compressed_header->read_partition_probs());
+    }
+    if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_MV_PROBS, FrameIntra)) {
+      if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_MV_HP_PROBS, FrameIntra)) {
+        WriteVP9MvProbs<true>(compressed_header);
+      }
+      else {
+        WriteVP9MvProbs<false>(compressed_header);
+      }
+    }
+  }
+
+  static bool VP9TreeHas(const int8_t* tree, int32_t i, uint32_t value) {
+    // Whether the subtree at node i has the leaf value, leaves are stored negated
+    if (i <= 0) {
+      return (uint32_t) -i == value;
+    }
+    return VP9TreeHas(tree, tree[i], value) || VP9TreeHas(tree, tree[i + 1], value);
+  }
+
+  uint32_t WriteVP9Tree(const int8_t* tree, const uint8_t* probs, uint32_t value) {
+    // Writes the path to the leaf value, a value not in the tree takes the left branches. Returns the value written
+    int32_t i = 0;
+    do {
+      int32_t bit = VP9TreeHas(tree, tree[i + 1], value);
+      WriteBool(bit, probs[i >> 1]);
+      i = tree[i + bit];
+    } while (i > 0);
+    return -i;
+  }
+
+  void WriteVP9CoefLevel(uint32_t token, uint32_t level) {
+    // read_coef() in spec, the extra bits of level above the smallest level of the token category
+    if (token < VP9Fuzzer::DCT_VAL_CAT1) {
+      return;
+    }
+    uint32_t cat = token - VP9Fuzzer::DCT_VAL_CAT1;
+    uint32_t extra = level - VP9Fuzzer::cat_min_level[cat];
+    uint32_t bits = VP9Fuzzer::cat_bits[cat];
+    if (token == VP9Fuzzer::DCT_VAL_CAT6) {
+      for (uint32_t bit = block_frame_info.bit_depth; bit --> 8;) {
+        WriteBool((extra >> (bit - 8 + bits)) & 1, 255);
+      }
+    }
+    for (uint32_t bit = 0; bit < bits; bit++) {
+      WriteBool((extra >> (bits - 1 - bit)) & 1, VP9Fuzzer::cat_probs[cat][bit]);
+    }
+  }
+
+  uint32_t WriteVP9Tokens(const TransformBlock* transform_block, uint32_t plane, uint32_t tx_size, uint32_t tx_type,
+                          uint32_t ctx) {
+    // tokens() in spec, returns the end of block. Only a block that fills the transform can end in zeros, the
+    // trailing zeros of a shorter one are dropped since no end of block can follow a zero
+    const uint8_t (*coef_probs)[6][3] = block_frame_info.probs.coef_probs[tx_size][plane > 0][0];
+    const uint16_t* scan = VP9Fuzzer::GetVP9Scan(tx_size, tx_type);
+    uint32_t max_eob = 16 << (tx_size << 1);
+    uint32_t eob = std::min<uint32_t>(transform_block->coef_size(), max_eob);
+    if (eob < max_eob) {
+      while (eob > 0 && transform_block->coef(eob - 1) == 0) {
+        eob--;
+      }
+    }
+    // Category 6 holds 14 extra bits plus BitDepth - 8 more
+    int64_t max_level = VP9Fuzzer::cat_min_level[5] + (1 << (block_frame_info.bit_depth + 6)) - 1;
+    uint32_t c = 0;
+    bool check_eob = true;
+    while (c < max_eob) {
+      if (c > 0) {
+        ctx = VP9Fuzzer::GetVP9CoefContext(&tile_context, scan, tx_size, tx_type, c);
+      }
+      const uint8_t* prob = coef_probs[VP9Fuzzer::GetVP9CoefBand(tx_size, c)][ctx];
+      if (check_eob) {
+        WriteBool(c < eob, prob[0]);
+        if (c == eob) {
+          break;
         }
-        // Otherwise write an empty one
-        else {
-          WriteVP9MvProbsLoop((VP9BitField) 0, 0);
+      }
+      int64_t coef = transform_block->coef(c);
+      uint32_t level = std::min<int64_t>(coef < 0 ? -coef : coef, max_level);
+      WriteBool(level != 0, prob[1]);
+      if (level == 0) {
+        tile_context.token_cache[scan[c]] = 0;
+        check_eob = false;
+        c++;
+        continue;
+      }
+      uint32_t token = VP9Fuzzer::GetVP9CoefToken(level);
+      WriteBool(token != VP9Fuzzer::ONE_TOKEN, prob[2]);
+      if (token != VP9Fuzzer::ONE_TOKEN) {
+        WriteVP9Tree(VP9Fuzzer::coef_con_tree, VP9Fuzzer::pareto8_full[prob[2] - 1], token);
+      }
+      WriteVP9CoefLevel(token, level);
+      WriteBool(coef < 0, 128);
+      tile_context.token_cache[scan[c]] = VP9Fuzzer::energy_class[token];
+      check_eob = true;
+      c++;
+    }
+    return eob;
+  }
+
+  void WriteVP9Residual(const Block* block, const VP9Fuzzer::VP9BlockInfo& info, uint32_t uv_mode, uint32_t mi_row,
+                        uint32_t mi_col, uint32_t bwl, uint32_t bhl) {
+    // residual() in spec for an intra block, the transform blocks missing from the proto have no coefficients
+    static const TransformBlock empty_transform_block;
+    uint32_t bw = 1 << (bwl - 1);
+    uint32_t bh = 1 << (bhl - 1);
+    int32_t index = 0;
+    for (uint32_t plane = 0; plane < 3; plane++) {
+      uint32_t ssx = plane > 0 ? block_frame_info.subsampling_x : 0;
+      uint32_t ssy = plane > 0 ? block_frame_info.subsampling_y : 0;
+      uint32_t n4_w = (bw << 1) >> ssx;
+      uint32_t n4_h = (bh << 1) >> ssy;
+      uint32_t x4 = (mi_col * 2) >> ssx;
+      uint32_t y4 = ((mi_row * 2) & 15) >> ssy;
+      // The above context has 16 columns past the frame, blocks of a mutated frame don't get past them. Rows of the
+      // left context wrap at 16
+      uint32_t above_size = tile_context.above_nonzero[plane].size();
+      if (info.skip) {
+        uint32_t clear_w = x4 < above_size ? std::min(n4_w, above_size - x4) : 0;
+        VP9Fuzzer::ClearVP9NonzeroContext(&tile_context, plane, x4, y4, clear_w, n4_h);
+        continue;
+      }
+      uint32_t tx_size = plane > 0 ? VP9Fuzzer::GetVP9UvTxSize(info.tx_size, bwl - ssx, bhl - ssy) : info.tx_size;
+      uint32_t step = 1 << tx_size;
+      // In 64 bits and not below 0, a block past the edge of the frame has no transform blocks instead of 4G
+      int64_t right_edge = ((int64_t) block_frame_info.mi_cols - bw - mi_col) * 64;
+      int64_t bottom_edge = ((int64_t) block_frame_info.mi_rows - bh - mi_row) * 64;
+      uint32_t max_blocks_wide = std::max<int64_t>(n4_w + (right_edge >= 0 ? 0 : right_edge >> (5 + ssx)), 0);
+      uint32_t max_blocks_high = std::max<int64_t>(n4_h + (bottom_edge >= 0 ? 0 : bottom_edge >> (5 + ssy)), 0);
+      for (uint32_t row = 0; row < max_blocks_high; row += step) {
+        for (uint32_t col = 0; col < max_blocks_wide && x4 + col + step <= above_size; col += step) {
+          uint32_t mode = plane > 0 ? uv_mode : info.sub_modes[info.sb_type < VP9Fuzzer::BLOCK_8X8 ? (row << 1) + col : 0];
+          uint32_t tx_type = (plane > 0 || block_frame_info.lossless) ? (uint32_t) VP9Fuzzer::DCT_DCT : (uint32_t) VP9Fuzzer::intra_mode_to_tx_type[mode];
+          uint32_t ctx = VP9Fuzzer::GetVP9NonzeroContext(&tile_context, plane, x4 + col, y4 + row, tx_size);
+          const TransformBlock* transform_block = index < block->transform_block_size() ? &block->transform_block(index) : &empty_transform_block;
+          index++;
+          uint32_t eob = WriteVP9Tokens(transform_block, plane, tx_size, tx_type, ctx);
+          VP9Fuzzer::SetVP9NonzeroContext(&tile_context, plane, x4 + col, y4 + row, tx_size,
+                                          max_blocks_wide - col, max_blocks_high - row, eob > 0);
         }
       }
     }
   }
 
-  void WriteVP9CompressedHeader(const CompressedHeader *compressed_header) {
-    // Write read_tx_mode
-    WriteVP9ReadTxMode(compressed_header);
-    // std::cout << "Starting Bits: " << bit_buffer.size() << std::endl;
-    // std::cout << "Bool Bytes: " << BoolPos << std::endl;
-    // Write tx mode probability info if select tx mode is enabled
-    // std::cout << "TXMODE: " << tx_mode << std::endl;
-    if (tx_mode == CompressedHeader_TxMode_TX_MODE_SELECT) {
-      WriteVP9TxModeProbs(compressed_header);
-    }
-    // std::cout << "Bool Bytes: " << BoolPos << std::endl;
-    // Write read probabilities
-    WriteVP9ReadCoefProbs(compressed_header);
-    WriteVP9ReadSkipProb(compressed_header);
-
-    // std::cout << "Bool Bytes: " << BoolPos << std::endl;
-
-    // std::cout << "FrameIsIntra: "<< FrameIsIntra << std::endl;
-
-    if (FrameIsIntra == false) {
-      // std::cout << "FRAME IS INTRA!" << std::endl;
-      WriteVP9ReadInterModeProbs(compressed_header);
-      if (interpolation_filter == UncompressedHeader_InterpolationFilter_SWITCHABLE) {
-        WriteVP9ReadInterpFilterProbs(compressed_header);
-      }
-      WriteVP9ReadIsInterProbs(compressed_header);
-      WriteVP9FrameReferenceMode(compressed_header);
-      WriteVP9FrameReferenceModeProbs(compressed_header);
-      WriteVP9ReadYModeProbs(compressed_header);
-      WriteVP9ReadPartitionProbs(compressed_header);
-      WriteVP9MvProbs(compressed_header);
+  void WriteVP9Block(const Block* block, uint32_t mi_row, uint32_t mi_col, uint32_t bsize, uint32_t bwl, uint32_t bhl) {
+    // decode_block() with intra_frame_mode_info() in spec, values out of range are clamped to what is written
+    const VP9Fuzzer::VP9FrameContext& probs = block_frame_info.probs;
+    const VP9Fuzzer::VP9BlockInfo* above = VP9Fuzzer::GetVP9AboveInfo(&tile_context, mi_row, mi_col);
+    const VP9Fuzzer::VP9BlockInfo* left = VP9Fuzzer::GetVP9LeftInfo(&tile_context, mi_row, mi_col);
+    VP9Fuzzer::VP9BlockInfo info;
+    info.sb_type = bsize;
+
+    if (block_frame_info.read_segment_id) {
+      info.segment_id = WriteVP9Tree(VP9Fuzzer::segment_tree, block_frame_info.segment_tree_probs, block->segment_id());
+    }
+    if (block_frame_info.segment_skip[info.segment_id]) {
+      info.skip = 1;
     }
+    else {
+      info.skip = block->skip() != 0;
+      WriteBool(info.skip, probs.skip_prob[VP9Fuzzer::GetVP9SkipContext(above, left)]);
+    }
+
+    uint32_t max_tx_size = VP9Fuzzer::max_txsize_lookup[bsize];
+    if (block_frame_info.tx_mode == CompressedHeader_TxMode_TX_MODE_SELECT && bsize >= VP9Fuzzer::BLOCK_8X8) {
+      const uint8_t* tx_probs = VP9Fuzzer::GetVP9TxProbs(probs, max_tx_size, VP9Fuzzer::GetVP9TxSizeContext(above, left, max_tx_size));
+      info.tx_size = std::min<uint32_t>(block->tx_size(), max_tx_size);
+      WriteBool(info.tx_size != 0, tx_probs[0]);
+      if (info.tx_size != 0 && max_tx_size >= 2) {
+        WriteBool(info.tx_size != 1, tx_probs[1]);
+        if (info.tx_size != 1 && max_tx_size >= 3) {
+          WriteBool(info.tx_size != 2, tx_probs[2]);
+        }
+      }
+    }
+    else {
+      info.tx_size = std::min<uint32_t>(max_tx_size, VP9Fuzzer::tx_mode_to_biggest_tx_size[block_frame_info.tx_mode]);
+    }
+
+    // One mode per coded 4x4 quarter like the reader, the modes missing from the proto are DC_PRED
+    uint32_t step_x = bsize == VP9Fuzzer::BLOCK_4X4 || bsize == VP9Fuzzer::BLOCK_4X8 ? 1 : 2;
+    uint32_t step_y = bsize == VP9Fuzzer::BLOCK_4X4 || bsize == VP9Fuzzer::BLOCK_8X4 ? 1 : 2;
+    uint32_t y_mode = VP9Fuzzer::DC_PRED;
+    int32_t index = 0;
+    for (uint32_t idy = 0; idy < 2; idy += step_y) {
+      for (uint32_t idx = 0; idx < 2; idx += step_x) {
+        uint32_t b = idy * 2 + idx;
+        uint32_t above_mode = VP9Fuzzer::GetVP9AboveMode(info, above, b);
+        uint32_t left_mode = VP9Fuzzer::GetVP9LeftMode(info, left, b);
+        uint32_t mode = index < block->default_intra_mode_size() ? (uint32_t) block->default_intra_mode(index) : (uint32_t) VP9Fuzzer::DC_PRED;
+        index++;
+        y_mode = WriteVP9Tree(VP9Fuzzer::intra_mode_tree, VP9Fuzzer::kf_y_mode_probs[above_mode][left_mode], mode);
+        for (uint32_t y = 0; y < step_y; y++) {
+          for (uint32_t x = 0; x < step_x; x++) {
+            info.sub_modes[b + y * 2 + x] = y_mode;
+          }
+        }
+      }
+    }
+    uint32_t uv_mode = WriteVP9Tree(VP9Fuzzer::intra_mode_tree, VP9Fuzzer::kf_uv_mode_probs[y_mode], block->default_uv_mode());
+
+    WriteVP9Residual(block, info, uv_mode, mi_row, mi_col, bwl, bhl);
+    VP9Fuzzer::StoreVP9BlockInfo(&tile_context, block_frame_info, mi_row, mi_col, 1 << (bwl - 1), 1 << (bhl - 1), info);
   }
 
-  void WriteVP9Tile(const Tile* tile, bool last_tile) {
-    // WriteBitUInt(tile->tile_size(), 32);
+  void WriteVP9Partition(const Partition* partition, uint32_t mi_row, uint32_t mi_col, uint32_t n4x4_l2) {
+    // decode_partition() in spec, the blocks and splits missing from the proto are default messages
+    static const Block empty_block;
+    static const Partition empty_partition;
+    uint32_t n8x8_l2 = n4x4_l2 - 1;
+    uint32_t num_8x8 = 1 << n8x8_l2;
+    uint32_t hbs = num_8x8 >> 1;
+    uint32_t bsize = VP9Fuzzer::BLOCK_8X8 + n8x8_l2 * 3;
+    bool has_rows = (mi_row + hbs) < block_frame_info.mi_rows;
+    bool has_cols = (mi_col + hbs) < block_frame_info.mi_cols;
+
+    const uint8_t* probs = VP9Fuzzer::kf_partition_probs[VP9Fuzzer::GetVP9PartitionContext(&tile_context, mi_row, mi_col, n8x8_l2)];
+    uint32_t partition_type = VP9Fuzzer::PARTITION_SPLIT;
+    if (has_rows && has_cols) {
+      partition_type = WriteVP9Tree(VP9Fuzzer::partition_tree, probs, partition->partition());
+    }
+    else if (has_cols) {
+      partition_type = partition->partition() == VP9Fuzzer::PARTITION_SPLIT ? VP9Fuzzer::PARTITION_SPLIT : VP9Fuzzer::PARTITION_HORZ;
+      WriteBool(partition_type == VP9Fuzzer::PARTITION_SPLIT, probs[1]);
+    }
+    else if (has_rows) {
+      partition_type = partition->partition() == VP9Fuzzer::PARTITION_SPLIT ? VP9Fuzzer::PARTITION_SPLIT : VP9Fuzzer::PARTITION_VERT;
+      WriteBool(partition_type == VP9Fuzzer::PARTITION_SPLIT, probs[2]);
+    }
+
+    auto get_block = [&](int32_t i) {
+      return i < partition->block_size() ? &partition->block(i) : &empty_block;
+    };
+    uint32_t subsize = VP9Fuzzer::subsize_lookup[partition_type][bsize];
+    if (hbs == 0) {
+      WriteVP9Block(get_block(0), mi_row, mi_col, subsize, 1, 1);
+    }
+    else if (partition_type == VP9Fuzzer::PARTITION_NONE) {
+      WriteVP9Block(get_block(0), mi_row, mi_col, subsize, n4x4_l2, n4x4_l2);
+    }
+    else if (partition_type == VP9Fuzzer::PARTITION_HORZ) {
+      WriteVP9Block(get_block(0), mi_row, mi_col, subsize, n4x4_l2, n8x8_l2);
+      if (has_rows) {
+        WriteVP9Block(get_block(1), mi_row + hbs, mi_col, subsize, n4x4_l2, n8x8_l2);
+      }
+    }
+    else if (partition_type == VP9Fuzzer::PARTITION_VERT) {
+      WriteVP9Block(get_block(0), mi_row, mi_col, subsize, n8x8_l2, n4x4_l2);
+      if (has_cols) {
+        WriteVP9Block(get_block(1), mi_row, mi_col + hbs, subsize, n8x8_l2, n4x4_l2);
+      }
+    }
+    else {
+      int32_t index = 0;
+      for (uint32_t i = 0; i < 4; i++) {
+        uint32_t row = mi_row + (i >> 1) * hbs;
+        uint32_t col = mi_col + (i & 1) * hbs;
+        if (row < block_frame_info.mi_rows && col < block_frame_info.mi_cols) {
+          WriteVP9Partition(index < partition->split_size() ? &partition->split(index) : &empty_partition, row, col, n8x8_l2);
+          index++;
+        }
+      }
+    }
+    if (bsize == VP9Fuzzer::BLOCK_8X8 || partition_type != VP9Fuzzer::PARTITION_SPLIT) {
+      VP9Fuzzer::UpdateVP9PartitionContext(&tile_context, mi_row, mi_col, subsize, num_8x8);
+    }
+  }
+
+  void WriteVP9TileBlocks(const Tile* tile, const VP9Fuzzer::VP9TileBounds& bounds) {
+    // decode_tile() in spec into the bool buffer, the superblocks missing from the proto are default messages
+    static const Partition empty_partition;
+    InitBool();
+    tile_context.mi_col_start = bounds.mi_col_start;
+    int32_t index = 0;
+    for (uint32_t mi_row = bounds.mi_row_start; mi_row < bounds.mi_row_end; mi_row += 8) {
+      VP9Fuzzer::ClearVP9LeftContext(&tile_context);
+      for (uint32_t mi_col = bounds.mi_col_start; mi_col < bounds.mi_col_end; mi_col += 8) {
+        WriteVP9Partition(index < tile->superblock_size() ? &tile->superblock(index) : &empty_partition, mi_row, mi_col, 4);
+        index++;
+      }
+    }
+    ExitBool();
+  }
+
+  void WriteVP9Tile(const Tile* tile, const VP9Fuzzer::VP9TileBounds& bounds, bool last_tile) {
+    // The superblocks of an intra frame are bool-encoded, other tiles are written as their bytes. The size marker
+    // comes from the encoded size
+    if (WriteBlocks && tile->superblock_size() > 0) {
+      WriteVP9TileBlocks(tile, bounds);
+      if (!last_tile) {
+        WriteBitUInt(BoolPos, 32);
+      }
+      AddVP9TileSection(BoolPos, -1, true);
+      WriteBitString(BoolBuffer, BoolPos * 8);
+      return;
+    }
     if (!last_tile) {
       WriteBitUInt(tile->partition().size(), 32);
     }
+    size_t borrowed_count = bit_buffer.borrowed.size();
+    if (BorrowTiles && VP9Fuzzer::BorrowBytes(&bit_buffer, (const uint8_t*) tile->partition().data(), tile->partition().size())) {
+      AddVP9TileSection(tile->partition().size(), bit_buffer.borrowed.size() > borrowed_count ? borrowed_count : -1, false);
+      return;
+    }
+    AddVP9TileSection(tile->partition().size(), -1, false);
     WriteBitString(tile->partition(), (tile->partition().size() * 8));
   }
 
-  std::string GetBitBufferAsBytes() {
-    // Create std::string to return
-    size_t bitbuffer_size = bit_buffer.size();
-    std::string return_buffer;
-    // Loop through all the bits and set the bytes on the return buffer
-    uint64_t bytes_to_write = ceil(bitbuffer_size / 8.0);
-    uint64_t bit_buffer_index = 0;
-    for (uint64_t i = 0; i < bytes_to_write; i++) {
-      // Setup temporary byte
-      uint8_t temp_byte = 0;
-      for (uint64_t j = 8; j --> 0;) {
-        // Get bit
-        bool bit;
-        if (bit_buffer_index < bitbuffer_size) {
-          bit = bit_buffer.at(bit_buffer_index) & 0b1;
-        }
-        else bit = 0;
-        // // std::cout << bit;
-        // Write bit to the temporary byte at the necessary position
-        temp_byte |= (bit << j);
-        // Increate bit index
-        ++bit_buffer_index;
-      }
-      // // std::cout << std::hex << temp_byte << std::dec << std::endl;
-      // Put temporary byte into the return buffer
-      return_buffer.push_back(temp_byte);
+  void AddVP9TileSection(uint64_t size, int32_t borrowed, bool blocks) {
+    // Called at the start of the tile data, after its size marker
+    if (Incremental) {
+      tile_data_at.push_back(bit_buffer.bit_count >> 3);
+      tile_data_size.push_back(size);
+      tile_borrowed.push_back(borrowed);
+      tile_blocks.push_back(blocks);
     }
-    // Return string
-    // // std::cout << return_buffer;
-    return return_buffer;
+  }
+
+  std::string GetBitBufferAsBytes() {
+    // The bits after the last one written are zero, borrowed tiles are copied in
+    return VP9Fuzzer::GetBitWriterBytes(bit_buffer);
+  }
+
+  std::vector<struct iovec> GetBitBufferAsIovecs() {
+    // Views of the header bytes and the borrowed tiles, valid until the next frame is written
+    return VP9Fuzzer::GetBitWriterIovecs(bit_buffer);
   }
 
   void WriteVP9TrailingBits() {
-    while (bit_buffer.size() & 7) {
-      WriteBitUInt(0, 1);
-    }
+    WriteBitUInt(0, (8 - (bit_buffer.bit_count & 7)) & 7);
   }
 
   void WriteVP9Frame(const VP9Frame *frame) {
     // Instantiate bitvector to store frame bits/bytes
-    bit_buffer = std::vector<bool>();
+    VP9Fuzzer::ResetBitWriter(&bit_buffer);
+    sections_valid = Incremental;
+    if (Incremental) {
+      saved_state = SavedState{frame_contexts, ref_slots, interpolation_filter, allow_high_precision_mv};
+      context_fields = GetVP9ContextFields(frame->uncompressed_header());
+      tile_data_at.clear();
+      tile_data_size.clear();
+      tile_borrowed.clear();
+      tile_blocks.clear();
+    }
     // Write VP9 uncompressed header
     WriteVP9UncompressedHeader(&frame->uncompressed_header());
 
@@ -837,15 +1279,18 @@ public:
     InitBool();
     WriteVP9CompressedHeader(&frame->compressed_header());
     ExitBool();
+    VP9Fuzzer::ApplyVP9FrameContext(&frame_contexts, *frame);
 
     // std::cout << bit_buffer.size() << std::endl;
 
     // Write header size once we have the final size
     header_size_in_bytes = BoolPos;
-    WriteBitUInt(header_size_in_bytes, 16);
+    header_size_pos = bit_buffer.bit_count;
+    WriteVP9Element<VP9Fuzzer::VP9_SYNTAX_HEADER_SIZE_IN_BYTES>(header_size_in_bytes);
 
     // Write trailing_bits
     WriteVP9TrailingBits();
+    compressed_header_at = bit_buffer.bit_count >> 3;
     // Return if header size == 0
     if (header_size_in_bytes == 0) {
       return;
@@ -855,27 +1300,184 @@ public:
     WriteBitString(BoolBuffer, BoolPos * 8);
 
 
-    // Write video frame tiles
-    int32_t tile_count = 0;
-    for (const Tile &tile : frame->tile()) {
-      WriteVP9Tile(&tile, (tile_count == MAX_TILES || tile_count == (frame->tile().size() - 1)));
-      // Limit tiles
-      ++tile_count;
-      if (tile_count > MAX_TILES) {
-        break;
+    // Write exactly the tiles of the tile layout, missing ones are empty and extra ones are dropped
+    VP9Fuzzer::UpdateVP9TileLayout(MiCols, MiRows, TileColsLog2, TileRowsLog2, &tile_layout);
+    uint32_t tile_count = tile_layout.tiles.size();
+    const Tile empty_tile;
+    // Blocks are only written with a known probability context, like the reader parses them. The tiles of a frame
+    // share the above context, a tile written as bytes leaves it as it was
+    WriteBlocks = FrameIsIntra && !frame_contexts.frame_approximate;
+    if (WriteBlocks) {
+      VP9Fuzzer::MakeVP9BlockFrameInfo(*frame, frame_contexts, ref_slots.current, tx_mode, Lossless, &block_frame_info);
+      VP9Fuzzer::ClearVP9AboveContext(&tile_context, block_frame_info.mi_cols);
+    }
+    for (uint32_t i = 0; i < tile_count; i++) {
+      const Tile* tile = (int32_t) i < frame->tile().size() ? &frame->tile(i) : &empty_tile;
+      WriteVP9Tile(tile, tile_layout.tiles[i], i == tile_count - 1);
+    }
+  }
+
+  void WriteVP9CompactFrame(const CompactVP9Frame *compact_frame) {
+    // Expand the bit-packed frame and write it like any other frame
+    unpacked_frame.Clear();
+    VP9Fuzzer::UnpackVP9Frame(compact_frame, &unpacked_frame);
+    WriteVP9Frame(&unpacked_frame);
+  }
+
+  static std::array<uint32_t, 8> GetVP9ContextFields(const UncompressedHeader& uncompressed_header) {
+    // The enum fields are cast, braced init doesn't narrow them to uint32_t
+    return {static_cast<uint32_t>(uncompressed_header.show_existing_frame()),
+            static_cast<uint32_t>(uncompressed_header.frame_type()),
+            static_cast<uint32_t>(uncompressed_header.intra_only()),
+            static_cast<uint32_t>(uncompressed_header.error_resilient_mode()),
+            uncompressed_header.reset_frame_context(), uncompressed_header.frame_context_idx(),
+            static_cast<uint32_t>(uncompressed_header.refresh_frame_context()),
+            static_cast<uint32_t>(uncompressed_header.frame_parallel_decoding_mode())};
+  }
+
+  void RestoreVP9SavedState(bool contexts) {
+    if (contexts) {
+      frame_contexts = saved_state.frame_contexts;
+    }
+    ref_slots = saved_state.ref_slots;
+    interpolation_filter = saved_state.interpolation_filter;
+    allow_high_precision_mv = saved_state.allow_high_precision_mv;
+  }
+
+  void RewriteVP9Frame(const VP9Frame *frame) {
+    // Writes the edited frame again from the state before its last write
+    if (sections_valid) {
+      RestoreVP9SavedState(true);
+    }
+    WriteVP9Frame(frame);
+  }
+
+  void ResizeVP9Section(uint64_t at, uint64_t old_size, const uint8_t* data, uint64_t size, uint32_t first_tile) {
+    // Replaces owned bytes of the frame, the tiles from first_tile on move with them
+    bit_buffer.bytes.replace(at, old_size, (const char*) data, size);
+    bit_buffer.bit_count = (uint64_t) bit_buffer.bytes.size() * 8;
+    int64_t delta = (int64_t) size - (int64_t) old_size;
+    for (uint32_t i = first_tile; i < tile_data_at.size(); i++) {
+      tile_data_at[i] += delta;
+    }
+    // Borrowed tiles of later tiles go after the replaced bytes, ones of earlier tiles stay before them
+    for (uint32_t i = first_tile; i < tile_borrowed.size(); i++) {
+      if (tile_borrowed[i] >= 0) {
+        bit_buffer.borrowed[tile_borrowed[i]].at += delta;
       }
     }
   }
 
+  void RewriteVP9Tile(const VP9Frame *frame, uint32_t i) {
+    // After an edit of tile i only its bytes and size marker change, unless blocks are written from it or the
+    // tiles around it share the above context with it
+    if (!sections_valid) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    if (i >= tile_data_at.size()) {
+      // Dropped by the tile layout
+      return;
+    }
+    static const Tile empty_tile;
+    const Tile* tile = (int32_t) i < frame->tile().size() ? &frame->tile(i) : &empty_tile;
+    if (tile_blocks[i] || (WriteBlocks && tile->superblock_size() > 0)) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    const std::string& partition = tile->partition();
+    if (i + 1 < tile_data_at.size()) {
+      WriteBitUIntPos(partition.size(), 32, (tile_data_at[i] - 4) * 8);
+    }
+    if (tile_borrowed[i] >= 0) {
+      VP9Fuzzer::BorrowedBytes* borrowed = &bit_buffer.borrowed[tile_borrowed[i]];
+      borrowed->data = (const uint8_t*) partition.data();
+      borrowed->size = partition.size();
+    }
+    else {
+      ResizeVP9Section(tile_data_at[i], tile_data_size[i], (const uint8_t*) partition.data(), partition.size(), i + 1);
+    }
+    tile_data_size[i] = partition.size();
+  }
+
+  void RewriteVP9CompressedHeader(const VP9Frame *frame) {
+    // After an edit of the compressed header it is encoded again and replaces the old one with its size, the
+    // saved contexts are refreshed from the state before the frame. Written blocks depend on the probabilities
+    if (!sections_valid || WriteBlocks || header_size_in_bytes == 0) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    InitBool();
+    WriteVP9CompressedHeader(&frame->compressed_header());
+    ExitBool();
+    if (BoolPos == 0) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    frame_contexts = saved_state.frame_contexts;
+    VP9Fuzzer::ApplyVP9FrameContext(&frame_contexts, *frame);
+    WriteBitUIntPos(BoolPos, 16, header_size_pos);
+    ResizeVP9Section(compressed_header_at, header_size_in_bytes, (const uint8_t*) BoolBuffer.data(), BoolPos, 0);
+    header_size_in_bytes = BoolPos;
+  }
+
+  void RewriteVP9UncompressedHeader(const VP9Frame *frame) {
+    // After an edit of fixed width fields the uncompressed header is written again on its own and copied over the
+    // old one. When its size or anything the later sections depend on changes, the whole frame is written again
+    if (!sections_valid || WriteBlocks || header_size_in_bytes == 0) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    bool old_lossless = Lossless;
+    uint32_t old_profile = profile;
+    bool old_frame_is_intra = FrameIsIntra;
+    uint32_t old_interpolation_filter = interpolation_filter;
+    bool old_compound_reference_allowed = compoundReferenceAllowed;
+    bool old_allow_high_precision_mv = allow_high_precision_mv;
+    uint32_t old_mi_cols = MiCols;
+    uint32_t old_mi_rows = MiRows;
+    uint32_t old_tile_cols_log2 = TileColsLog2;
+    uint32_t old_tile_rows_log2 = TileRowsLog2;
+    // The saved contexts only change with the fields that select and refresh them
+    RestoreVP9SavedState(false);
+    std::array<uint32_t, 8> new_context_fields = GetVP9ContextFields(frame->uncompressed_header());
+    if (new_context_fields != context_fields) {
+      frame_contexts = saved_state.frame_contexts;
+      VP9Fuzzer::ApplyVP9FrameContext(&frame_contexts, *frame);
+      context_fields = new_context_fields;
+    }
+    std::swap(bit_buffer, header_buffer);
+    VP9Fuzzer::ResetBitWriter(&bit_buffer);
+    WriteVP9UncompressedHeader(&frame->uncompressed_header());
+    std::swap(bit_buffer, header_buffer);
+    bool same_sections = header_buffer.bit_count == header_size_pos && header_size_in_bytes != 0 &&
+                         Lossless == old_lossless && profile == old_profile && FrameIsIntra == old_frame_is_intra &&
+                         interpolation_filter == old_interpolation_filter &&
+                         compoundReferenceAllowed == old_compound_reference_allowed &&
+                         allow_high_precision_mv == old_allow_high_precision_mv && MiCols == old_mi_cols &&
+                         MiRows == old_mi_rows && TileColsLog2 == old_tile_cols_log2 &&
+                         TileRowsLog2 == old_tile_rows_log2;
+    if (!same_sections || (FrameIsIntra && !frame_contexts.frame_approximate)) {
+      RewriteVP9Frame(frame);
+      return;
+    }
+    uint64_t whole_bytes = header_size_pos >> 3;
+    memcpy(&bit_buffer.bytes[0], header_buffer.bytes.data(), whole_bytes);
+    if (header_size_pos & 7) {
+      uint32_t bits = header_size_pos & 7;
+      WriteBitUIntPos((uint8_t) header_buffer.bytes[whole_bytes] >> (8 - bits), bits, whole_bytes * 8);
+    }
+  }
+
   void WriteVP9FrameWithIVFHeader(const VP9Frame* vp9_frame) {
     // Save initial position
-    uint32_t start_pos = bit_buffer.size() - 1;
+    uint32_t start_pos = bit_buffer.bit_count - 1;
     // Allocate 12 bytes in buffer for size and timestamp
     WriteBitString("", 12*8);
     // Write VP9 frame
     WriteVP9Frame(vp9_frame);
     // Get ending position
-    uint32_t end_pos = bit_buffer.size() - 1;
+    uint32_t end_pos = bit_buffer.bit_count - 1;
     // Edit IVF frame header with VP9 frame size
     uint32_t frame_size_bytes = ceil((end_pos - start_pos) / 8.0);
     WriteBitUIntPos(((uint8_t*)&frame_size_bytes)[0], 8, start_pos); // little endian :P
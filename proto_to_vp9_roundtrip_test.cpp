@@ -0,0 +1,228 @@
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#include "proto_to_vp9.cpp"
+
+// Round trip of vp9_to_proto output: the frames written from the protos of an IVF file have to be its frames byte
+// for byte. The protos are written by vp9_to_proto from the same file, with or without --sparse and --blocks
+//   proto_to_vp9_roundtrip_test <ivf_file> <proto_file>              first frame from a VP9Fuzz
+//   proto_to_vp9_roundtrip_test <ivf_file> <proto_file> --compact    first frame from a CompactVP9Frame
+//   proto_to_vp9_roundtrip_test <ivf_file> <out_file> --stream       every frame from <out_file>.<n>, one writer
+//   proto_to_vp9_roundtrip_test <ivf_file> <out_file> --incremental  --stream, then edits of each section rewritten
+//   proto_to_vp9_roundtrip_test <ivf_file> <proto_file> --mutate     out of range edits of the first frame
+
+static std::vector<std::string> ReadIVFFrames(const char* ivf_file) {
+  std::ifstream ifs(ivf_file, std::ios_base::in | std::ios_base::binary);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  std::string data = ss.str();
+  std::vector<std::string> frames;
+  // 32 byte file header, then a 4 byte size and an 8 byte timestamp before every frame
+  size_t pos = 32;
+  while (pos + 12 <= data.size()) {
+    uint32_t frame_size = 0;
+    memcpy(&frame_size, data.data() + pos, sizeof(uint32_t));
+    if (frame_size > data.size() - pos - 12) {
+      break;
+    }
+    frames.push_back(data.substr(pos + 12, frame_size));
+    pos += 12 + frame_size;
+  }
+  return frames;
+}
+
+static bool WritesFrame(ProtoToVP9* proto_to_vp9, const VP9Frame& vp9_frame, const std::string& expected) {
+  proto_to_vp9->WriteVP9Frame(&vp9_frame);
+  return proto_to_vp9->GetBitBufferAsBytes() == expected;
+}
+
+static bool RewritesFrame(ProtoToVP9* proto_to_vp9, const ProtoToVP9& writer_before, const VP9Frame& vp9_frame,
+                          const VP9Frame& previous_frame, const std::string& expected) {
+  // Edits of each section of the last frame rewritten on their own have to give what a writer in the state before
+  // the frame writes for the edited frame, and the frame rewritten as it was the input again
+  std::vector<std::function<void(VP9Frame*)>> edits = {
+    [&](VP9Frame* frame) {
+      frame->mutable_compressed_header()->CopyFrom(previous_frame.compressed_header());
+      proto_to_vp9->RewriteVP9CompressedHeader(frame);
+    },
+    [&](VP9Frame* frame) {
+      if (frame->tile_size() > 0) {
+        frame->mutable_tile(0)->mutable_partition()->push_back('\x5a');
+        proto_to_vp9->RewriteVP9Tile(frame, 0);
+      }
+    },
+    [&](VP9Frame* frame) {
+      UncompressedHeader_LoopFilterParams* loop_filter_params =
+          frame->mutable_uncompressed_header()->mutable_loop_filter_params();
+      loop_filter_params->set_loop_filter_level(loop_filter_params->loop_filter_level() ^ 1);
+      proto_to_vp9->RewriteVP9UncompressedHeader(frame);
+    },
+  };
+  VP9Frame edited_frame = vp9_frame;
+  bool same = true;
+  for (const std::function<void(VP9Frame*)>& edit : edits) {
+    edit(&edited_frame);
+    ProtoToVP9 full_writer = writer_before;
+    full_writer.WriteVP9Frame(&edited_frame);
+    same = same && proto_to_vp9->GetBitBufferAsBytes() == full_writer.GetBitBufferAsBytes();
+  }
+  proto_to_vp9->RewriteVP9Frame(&vp9_frame);
+  return same && proto_to_vp9->GetBitBufferAsBytes() == expected;
+}
+
+static void MutateVP9Blocks(Partition* partition) {
+  // Values no block can code, the writer clamps them to what it writes
+  for (Block& block : *partition->mutable_block()) {
+    block.set_segment_id(0xffffffff);
+    block.set_tx_size(0xffffffff);
+    block.set_default_uv_mode(0xffffffff);
+    for (uint32_t i = 0; i < 4; i++) {
+      block.add_default_intra_mode(0xffffffff);
+    }
+    block.add_transform_block()->add_coef(INT32_MIN);
+  }
+  for (Partition& split : *partition->mutable_split()) {
+    MutateVP9Blocks(&split);
+  }
+}
+
+struct VP9Mutation {
+  // With the coded bits kept the frame written is still the input
+  bool keeps_coded_bits;
+  std::function<void(VP9Frame*)> mutate;
+};
+
+static int RunVP9Mutations(const VP9Frame& vp9_frame, const std::string& expected) {
+  // Every edit has to write the same bytes twice, a key frame after them has to write the input again
+  std::vector<VP9Mutation> mutations = {
+    {true, [](VP9Frame* frame) {
+      // MiCols and MiRows only come from the 16 coded bits
+      if (!frame->uncompressed_header().has_frame_size()) {
+        return;
+      }
+      UncompressedHeader_FrameSize* frame_size = frame->mutable_uncompressed_header()->mutable_frame_size();
+      frame_size->set_frame_width_minus_1(frame_size->frame_width_minus_1() | 0xffff0000);
+      frame_size->set_frame_height_minus_1(frame_size->frame_height_minus_1() | 0xffff0000);
+    }},
+    {true, [](VP9Frame* frame) {
+      UncompressedHeader* uncompressed_header = frame->mutable_uncompressed_header();
+      uncompressed_header->set_profile_low_bit((VP9BitField) (uncompressed_header->profile_low_bit() | 0xfe));
+      uncompressed_header->set_profile_high_bit((VP9BitField) (uncompressed_header->profile_high_bit() | 0xfe));
+      if (!uncompressed_header->has_color_config()) {
+        return;
+      }
+      UncompressedHeader_ColorConfig* color_config = uncompressed_header->mutable_color_config();
+      color_config->set_subsampling_x((VP9BitField) (color_config->subsampling_x() | 0xfe));
+      color_config->set_subsampling_y((VP9BitField) (color_config->subsampling_y() | 0xfe));
+    }},
+    {true, [](VP9Frame* frame) {
+      if (!frame->compressed_header().has_read_tx_mode()) {
+        return;
+      }
+      CompressedHeader_ReadTxMode* read_tx_mode = frame->mutable_compressed_header()->mutable_read_tx_mode();
+      read_tx_mode->set_tx_mode((CompressedHeader_TxMode) (read_tx_mode->tx_mode() | 0xfc));
+      read_tx_mode->set_tx_mode_select((VP9BitField) (read_tx_mode->tx_mode_select() | 0xfe));
+    }},
+    {false, [](VP9Frame* frame) {
+      // The superblocks of the input are past the right and bottom edge of an 8x8 frame
+      UncompressedHeader_FrameSize* frame_size = frame->mutable_uncompressed_header()->mutable_frame_size();
+      frame_size->set_frame_width_minus_1(7);
+      frame_size->set_frame_height_minus_1(7);
+    }},
+    {false, [](VP9Frame* frame) {
+      for (Tile& tile : *frame->mutable_tile()) {
+        for (Partition& superblock : *tile.mutable_superblock()) {
+          MutateVP9Blocks(&superblock);
+        }
+      }
+    }},
+  };
+  bool key_frame = vp9_frame.uncompressed_header().frame_type() == UncompressedHeader_FrameType_KEY_FRAME;
+  int failed = 0;
+  for (size_t i = 0; i < mutations.size(); i++) {
+    VP9Frame mutated_frame = vp9_frame;
+    mutations[i].mutate(&mutated_frame);
+    ProtoToVP9 proto_to_vp9;
+    proto_to_vp9.WriteVP9Frame(&mutated_frame);
+    std::string first = proto_to_vp9.GetBitBufferAsBytes();
+    bool same = !mutations[i].keeps_coded_bits || first == expected;
+    proto_to_vp9.WriteVP9Frame(&mutated_frame);
+    same = same && proto_to_vp9.GetBitBufferAsBytes() == first;
+    if (key_frame) {
+      same = same && WritesFrame(&proto_to_vp9, vp9_frame, expected);
+    }
+    if (!same) {
+      std::cerr << "Mutation " << i << " doesn't write the same frame" << std::endl;
+      failed++;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char** argv) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  if (argc < 3) {
+    std::cout << "usage: " << argv[0] << " <ivf_file> <proto_file> [--compact] [--stream] [--incremental] [--mutate]" << std::endl;
+    return 1;
+  }
+  std::string option = argc > 3 ? argv[3] : "";
+  std::vector<std::string> frames = ReadIVFFrames(argv[1]);
+  if (frames.empty()) {
+    std::cerr << "No frame in file: " << argv[1] << std::endl;
+    return 1;
+  }
+
+  ProtoToVP9 proto_to_vp9;
+  size_t matched = 0;
+  size_t frame_count = 1;
+  if (option == "--compact") {
+    std::ifstream ifs(argv[2], std::ios_base::in | std::ios_base::binary);
+    CompactVP9Frame compact_frame;
+    compact_frame.ParseFromIstream(&ifs);
+    proto_to_vp9.WriteVP9CompactFrame(&compact_frame);
+    matched += proto_to_vp9.GetBitBufferAsBytes() == frames[0];
+  }
+  else if (option == "--stream" || option == "--incremental") {
+    // The writer keeps the reference slots and probability contexts from frame to frame like a decoder
+    proto_to_vp9.Incremental = option == "--incremental";
+    frame_count = frames.size();
+    VP9Frame previous_frame;
+    for (size_t i = 0; i < frames.size(); i++) {
+      std::ifstream ifs(std::string(argv[2]) + "." + std::to_string(i), std::ios_base::in | std::ios_base::binary);
+      VP9Fuzz vp9_fuzz;
+      if (!vp9_fuzz.ParseFromIstream(&ifs)) {
+        std::cerr << "Missing frame " << i << std::endl;
+        continue;
+      }
+      const VP9Frame& vp9_frame = vp9_fuzz.ivf().vp9_frame_1();
+      ProtoToVP9 writer_before;
+      if (proto_to_vp9.Incremental) {
+        writer_before = proto_to_vp9;
+      }
+      matched += WritesFrame(&proto_to_vp9, vp9_frame, frames[i]) &&
+                 (!proto_to_vp9.Incremental ||
+                  RewritesFrame(&proto_to_vp9, writer_before, vp9_frame, previous_frame, frames[i]));
+      previous_frame = vp9_frame;
+    }
+  }
+  else {
+    std::ifstream ifs(argv[2], std::ios_base::in | std::ios_base::binary);
+    VP9Fuzz vp9_fuzz;
+    vp9_fuzz.ParseFromIstream(&ifs);
+    const VP9Frame& vp9_frame = vp9_fuzz.ivf().vp9_frame_1();
+    if (option == "--mutate") {
+      return RunVP9Mutations(vp9_frame, frames[0]) == 0 ? 0 : 1;
+    }
+    // Tiles copied and tiles borrowed as proto_to_vp9_test.cpp writes them have to give the same bytes
+    ProtoToVP9 borrowing_proto_to_vp9;
+    borrowing_proto_to_vp9.BorrowTiles = true;
+    matched += WritesFrame(&proto_to_vp9, vp9_frame, frames[0]) &&
+               WritesFrame(&borrowing_proto_to_vp9, vp9_frame, frames[0]);
+  }
+
+  std::cout << "Frames written: " << matched << "/" << frame_count << std::endl;
+  return matched == frame_count ? 0 : 1;
+}
@@ -1,3 +1,6 @@
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "proto_to_vp9.cpp"
 
 int main(int argc, char** argv) {
@@ -10,11 +13,17 @@ int main(int argc, char** argv) {
   VP9Frame vp9_frame;
   vp9_frame.ParseFromIstream(&ifs);
   ProtoToVP9 proto_to_vp9;
+  proto_to_vp9.BorrowTiles = true;
   proto_to_vp9.WriteVP9Frame((const VP9Frame*) &vp9_frame); 
 
-  // Write binary to file
-  std::ofstream ofs("./test_frame_out", std::ios_base::out | std::ios_base::binary);
-  ofs << proto_to_vp9.GetBitBufferAsBytes();
+  // Write binary to file, the tiles straight from the protobuf
+  int fd = open("./test_frame_out", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return 1;
+  }
+  std::vector<struct iovec> iovecs = proto_to_vp9.GetBitBufferAsIovecs();
+  ssize_t written = writev(fd, iovecs.data(), iovecs.size());
+  close(fd);
   
-  return 0;
+  return written == (ssize_t) VP9Fuzzer::GetBitWriterSize(proto_to_vp9.bit_buffer) ? 0 : 1;
 }
\ No newline at end of file
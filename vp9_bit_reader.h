@@ -0,0 +1,53 @@
+#ifndef VP9_BIT_READER_H_
+#define VP9_BIT_READER_H_
+
+#include <byteswap.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Big endian bit reader over a byte buffer
+// Shared by vp9_to_proto.cpp and PeekFrameInfo (vp9_frame_info.h) so both read header bits the same way
+// Reading past the end returns zero bits and still advances bit_counter, check BitReaderOverrun afterwards
+
+namespace VP9Fuzzer {
+
+struct BitReader {
+  const uint8_t* data;
+  uint64_t size_in_bits;
+  uint64_t bit_counter;
+};
+
+inline BitReader MakeBitReader(const uint8_t* data, size_t size) {
+  return BitReader{data, (uint64_t) size * 8, 0};
+}
+
+inline uint64_t ReadBits(BitReader* reader, uint32_t bits) {
+  // Reads up to 64 bits, most significant bit first
+  uint64_t bit_counter = reader->bit_counter;
+  reader->bit_counter += bits;
+  uint64_t byte_index = bit_counter >> 3;
+  // Fast path, the bits fit in a single 8 byte load from inside the buffer
+  if (bits > 0 && bits <= 56 && byte_index + 8 <= (reader->size_in_bits >> 3)) {
+    uint64_t big_endian_values;
+    memcpy(&big_endian_values, reader->data + byte_index, sizeof(uint64_t));
+    return (bswap_64(big_endian_values) << (bit_counter & 7)) >> (64 - bits);
+  }
+  uint64_t value = 0;
+  for (uint32_t i = 0; i < bits; i++, bit_counter++) {
+    uint64_t bit = 0;
+    if (bit_counter < reader->size_in_bits) {
+      bit = (reader->data[bit_counter >> 3] >> (7 - (bit_counter & 7))) & 0b1;
+    }
+    value = (value << 1) | bit;
+  }
+  return value;
+}
+
+inline bool BitReaderOverrun(const BitReader* reader) {
+  return reader->bit_counter > reader->size_in_bits;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_BIT_READER_H_
@@ -0,0 +1,162 @@
+#ifndef VP9_BIT_WRITER_H_
+#define VP9_BIT_WRITER_H_
+
+#include <byteswap.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+// Big endian bit writer into a byte buffer, the counterpart of vp9_bit_reader.h for proto_to_vp9.cpp
+// bytes always holds exactly the bytes bit_count touches, the bits after bit_count in the last byte are zero.
+// Whole bytes are appended with AppendBytes, a memcpy when the output is byte aligned and a shifted copy of
+// 8 byte words otherwise, so tile data doesn't go through the output a bit at a time.
+// Byte-aligned data that outlives the output can be borrowed with BorrowBytes instead, GetBitWriterIovecs then
+// returns the owned bytes split around the borrowed ones as an iovec list for writev without copying them
+
+namespace VP9Fuzzer {
+
+struct BorrowedBytes {
+  // Borrowed data goes before the owned byte at
+  uint64_t at;
+  const uint8_t* data;
+  size_t size;
+};
+
+struct BitWriter {
+  std::string bytes;
+  uint64_t bit_count = 0;
+  // In output order, bytes and bit_count only count the owned bytes
+  std::vector<BorrowedBytes> borrowed;
+};
+
+inline void ResetBitWriter(BitWriter* writer) {
+  writer->bytes.clear();
+  writer->bit_count = 0;
+  writer->borrowed.clear();
+}
+
+inline void WriteBits(BitWriter* writer, uint64_t value, uint32_t bits) {
+  // Appends the low bits of value, most significant bit first, filling up the last byte first
+  if (bits == 0) {
+    return;
+  }
+  writer->bytes.resize((writer->bit_count + bits + 7) >> 3);
+  uint8_t* out = (uint8_t*) &writer->bytes[writer->bit_count >> 3];
+  uint32_t used = writer->bit_count & 7;
+  writer->bit_count += bits;
+  while (bits > 0) {
+    uint32_t take = bits < 8 - used ? bits : 8 - used;
+    uint32_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+    *out++ |= chunk << (8 - used - take);
+    bits -= take;
+    used = 0;
+  }
+}
+
+inline void WriteBitsAt(BitWriter* writer, uint64_t value, uint32_t bits, uint64_t pos) {
+  // Overwrites bits already written, starting at bit pos
+  for (uint32_t i = bits; i --> 0; pos++) {
+    uint8_t mask = 0x80 >> (pos & 7);
+    uint8_t* out = (uint8_t*) &writer->bytes[pos >> 3];
+    *out = ((value >> i) & 1) ? (*out | mask) : (*out & ~mask);
+  }
+}
+
+inline void AppendBytes(BitWriter* writer, const uint8_t* data, size_t size) {
+  // Appends size whole bytes at the current bit offset
+  if (size == 0) {
+    return;
+  }
+  uint32_t shift = writer->bit_count & 7;
+  uint64_t start = writer->bit_count >> 3;
+  writer->bytes.resize(start + size + (shift != 0));
+  uint8_t* out = (uint8_t*) &writer->bytes[start];
+  writer->bit_count += (uint64_t) size * 8;
+  if (shift == 0) {
+    memcpy(out, data, size);
+    return;
+  }
+  // Every output byte is the low bits of one input byte and the high bits of the next, the first one starts
+  // with the bits already in the last byte
+  uint64_t carry = (uint64_t) out[0] << 56;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t big_endian_values;
+    memcpy(&big_endian_values, data + i, sizeof(uint64_t));
+    uint64_t values = bswap_64(big_endian_values);
+    big_endian_values = bswap_64(carry | (values >> shift));
+    memcpy(out + i, &big_endian_values, sizeof(uint64_t));
+    carry = values << (64 - shift);
+  }
+  uint8_t carry_byte = carry >> 56;
+  for (; i < size; i++) {
+    out[i] = carry_byte | (data[i] >> shift);
+    carry_byte = data[i] << (8 - shift);
+  }
+  out[size] = carry_byte;
+}
+
+inline void AppendZeroBytes(BitWriter* writer, size_t size) {
+  // The bits after bit_count are already zero
+  writer->bit_count += (uint64_t) size * 8;
+  writer->bytes.resize((writer->bit_count + 7) >> 3);
+}
+
+inline bool BorrowBytes(BitWriter* writer, const uint8_t* data, size_t size) {
+  // Puts data in the output without copying it, it has to stay unchanged until the output is used. Only works at a
+  // byte boundary, false when the caller has to append the bytes instead
+  if ((writer->bit_count & 7) != 0) {
+    return false;
+  }
+  if (size > 0) {
+    writer->borrowed.push_back(BorrowedBytes{writer->bit_count >> 3, data, size});
+  }
+  return true;
+}
+
+inline uint64_t GetBitWriterSize(const BitWriter& writer) {
+  // Output size in bytes, owned and borrowed
+  uint64_t size = writer.bytes.size();
+  for (const BorrowedBytes& borrowed : writer.borrowed) {
+    size += borrowed.size;
+  }
+  return size;
+}
+
+inline std::vector<struct iovec> GetBitWriterIovecs(const BitWriter& writer) {
+  // The output as views of the owned and borrowed bytes, valid until the next write
+  std::vector<struct iovec> iovecs;
+  iovecs.reserve(writer.borrowed.size() * 2 + 1);
+  uint64_t owned_start = 0;
+  for (const BorrowedBytes& borrowed : writer.borrowed) {
+    if (borrowed.at > owned_start) {
+      iovecs.push_back(iovec{(void*) &writer.bytes[owned_start], borrowed.at - owned_start});
+    }
+    iovecs.push_back(iovec{(void*) borrowed.data, borrowed.size});
+    owned_start = borrowed.at;
+  }
+  if (writer.bytes.size() > owned_start) {
+    iovecs.push_back(iovec{(void*) &writer.bytes[owned_start], writer.bytes.size() - owned_start});
+  }
+  return iovecs;
+}
+
+inline std::string GetBitWriterBytes(const BitWriter& writer) {
+  // The output gathered into one string
+  if (writer.borrowed.empty()) {
+    return writer.bytes;
+  }
+  std::string out;
+  out.reserve(GetBitWriterSize(writer));
+  for (const struct iovec& iov : GetBitWriterIovecs(writer)) {
+    out.append((const char*) iov.iov_base, iov.iov_len);
+  }
+  return out;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_BIT_WRITER_H_
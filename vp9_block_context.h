@@ -0,0 +1,384 @@
+#ifndef VP9_BLOCK_CONTEXT_H_
+#define VP9_BLOCK_CONTEXT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "vp9.pb.h"
+#include "vp9_block_tables.h"
+#include "vp9_frame_context.h"
+#include "vp9_ref_slots.h"
+
+// Block level syntax of the tiles of intra frames (decode_partition, intra_frame_mode_info and residual in the spec)
+// Both converters walk the partition tree of a tile in the same order and take the probability of every symbol from
+// the contexts kept here: the mode info of the row above and the column to the left, the nonzero flags of the
+// transform blocks next to it and the partition sizes around it. The above arrays are one entry per 8x8 (or 4x4)
+// column of the frame, the left arrays only cover one superblock, so a block only touches a few cache lines.
+
+namespace VP9Fuzzer {
+
+enum BlockSize {
+  BLOCK_4X4,
+  BLOCK_4X8,
+  BLOCK_8X4,
+  BLOCK_8X8,
+  BLOCK_8X16,
+  BLOCK_16X8,
+  BLOCK_16X16,
+  BLOCK_16X32,
+  BLOCK_32X16,
+  BLOCK_32X32,
+  BLOCK_32X64,
+  BLOCK_64X32,
+  BLOCK_64X64
+};
+
+enum PartitionType {
+  PARTITION_NONE,
+  PARTITION_HORZ,
+  PARTITION_VERT,
+  PARTITION_SPLIT
+};
+
+enum PredictionMode {
+  DC_PRED,
+  V_PRED,
+  H_PRED,
+  D45_PRED,
+  D135_PRED,
+  D117_PRED,
+  D153_PRED,
+  D207_PRED,
+  D63_PRED,
+  TM_PRED
+};
+
+enum TxType {
+  DCT_DCT,
+  ADST_DCT,
+  DCT_ADST,
+  ADST_ADST
+};
+
+enum CoefToken {
+  ZERO_TOKEN,
+  ONE_TOKEN,
+  TWO_TOKEN,
+  THREE_TOKEN,
+  FOUR_TOKEN,
+  DCT_VAL_CAT1,
+  DCT_VAL_CAT2,
+  DCT_VAL_CAT3,
+  DCT_VAL_CAT4,
+  DCT_VAL_CAT5,
+  DCT_VAL_CAT6
+};
+
+const uint8_t num_8x8_blocks_wide_lookup[13] = {1, 1, 1, 1, 1, 2, 2, 2, 4, 4, 4, 8, 8};
+const uint8_t num_8x8_blocks_high_lookup[13] = {1, 1, 1, 1, 2, 1, 2, 4, 2, 4, 8, 4, 8};
+const uint8_t max_txsize_lookup[13] = {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 3};
+const uint8_t subsize_lookup[4][13] = {
+  {BLOCK_4X4, BLOCK_4X8, BLOCK_8X4, BLOCK_8X8, BLOCK_8X16, BLOCK_16X8, BLOCK_16X16, BLOCK_16X32, BLOCK_32X16,
+   BLOCK_32X32, BLOCK_32X64, BLOCK_64X32, BLOCK_64X64},
+  {0, 0, 0, BLOCK_8X4, 0, 0, BLOCK_16X8, 0, 0, BLOCK_32X16, 0, 0, BLOCK_64X32},
+  {0, 0, 0, BLOCK_4X8, 0, 0, BLOCK_8X16, 0, 0, BLOCK_16X32, 0, 0, BLOCK_32X64},
+  {0, 0, 0, BLOCK_4X4, 0, 0, BLOCK_8X8, 0, 0, BLOCK_16X16, 0, 0, BLOCK_32X32}
+};
+// Value stored in the above and left partition contexts for a block size, bit n is set when the block is
+// narrower (or shorter) than a 64 >> n block
+const uint8_t partition_context_above[13] = {15, 15, 14, 14, 14, 12, 12, 12, 8, 8, 8, 0, 0};
+const uint8_t partition_context_left[13] = {15, 14, 15, 14, 12, 14, 12, 8, 12, 8, 0, 8, 0};
+const uint8_t intra_mode_to_tx_type[10] = {DCT_DCT, ADST_DCT, DCT_ADST, DCT_DCT, ADST_ADST, ADST_DCT, DCT_ADST,
+                                           DCT_ADST, ADST_DCT, ADST_ADST};
+const uint8_t coefband_4x4[16] = {0, 1, 1, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 5, 5, 5};
+const uint8_t coefband_8x8plus[21] = {0, 1, 1, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
+const uint8_t energy_class[11] = {0, 1, 2, 3, 3, 4, 4, 5, 5, 5, 5};
+// Smallest level and number of extra bits of DCT_VAL_CAT1 to DCT_VAL_CAT6
+const uint32_t cat_min_level[6] = {5, 7, 11, 19, 35, 67};
+const uint8_t* const cat_probs[6] = {cat1_probs, cat2_probs, cat3_probs, cat4_probs, cat5_probs, cat6_probs};
+const uint8_t cat_bits[6] = {1, 2, 3, 4, 5, 14};
+
+// Trees in the libvpx layout, tree[i + bit] is the next node or -symbol, node i uses probability i >> 1
+const int8_t partition_tree[6] = {-PARTITION_NONE, 2, -PARTITION_HORZ, 4, -PARTITION_VERT, -PARTITION_SPLIT};
+const int8_t intra_mode_tree[18] = {-DC_PRED, 2, -TM_PRED, 4, -V_PRED, 6, 8, 12, -H_PRED, 10, -D135_PRED, -D117_PRED,
+                                    -D45_PRED, 14, -D63_PRED, 16, -D153_PRED, -D207_PRED};
+const int8_t segment_tree[14] = {2, 4, 6, 8, 10, 12, 0, -1, -2, -3, -4, -5, -6, -7};
+// Token tree below the ONE node, its probabilities come from pareto8_full
+const int8_t coef_con_tree[16] = {2, 6, -TWO_TOKEN, 4, -THREE_TOKEN, -FOUR_TOKEN, 8, 10, -DCT_VAL_CAT1, -DCT_VAL_CAT2,
+                                  12, 14, -DCT_VAL_CAT3, -DCT_VAL_CAT4, -DCT_VAL_CAT5, -DCT_VAL_CAT6};
+
+struct VP9BlockInfo {
+  // Mode info of a decoded block that the blocks below and to the right take their contexts from
+  uint8_t sb_type = BLOCK_64X64;
+  uint8_t skip = 0;
+  uint8_t tx_size = 0;
+  uint8_t is_inter = 0;
+  uint8_t segment_id = 0;
+  // Y mode of each 4x4 quarter of an 8x8, all 4 are the block's mode at 8x8 and above
+  uint8_t sub_modes[4] = {DC_PRED, DC_PRED, DC_PRED, DC_PRED};
+};
+
+struct VP9BlockFrameInfo {
+  // Frame level inputs of the block syntax
+  VP9FrameContext probs;
+  uint32_t mi_cols = 0;
+  uint32_t mi_rows = 0;
+  uint32_t tx_mode = 0;
+  bool lossless = false;
+  uint8_t subsampling_x = 1;
+  uint8_t subsampling_y = 1;
+  uint8_t bit_depth = 8;
+  // Segment ids are only coded with segmentation_enabled and segmentation_update_map
+  bool read_segment_id = false;
+  uint8_t segment_tree_probs[7] = {255, 255, 255, 255, 255, 255, 255};
+  // Segments with SEG_LVL_SKIP, their blocks don't code skip or any coefficients
+  bool segment_skip[8] = {};
+};
+
+struct VP9TileContext {
+  uint32_t mi_col_start = 0;
+  std::vector<VP9BlockInfo> above_info;
+  VP9BlockInfo left_info[8];
+  // Above, 4x4 columns of each plane, 16 more than the frame for blocks that reach past the right edge
+  std::vector<uint8_t> above_nonzero[3];
+  uint8_t left_nonzero[3][16];
+  std::vector<uint8_t> above_partition;
+  uint8_t left_partition[8];
+  // Energy class of the tokens of the transform block being coded, by coefficient position
+  uint8_t token_cache[1024];
+};
+
+inline void MakeVP9BlockFrameInfo(const VP9Frame& vp9_frame, const VP9FrameContextStore& frame_contexts,
+                                  const VP9FrameFormat& frame_format, uint32_t tx_mode, bool lossless,
+                                  VP9BlockFrameInfo* info) {
+  // Call after ApplyVP9FrameContext for the frame
+  LoadVP9FrameContext(&frame_contexts, &info->probs);
+  info->mi_cols = (frame_format.width + 7) >> 3;
+  info->mi_rows = (frame_format.height + 7) >> 3;
+  info->tx_mode = tx_mode;
+  info->lossless = lossless;
+  info->subsampling_x = frame_format.subsampling_x;
+  info->subsampling_y = frame_format.subsampling_y;
+  info->bit_depth = frame_format.bit_depth;
+
+  // Intra frames start from cleared segmentation features (setup_past_independence), only coded ones apply
+  const UncompressedHeader_SegmentationParams& segmentation = vp9_frame.uncompressed_header().segmentation_params();
+  bool enabled = segmentation.segmentation_enabled() == 1;
+  info->read_segment_id = enabled && segmentation.segmentation_update_map() == 1;
+  for (uint32_t i = 0; i < 7; i++) {
+    info->segment_tree_probs[i] = 255;
+    if (info->read_segment_id && (int32_t) i < segmentation.prob_size() && segmentation.prob(i).prob_coded() == 1) {
+      info->segment_tree_probs[i] = segmentation.prob(i).prob();
+    }
+  }
+  for (uint32_t i = 0; i < 8; i++) {
+    // 4 features per segment, SEG_LVL_SKIP is the last
+    uint32_t feature_index = i * 4 + 3;
+    info->segment_skip[i] = enabled && segmentation.segmentation_update_data() == 1 &&
+                            (int32_t) feature_index < segmentation.features_size() &&
+                            segmentation.features(feature_index).feature_enabled() == 1;
+  }
+}
+
+inline void ClearVP9AboveContext(VP9TileContext* context, uint32_t mi_cols) {
+  // Once per frame, tile rows carry the above context over (clear_above_context)
+  context->above_info.assign(mi_cols + 8, VP9BlockInfo());
+  for (uint32_t plane = 0; plane < 3; plane++) {
+    context->above_nonzero[plane].assign(mi_cols * 2 + 16, 0);
+  }
+  context->above_partition.assign(mi_cols + 8, 0);
+}
+
+inline void ClearVP9LeftContext(VP9TileContext* context) {
+  // At the start of every superblock row of a tile (clear_left_context)
+  for (VP9BlockInfo& info : context->left_info) {
+    info = VP9BlockInfo();
+  }
+  memset(context->left_nonzero, 0, sizeof(context->left_nonzero));
+  memset(context->left_partition, 0, sizeof(context->left_partition));
+}
+
+inline uint32_t GetVP9PartitionContext(const VP9TileContext* context, uint32_t mi_row, uint32_t mi_col, uint32_t bsl) {
+  // bsl is log2 of the block width in 8x8 units, 0 for 8x8 to 3 for 64x64
+  uint32_t above = (context->above_partition[mi_col] >> bsl) & 1;
+  uint32_t left = (context->left_partition[mi_row & 7] >> bsl) & 1;
+  return bsl * 4 + left * 2 + above;
+}
+
+inline void UpdateVP9PartitionContext(VP9TileContext* context, uint32_t mi_row, uint32_t mi_col, uint32_t subsize,
+                                      uint32_t num_8x8) {
+  memset(&context->above_partition[mi_col], partition_context_above[subsize], num_8x8);
+  memset(&context->left_partition[mi_row & 7], partition_context_left[subsize], num_8x8);
+}
+
+inline const VP9BlockInfo* GetVP9AboveInfo(const VP9TileContext* context, uint32_t mi_row, uint32_t mi_col) {
+  // Rows above are available across tile rows, nullptr in the first row of the frame
+  return mi_row > 0 ? &context->above_info[mi_col] : nullptr;
+}
+
+inline const VP9BlockInfo* GetVP9LeftInfo(const VP9TileContext* context, uint32_t mi_row, uint32_t mi_col) {
+  // Columns to the left are only available inside the tile
+  return mi_col > context->mi_col_start ? &context->left_info[mi_row & 7] : nullptr;
+}
+
+inline void StoreVP9BlockInfo(VP9TileContext* context, const VP9BlockFrameInfo& frame_info, uint32_t mi_row,
+                              uint32_t mi_col, uint32_t bw, uint32_t bh, const VP9BlockInfo& info) {
+  // Only the 8x8 positions inside the frame, the blocks after it read them from there
+  uint32_t x_mis = std::min(bw, frame_info.mi_cols - mi_col);
+  uint32_t y_mis = std::min(bh, frame_info.mi_rows - mi_row);
+  for (uint32_t i = 0; i < x_mis; i++) {
+    context->above_info[mi_col + i] = info;
+  }
+  for (uint32_t i = 0; i < y_mis; i++) {
+    context->left_info[(mi_row & 7) + i] = info;
+  }
+}
+
+inline uint32_t GetVP9SkipContext(const VP9BlockInfo* above, const VP9BlockInfo* left) {
+  return (above != nullptr ? above->skip : 0) + (left != nullptr ? left->skip : 0);
+}
+
+inline uint32_t GetVP9TxSizeContext(const VP9BlockInfo* above, const VP9BlockInfo* left, uint32_t max_tx_size) {
+  uint32_t above_ctx = (above != nullptr && !above->skip) ? above->tx_size : max_tx_size;
+  uint32_t left_ctx = (left != nullptr && !left->skip) ? left->tx_size : max_tx_size;
+  if (left == nullptr) {
+    left_ctx = above_ctx;
+  }
+  if (above == nullptr) {
+    above_ctx = left_ctx;
+  }
+  return (above_ctx + left_ctx) > max_tx_size;
+}
+
+inline const uint8_t* GetVP9TxProbs(const VP9FrameContext& probs, uint32_t max_tx_size, uint32_t ctx) {
+  if (max_tx_size == 1) {
+    return probs.tx_probs_8x8[ctx];
+  }
+  if (max_tx_size == 2) {
+    return probs.tx_probs_16x16[ctx];
+  }
+  return probs.tx_probs_32x32[ctx];
+}
+
+inline uint32_t GetVP9AboveMode(const VP9BlockInfo& block, const VP9BlockInfo* above, uint32_t b) {
+  // Mode above 4x4 quarter b, from the block above for the top row
+  if (b < 2) {
+    return (above == nullptr || above->is_inter) ? (uint32_t) DC_PRED : (uint32_t) above->sub_modes[b + 2];
+  }
+  return block.sub_modes[b - 2];
+}
+
+inline uint32_t GetVP9LeftMode(const VP9BlockInfo& block, const VP9BlockInfo* left, uint32_t b) {
+  if (b == 0 || b == 2) {
+    return (left == nullptr || left->is_inter) ? (uint32_t) DC_PRED : (uint32_t) left->sub_modes[b + 1];
+  }
+  return block.sub_modes[b - 1];
+}
+
+inline uint32_t GetVP9UvTxSize(uint32_t tx_size, uint32_t n4_wl, uint32_t n4_hl) {
+  // n4_wl and n4_hl are log2 of the chroma block size in 4x4 units
+  return std::min(tx_size, std::min(n4_wl, n4_hl));
+}
+
+inline const uint16_t* GetVP9Scan(uint32_t tx_size, uint32_t tx_type) {
+  static const uint16_t* const scans[4][4] = {
+    {default_scan_4x4, row_scan_4x4, col_scan_4x4, default_scan_4x4},
+    {default_scan_8x8, row_scan_8x8, col_scan_8x8, default_scan_8x8},
+    {default_scan_16x16, row_scan_16x16, col_scan_16x16, default_scan_16x16},
+    {default_scan_32x32, default_scan_32x32, default_scan_32x32, default_scan_32x32}
+  };
+  return scans[tx_size][tx_type];
+}
+
+inline uint32_t GetVP9CoefBand(uint32_t tx_size, uint32_t c) {
+  if (tx_size == 0) {
+    return coefband_4x4[c];
+  }
+  return c < 21 ? coefband_8x8plus[c] : 5;
+}
+
+inline uint32_t GetVP9NonzeroContext(const VP9TileContext* context, uint32_t plane, uint32_t x4, uint32_t y4,
+                                     uint32_t tx_size) {
+  // Context of the first coefficient, x4 and y4 are the 4x4 column in the frame and the 4x4 row in the superblock
+  // Entries past the edge of the frame are always 0
+  uint32_t above = 0;
+  uint32_t left = 0;
+  for (uint32_t i = 0; i < (1u << tx_size); i++) {
+    above |= context->above_nonzero[plane][x4 + i];
+    left |= context->left_nonzero[plane][(y4 + i) & 15];
+  }
+  return above + left;
+}
+
+inline void SetVP9NonzeroContext(VP9TileContext* context, uint32_t plane, uint32_t x4, uint32_t y4, uint32_t tx_size,
+                                 uint32_t blocks_wide, uint32_t blocks_high, bool nonzero) {
+  // blocks_wide and blocks_high are how many of the 4x4 columns and rows are inside the frame, the rest stay 0
+  for (uint32_t i = 0; i < (1u << tx_size); i++) {
+    context->above_nonzero[plane][x4 + i] = nonzero && i < blocks_wide;
+    context->left_nonzero[plane][(y4 + i) & 15] = nonzero && i < blocks_high;
+  }
+}
+
+inline void ClearVP9NonzeroContext(VP9TileContext* context, uint32_t plane, uint32_t x4, uint32_t y4, uint32_t n4_w,
+                                   uint32_t n4_h) {
+  // A skipped block has no nonzero transform block, over its whole size in the plane
+  memset(&context->above_nonzero[plane][x4], 0, n4_w);
+  for (uint32_t i = 0; i < n4_h; i++) {
+    context->left_nonzero[plane][(y4 + i) & 15] = 0;
+  }
+}
+
+inline uint32_t GetVP9CoefContext(const VP9TileContext* context, const uint16_t* scan, uint32_t tx_size,
+                                  uint32_t tx_type, uint32_t c) {
+  // Context of coefficient c > 0 from the tokens above and to the left of it. Column scans (DCT_ADST) only look
+  // above, row scans (ADST_DCT) only look left
+  uint32_t pos = scan[c];
+  uint32_t width_log2 = tx_size + 2;
+  uint32_t i = pos >> width_log2;
+  uint32_t j = pos & ((1u << width_log2) - 1);
+  uint32_t above = pos - (1u << width_log2);
+  uint32_t left = pos - 1;
+  uint32_t a;
+  uint32_t b;
+  if (i > 0 && j > 0) {
+    if (tx_size < 3 && tx_type == DCT_ADST) {
+      a = above;
+      b = above;
+    }
+    else if (tx_size < 3 && tx_type == ADST_DCT) {
+      a = left;
+      b = left;
+    }
+    else {
+      a = above;
+      b = left;
+    }
+  }
+  else if (i > 0) {
+    a = above;
+    b = above;
+  }
+  else {
+    a = left;
+    b = left;
+  }
+  return (1 + context->token_cache[a] + context->token_cache[b]) >> 1;
+}
+
+inline uint32_t GetVP9CoefToken(uint32_t level) {
+  // Token of a coefficient level above 0
+  if (level <= 4) {
+    return level;
+  }
+  uint32_t cat = 5;
+  while (cat > 0 && level < cat_min_level[cat]) {
+    cat--;
+  }
+  return DCT_VAL_CAT1 + cat;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_BLOCK_CONTEXT_H_
@@ -0,0 +1,59 @@
+#ifndef VP9_BOOL_RUN_H_
+#define VP9_BOOL_RUN_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Precomputed tables for coding a run of zero bools at a fixed probability in one step
+// Coding a zero only shrinks the range to split and renormalizes it, so the range and the total
+// normalization shift after 2^level zeros only depend on the starting range and the probability.
+// The encoder and decoder share these tables and combine levels like binary lifting to cover any run.
+
+#define BOOL_RUN_LEVELS 9 // runs of up to 2^9 - 1 zeros per pass, enough for the 396 coef probs
+
+namespace VP9Fuzzer {
+
+struct BoolRunTable {
+  // Indexed by [level][range] for the range before the run, 128-255 after normalization
+  uint8_t range[BOOL_RUN_LEVELS][256];
+  uint16_t shift[BOOL_RUN_LEVELS][256];
+};
+
+inline void BuildBoolRunTable(uint32_t p, BoolRunTable* table) {
+  // Level 0 is a single zero bool, same split as ReadBool and WriteBool
+  for (uint32_t range = 1; range < 256; range++) {
+    uint32_t split = 1 + (((range - 1) * p) >> 8);
+    uint32_t shift = 0;
+    while (((split << shift) & 0x80) == 0 && shift < 8) {
+      shift++;
+    }
+    table->range[0][range] = (split << shift) & 0xff;
+    table->shift[0][range] = shift;
+  }
+  // Level n is two runs of level n - 1
+  for (uint32_t level = 1; level < BOOL_RUN_LEVELS; level++) {
+    for (uint32_t range = 0; range < 256; range++) {
+      uint8_t half_range = table->range[level - 1][range];
+      table->range[level][range] = table->range[level - 1][half_range];
+      table->shift[level][range] = table->shift[level - 1][range] + table->shift[level - 1][half_range];
+    }
+  }
+}
+
+inline const BoolRunTable* GetBoolRunTable(uint32_t p) {
+  // Tables are built on first use, only a few probabilities (mostly 252) ever get used
+  // call_once so readers on several threads can share them
+  static std::unique_ptr<BoolRunTable> tables[256];
+  static std::once_flag built[256];
+  std::unique_ptr<BoolRunTable>& table = tables[p & 0xff];
+  std::call_once(built[p & 0xff], [&table, p] {
+    table.reset(new BoolRunTable());
+    BuildBoolRunTable(p & 0xff, table.get());
+  });
+  return table.get();
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_BOOL_RUN_H_
@@ -0,0 +1,604 @@
+#ifndef VP9_COMPACT_H_
+#define VP9_COMPACT_H_
+
+#include <string>
+
+#include "vp9.pb.h"
+#include "vp9_compact.pb.h"
+
+// Lossless conversion between VP9Frame and the bit-packed CompactVP9Frame (vp9_compact.proto)
+// Every field keeps the bits its syntax element has in the bitstream, which covers everything the reader
+// produces and everything the writer emits. VP9SignedInteger::value and Feature::feature_value only keep
+// their first byte since neither converter reads past it (at most 8 bits), but empty and zero stay distinct.
+
+namespace VP9Fuzzer {
+
+enum CompactUncompressedFlag {
+  CUF_PROFILE_LOW_BIT,
+  CUF_PROFILE_HIGH_BIT,
+  CUF_SHOW_EXISTING_FRAME,
+  CUF_SHOW_FRAME,
+  CUF_ERROR_RESILIENT_MODE,
+  CUF_INTRA_ONLY,
+  CUF_ALLOW_HIGH_PRECISION_MV,
+  CUF_REFRESH_FRAME_CONTEXT,
+  CUF_FRAME_PARALLEL_DECODING_MODE,
+  CUF_TEN_OR_TWELVE_BIT,
+  CUF_COLOR_RANGE,
+  CUF_SUBSAMPLING_X,
+  CUF_SUBSAMPLING_Y,
+  CUF_COLOR_RESERVED_ZERO,
+  CUF_RENDER_AND_FRAME_SIZE_DIFFERENT,
+  CUF_IS_FILTER_SWITCHABLE,
+  CUF_LOOP_FILTER_DELTA_ENABLED,
+  CUF_LOOP_FILTER_DELTA_UPDATE,
+  CUF_TILE_ROWS_LOG2,
+  CUF_INCREMENT_TILE_ROWS_LOG2,
+  CUF_SEGMENTATION_ENABLED,
+  CUF_SEGMENTATION_UPDATE_MAP,
+  CUF_SEGMENTATION_TEMPORAL_UPDATE,
+  CUF_SEGMENTATION_UPDATE_DATA,
+  CUF_SEGMENTATION_ABS_OR_DELTA_UPDATE
+};
+
+enum CompactUncompressedPresent {
+  CUP_COLOR_CONFIG,
+  CUP_FRAME_SIZE,
+  CUP_RENDER_SIZE,
+  CUP_READ_INTERPOLATION_FILTER,
+  CUP_LOOP_FILTER_PARAMS,
+  CUP_QUANTIZATION_PARAMS,
+  CUP_SEGMENTATION_PARAMS,
+  CUP_TILE_INFO,
+  CUP_DELTA_Q_Y_DC,
+  CUP_DELTA_Q_UV_DC,
+  CUP_DELTA_Q_UV_AC
+};
+
+enum CompactUncompressedValue {
+  CUV_RESERVED_ZERO,
+  CUV_FRAME_TO_SHOW_MAP_IDX,
+  CUV_FRAME_TYPE,
+  CUV_FRAME_SYNC_CODE,
+  CUV_COLOR_SPACE,
+  CUV_FRAME_SIZE_FOUND_REF,
+  CUV_FRAME_WIDTH_MINUS_1,
+  CUV_FRAME_HEIGHT_MINUS_1,
+  CUV_RENDER_WIDTH_MINUS_1,
+  CUV_RENDER_HEIGHT_MINUS_1,
+  CUV_RESET_FRAME_CONTEXT,
+  CUV_REFRESH_FRAME_FLAGS,
+  CUV_RAW_INTERPOLATION_FILTER,
+  CUV_FRAME_CONTEXT_IDX,
+  CUV_LOOP_FILTER_LEVEL,
+  CUV_LOOP_FILTER_SHARPNESS,
+  CUV_BASE_Q_IDX,
+  CUV_DELTA_Q_Y_DC,
+  CUV_DELTA_Q_UV_DC,
+  CUV_DELTA_Q_UV_AC,
+  CUV_COUNT
+};
+
+enum CompactCompressedPresent {
+  CCP_READ_TX_MODE,
+  CCP_TX_MODE_PROBS,
+  CCP_READ_COEF_PROBS,
+  CCP_READ_SKIP_PROB,
+  CCP_READ_INTER_MODE_PROBS,
+  CCP_READ_INTERP_FILTER_PROBS,
+  CCP_READ_IS_INTER_PROBS,
+  CCP_FRAME_REFERENCE_MODE,
+  CCP_FRAME_REFERENCE_MODE_PROBS,
+  CCP_READ_Y_MODE_PROBS,
+  CCP_READ_PARTITION_PROBS,
+  CCP_MV_PROBS
+};
+
+inline uint32_t PackFlag(uint32_t flag, uint32_t bit) {
+  return (flag & 0b1) << bit;
+}
+
+inline VP9BitField UnpackFlag(uint32_t flags, uint32_t bit) {
+  return (VP9BitField) ((flags >> bit) & 0b1);
+}
+
+inline uint32_t PackBytesValue(const std::string& value) {
+  // 0 for an empty value, otherwise the first byte + 1
+  return value.empty() ? 0 : (uint8_t) value[0] + 1;
+}
+
+inline std::string UnpackBytesValue(uint32_t packed) {
+  return packed == 0 ? std::string() : std::string(1, (char) (packed - 1));
+}
+
+inline uint32_t PackSignedInteger(const VP9SignedInteger& signed_int) {
+  // bit 0: sign, bits 1-9: value
+  return PackFlag(signed_int.sign(), 0) | (PackBytesValue(signed_int.value()) << 1);
+}
+
+inline void UnpackSignedInteger(uint32_t packed, VP9SignedInteger* signed_int) {
+  signed_int->set_sign(UnpackFlag(packed, 0));
+  signed_int->set_value(UnpackBytesValue((packed >> 1) & 0x1ff));
+}
+
+inline uint32_t PackBitList(const google::protobuf::RepeatedField<int>& bits) {
+  // Packs up to 31 one bit elements behind a leading 1 bit that marks the count
+  if (bits.empty()) {
+    return 0;
+  }
+  uint32_t packed = 1;
+  for (int i = 0; i < bits.size() && i < 31; i++) {
+    packed = (packed << 1) | (bits.Get(i) & 0b1);
+  }
+  return packed;
+}
+
+inline void UnpackBitList(uint32_t packed, google::protobuf::RepeatedField<int>* bits) {
+  uint32_t count = 0;
+  while ((packed >> count) > 1) {
+    ++count;
+  }
+  for (uint32_t i = count; i --> 0;) {
+    bits->Add((packed >> i) & 0b1);
+  }
+}
+
+inline uint32_t PackReadDeltaQ(const UncompressedHeader_QuantizationParams_ReadDeltaQ& read_delta_q) {
+  // bit 0: delta_coded, bit 1: delta_q present, bits 2-11: delta_q
+  return PackFlag(read_delta_q.delta_coded(), 0)
+         | PackFlag(read_delta_q.has_delta_q(), 1)
+         | (PackSignedInteger(read_delta_q.delta_q()) << 2);
+}
+
+inline void UnpackReadDeltaQ(uint32_t packed, UncompressedHeader_QuantizationParams_ReadDeltaQ* read_delta_q) {
+  read_delta_q->set_delta_coded(UnpackFlag(packed, 0));
+  if (UnpackFlag(packed, 1)) {
+    UnpackSignedInteger(packed >> 2, read_delta_q->mutable_delta_q());
+  }
+}
+
+inline uint32_t PackDelta(uint32_t update, bool has_delta, const VP9SignedInteger& delta) {
+  // Shared by RefDelta and ModeDelta
+  // bit 0: update flag, bit 1: delta present, bits 2-11: delta
+  return PackFlag(update, 0) | PackFlag(has_delta, 1) | (PackSignedInteger(delta) << 2);
+}
+
+inline uint32_t PackDecodeTermSubexp(const CompressedHeader_DecodeTermSubexp& decode_term_subexp) {
+  // bit 1: decode_term_subexp present, bits 2-5: bit_1 to bit_4,
+  // bits 6-9: sub_exp_val, bits 10-13: sub_exp_val_minus_16, bits 14-18: sub_exp_val_minus_32, bits 19-26: v
+  return PackFlag(1, 1)
+         | PackFlag(decode_term_subexp.bit_1(), 2)
+         | PackFlag(decode_term_subexp.bit_2(), 3)
+         | PackFlag(decode_term_subexp.bit_3(), 4)
+         | PackFlag(decode_term_subexp.bit_4(), 5)
+         | ((decode_term_subexp.sub_exp_val() & 0xf) << 6)
+         | ((decode_term_subexp.sub_exp_val_minus_16() & 0xf) << 10)
+         | ((decode_term_subexp.sub_exp_val_minus_32() & 0x1f) << 14)
+         | ((decode_term_subexp.v() & 0xff) << 19);
+}
+
+inline void UnpackDecodeTermSubexp(uint32_t packed, CompressedHeader_DecodeTermSubexp* decode_term_subexp) {
+  decode_term_subexp->set_bit_1(UnpackFlag(packed, 2));
+  decode_term_subexp->set_bit_2(UnpackFlag(packed, 3));
+  decode_term_subexp->set_bit_3(UnpackFlag(packed, 4));
+  decode_term_subexp->set_bit_4(UnpackFlag(packed, 5));
+  decode_term_subexp->set_sub_exp_val((packed >> 6) & 0xf);
+  decode_term_subexp->set_sub_exp_val_minus_16((packed >> 10) & 0xf);
+  decode_term_subexp->set_sub_exp_val_minus_32((packed >> 14) & 0x1f);
+  decode_term_subexp->set_v((packed >> 19) & 0xff);
+}
+
+inline uint32_t PackDiffUpdateProb(const CompressedHeader_DiffUpdateProb& diff_update_prob) {
+  // bit 0: update_prob, bits 1-26: decode_term_subexp
+  uint32_t packed = PackFlag(diff_update_prob.update_prob(), 0);
+  if (diff_update_prob.has_decode_term_subexp()) {
+    packed |= PackDecodeTermSubexp(diff_update_prob.decode_term_subexp());
+  }
+  return packed;
+}
+
+inline void UnpackDiffUpdateProb(uint32_t packed, CompressedHeader_DiffUpdateProb* diff_update_prob) {
+  diff_update_prob->set_update_prob(UnpackFlag(packed, 0));
+  if (UnpackFlag(packed, 1)) {
+    UnpackDecodeTermSubexp(packed, diff_update_prob->mutable_decode_term_subexp());
+  }
+}
+
+inline void PackSparseDiffUpdateProbs(const google::protobuf::RepeatedPtrField<CompressedHeader_SparseDiffUpdateProb>& sparse_diff_update_probs,
+                                      google::protobuf::RepeatedField<uint64_t>* packed) {
+  // bits 0-26: decode_term_subexp, bits 32-63: index
+  packed->Reserve(sparse_diff_update_probs.size());
+  for (const CompressedHeader_SparseDiffUpdateProb& sparse_diff_update_prob : sparse_diff_update_probs) {
+    uint64_t value = (uint64_t) sparse_diff_update_prob.index() << 32;
+    if (sparse_diff_update_prob.has_decode_term_subexp()) {
+      value |= PackDecodeTermSubexp(sparse_diff_update_prob.decode_term_subexp());
+    }
+    packed->Add(value);
+  }
+}
+
+inline void UnpackSparseDiffUpdateProbs(const google::protobuf::RepeatedField<uint64_t>& packed,
+                                        google::protobuf::RepeatedPtrField<CompressedHeader_SparseDiffUpdateProb>* sparse_diff_update_probs) {
+  sparse_diff_update_probs->Reserve(packed.size());
+  for (uint64_t value : packed) {
+    auto sparse_diff_update_prob = sparse_diff_update_probs->Add();
+    sparse_diff_update_prob->set_index(value >> 32);
+    if (UnpackFlag(value, 1)) {
+      UnpackDecodeTermSubexp(value, sparse_diff_update_prob->mutable_decode_term_subexp());
+    }
+  }
+}
+
+inline void PackDiffUpdateProbs(const google::protobuf::RepeatedPtrField<CompressedHeader_DiffUpdateProb>& diff_update_probs,
+                                google::protobuf::RepeatedField<uint32_t>* packed) {
+  packed->Reserve(diff_update_probs.size());
+  for (const CompressedHeader_DiffUpdateProb& diff_update_prob : diff_update_probs) {
+    packed->Add(PackDiffUpdateProb(diff_update_prob));
+  }
+}
+
+inline void UnpackDiffUpdateProbs(const google::protobuf::RepeatedField<uint32_t>& packed,
+                                  google::protobuf::RepeatedPtrField<CompressedHeader_DiffUpdateProb>* diff_update_probs) {
+  diff_update_probs->Reserve(packed.size());
+  for (uint32_t value : packed) {
+    UnpackDiffUpdateProb(value, diff_update_probs->Add());
+  }
+}
+
+inline void PackVP9UncompressedHeader(const UncompressedHeader* header, CompactUncompressedHeader* compact) {
+  const auto& color_config = header->color_config();
+  const auto& render_size = header->render_size();
+  const auto& loop_filter_params = header->loop_filter_params();
+  const auto& quantization_params = header->quantization_params();
+  const auto& segmentation_params = header->segmentation_params();
+  const auto& tile_info = header->tile_info();
+
+  compact->set_flags(PackFlag(header->profile_low_bit(), CUF_PROFILE_LOW_BIT)
+                     | PackFlag(header->profile_high_bit(), CUF_PROFILE_HIGH_BIT)
+                     | PackFlag(header->show_existing_frame(), CUF_SHOW_EXISTING_FRAME)
+                     | PackFlag(header->show_frame(), CUF_SHOW_FRAME)
+                     | PackFlag(header->error_resilient_mode(), CUF_ERROR_RESILIENT_MODE)
+                     | PackFlag(header->intra_only(), CUF_INTRA_ONLY)
+                     | PackFlag(header->allow_high_precision_mv(), CUF_ALLOW_HIGH_PRECISION_MV)
+                     | PackFlag(header->refresh_frame_context(), CUF_REFRESH_FRAME_CONTEXT)
+                     | PackFlag(header->frame_parallel_decoding_mode(), CUF_FRAME_PARALLEL_DECODING_MODE)
+                     | PackFlag(color_config.ten_or_twelve_bit(), CUF_TEN_OR_TWELVE_BIT)
+                     | PackFlag(color_config.color_range(), CUF_COLOR_RANGE)
+                     | PackFlag(color_config.subsampling_x(), CUF_SUBSAMPLING_X)
+                     | PackFlag(color_config.subsampling_y(), CUF_SUBSAMPLING_Y)
+                     | PackFlag(color_config.reserved_zero(), CUF_COLOR_RESERVED_ZERO)
+                     | PackFlag(render_size.render_and_frame_size_different(), CUF_RENDER_AND_FRAME_SIZE_DIFFERENT)
+                     | PackFlag(header->read_interpolation_filter().is_filter_switchable(), CUF_IS_FILTER_SWITCHABLE)
+                     | PackFlag(loop_filter_params.loop_filter_delta_enabled(), CUF_LOOP_FILTER_DELTA_ENABLED)
+                     | PackFlag(loop_filter_params.loop_filter_delta_update(), CUF_LOOP_FILTER_DELTA_UPDATE)
+                     | PackFlag(tile_info.tile_rows_log2(), CUF_TILE_ROWS_LOG2)
+                     | PackFlag(tile_info.increment_tile_rows_log2(), CUF_INCREMENT_TILE_ROWS_LOG2)
+                     | PackFlag(segmentation_params.segmentation_enabled(), CUF_SEGMENTATION_ENABLED)
+                     | PackFlag(segmentation_params.segmentation_update_map(), CUF_SEGMENTATION_UPDATE_MAP)
+                     | PackFlag(segmentation_params.segmentation_temporal_update(), CUF_SEGMENTATION_TEMPORAL_UPDATE)
+                     | PackFlag(segmentation_params.segmentation_update_data(), CUF_SEGMENTATION_UPDATE_DATA)
+                     | PackFlag(segmentation_params.segmentation_abs_or_delta_update(), CUF_SEGMENTATION_ABS_OR_DELTA_UPDATE));
+
+  compact->set_present(PackFlag(header->has_color_config(), CUP_COLOR_CONFIG)
+                       | PackFlag(header->has_frame_size(), CUP_FRAME_SIZE)
+                       | PackFlag(header->has_render_size(), CUP_RENDER_SIZE)
+                       | PackFlag(header->has_read_interpolation_filter(), CUP_READ_INTERPOLATION_FILTER)
+                       | PackFlag(header->has_loop_filter_params(), CUP_LOOP_FILTER_PARAMS)
+                       | PackFlag(header->has_quantization_params(), CUP_QUANTIZATION_PARAMS)
+                       | PackFlag(header->has_segmentation_params(), CUP_SEGMENTATION_PARAMS)
+                       | PackFlag(header->has_tile_info(), CUP_TILE_INFO)
+                       | PackFlag(quantization_params.has_delta_q_y_dc(), CUP_DELTA_Q_Y_DC)
+                       | PackFlag(quantization_params.has_delta_q_uv_dc(), CUP_DELTA_Q_UV_DC)
+                       | PackFlag(quantization_params.has_delta_q_uv_ac(), CUP_DELTA_Q_UV_AC));
+
+  uint32_t values[CUV_COUNT] = {};
+  values[CUV_RESERVED_ZERO] = header->reserved_zero();
+  values[CUV_FRAME_TO_SHOW_MAP_IDX] = header->frame_to_show_map_idx();
+  values[CUV_FRAME_TYPE] = header->frame_type();
+  values[CUV_FRAME_SYNC_CODE] = header->frame_sync_code();
+  values[CUV_COLOR_SPACE] = color_config.color_space();
+  values[CUV_FRAME_SIZE_FOUND_REF] = header->frame_size_found_ref();
+  values[CUV_FRAME_WIDTH_MINUS_1] = header->frame_size().frame_width_minus_1();
+  values[CUV_FRAME_HEIGHT_MINUS_1] = header->frame_size().frame_height_minus_1();
+  values[CUV_RENDER_WIDTH_MINUS_1] = render_size.render_width_minus_1();
+  values[CUV_RENDER_HEIGHT_MINUS_1] = render_size.render_height_minus_1();
+  values[CUV_RESET_FRAME_CONTEXT] = header->reset_frame_context();
+  values[CUV_REFRESH_FRAME_FLAGS] = header->refresh_frame_flags();
+  values[CUV_RAW_INTERPOLATION_FILTER] = header->read_interpolation_filter().raw_interpolation_filter();
+  values[CUV_FRAME_CONTEXT_IDX] = header->frame_context_idx();
+  values[CUV_LOOP_FILTER_LEVEL] = loop_filter_params.loop_filter_level();
+  values[CUV_LOOP_FILTER_SHARPNESS] = loop_filter_params.loop_filter_sharpness();
+  values[CUV_BASE_Q_IDX] = quantization_params.base_q_idx();
+  values[CUV_DELTA_Q_Y_DC] = PackReadDeltaQ(quantization_params.delta_q_y_dc());
+  values[CUV_DELTA_Q_UV_DC] = PackReadDeltaQ(quantization_params.delta_q_uv_dc());
+  values[CUV_DELTA_Q_UV_AC] = PackReadDeltaQ(quantization_params.delta_q_uv_ac());
+  // Drop trailing zeros, missing values unpack as 0
+  uint32_t value_count = CUV_COUNT;
+  while (value_count > 0 && values[value_count - 1] == 0) {
+    --value_count;
+  }
+  compact->mutable_values()->Add(values, values + value_count);
+
+  compact->mutable_ref_frame_idx()->CopyFrom(header->ref_frame_idx());
+  compact->set_ref_frame_sign_bias(PackBitList(header->ref_frame_sign_bias()));
+  compact->set_increment_tile_cols_log2(PackBitList(tile_info.increment_tile_cols_log2()));
+
+  for (const auto& ref_delta : loop_filter_params.ref_delta()) {
+    compact->add_ref_delta(PackDelta(ref_delta.update_ref_delta(), ref_delta.has_loop_filter_ref_deltas(),
+                                     ref_delta.loop_filter_ref_deltas()));
+  }
+  for (const auto& mode_delta : loop_filter_params.mode_delta()) {
+    compact->add_mode_delta(PackDelta(mode_delta.update_mode_delta(), mode_delta.has_loop_filter_mode_deltas(),
+                                      mode_delta.loop_filter_mode_deltas()));
+  }
+  for (const auto& prob : segmentation_params.prob()) {
+    // bit 0: prob_coded, bits 1-8: prob
+    compact->add_segmentation_prob(PackFlag(prob.prob_coded(), 0) | ((prob.prob() & 0xff) << 1));
+  }
+  for (const auto& feature : segmentation_params.features()) {
+    // bit 0: feature_enabled, bit 1: feature_sign, bits 2-10: feature_value
+    compact->add_segmentation_features(PackFlag(feature.feature_enabled(), 0)
+                                       | PackFlag(feature.feature_sign(), 1)
+                                       | (PackBytesValue(feature.feature_value()) << 2));
+  }
+}
+
+inline void UnpackVP9UncompressedHeader(const CompactUncompressedHeader* compact, UncompressedHeader* header) {
+  uint32_t flags = compact->flags();
+  uint32_t present = compact->present();
+  uint32_t values[CUV_COUNT] = {};
+  for (int i = 0; i < compact->values().size() && i < CUV_COUNT; i++) {
+    values[i] = compact->values(i);
+  }
+
+  header->set_profile_low_bit(UnpackFlag(flags, CUF_PROFILE_LOW_BIT));
+  header->set_profile_high_bit(UnpackFlag(flags, CUF_PROFILE_HIGH_BIT));
+  header->set_reserved_zero(values[CUV_RESERVED_ZERO]);
+  header->set_show_existing_frame(UnpackFlag(flags, CUF_SHOW_EXISTING_FRAME));
+  header->set_frame_to_show_map_idx(values[CUV_FRAME_TO_SHOW_MAP_IDX]);
+  header->set_frame_type((UncompressedHeader_FrameType) values[CUV_FRAME_TYPE]);
+  header->set_show_frame(UnpackFlag(flags, CUF_SHOW_FRAME));
+  header->set_error_resilient_mode(UnpackFlag(flags, CUF_ERROR_RESILIENT_MODE));
+  header->set_frame_sync_code(values[CUV_FRAME_SYNC_CODE]);
+
+  if ((present >> CUP_COLOR_CONFIG) & 0b1) {
+    auto color_config = header->mutable_color_config();
+    color_config->set_ten_or_twelve_bit(UnpackFlag(flags, CUF_TEN_OR_TWELVE_BIT));
+    color_config->set_color_space(values[CUV_COLOR_SPACE]);
+    color_config->set_color_range(UnpackFlag(flags, CUF_COLOR_RANGE));
+    color_config->set_subsampling_x(UnpackFlag(flags, CUF_SUBSAMPLING_X));
+    color_config->set_subsampling_y(UnpackFlag(flags, CUF_SUBSAMPLING_Y));
+    color_config->set_reserved_zero(UnpackFlag(flags, CUF_COLOR_RESERVED_ZERO));
+  }
+
+  header->set_frame_size_found_ref(values[CUV_FRAME_SIZE_FOUND_REF]);
+  if ((present >> CUP_FRAME_SIZE) & 0b1) {
+    header->mutable_frame_size()->set_frame_width_minus_1(values[CUV_FRAME_WIDTH_MINUS_1]);
+    header->mutable_frame_size()->set_frame_height_minus_1(values[CUV_FRAME_HEIGHT_MINUS_1]);
+  }
+  if ((present >> CUP_RENDER_SIZE) & 0b1) {
+    auto render_size = header->mutable_render_size();
+    render_size->set_render_and_frame_size_different(UnpackFlag(flags, CUF_RENDER_AND_FRAME_SIZE_DIFFERENT));
+    render_size->set_render_width_minus_1(values[CUV_RENDER_WIDTH_MINUS_1]);
+    render_size->set_render_height_minus_1(values[CUV_RENDER_HEIGHT_MINUS_1]);
+  }
+
+  header->set_intra_only(UnpackFlag(flags, CUF_INTRA_ONLY));
+  header->set_reset_frame_context(values[CUV_RESET_FRAME_CONTEXT]);
+  header->set_refresh_frame_flags(values[CUV_REFRESH_FRAME_FLAGS]);
+  header->mutable_ref_frame_idx()->CopyFrom(compact->ref_frame_idx());
+  UnpackBitList(compact->ref_frame_sign_bias(), header->mutable_ref_frame_sign_bias());
+  header->set_allow_high_precision_mv(UnpackFlag(flags, CUF_ALLOW_HIGH_PRECISION_MV));
+
+  if ((present >> CUP_READ_INTERPOLATION_FILTER) & 0b1) {
+    auto read_interpolation_filter = header->mutable_read_interpolation_filter();
+    read_interpolation_filter->set_is_filter_switchable(UnpackFlag(flags, CUF_IS_FILTER_SWITCHABLE));
+    read_interpolation_filter->set_raw_interpolation_filter((UncompressedHeader_InterpolationFilter) values[CUV_RAW_INTERPOLATION_FILTER]);
+  }
+
+  header->set_refresh_frame_context(UnpackFlag(flags, CUF_REFRESH_FRAME_CONTEXT));
+  header->set_frame_parallel_decoding_mode(UnpackFlag(flags, CUF_FRAME_PARALLEL_DECODING_MODE));
+  header->set_frame_context_idx(values[CUV_FRAME_CONTEXT_IDX]);
+
+  if ((present >> CUP_LOOP_FILTER_PARAMS) & 0b1) {
+    auto loop_filter_params = header->mutable_loop_filter_params();
+    loop_filter_params->set_loop_filter_level(values[CUV_LOOP_FILTER_LEVEL]);
+    loop_filter_params->set_loop_filter_sharpness(values[CUV_LOOP_FILTER_SHARPNESS]);
+    loop_filter_params->set_loop_filter_delta_enabled(UnpackFlag(flags, CUF_LOOP_FILTER_DELTA_ENABLED));
+    loop_filter_params->set_loop_filter_delta_update(UnpackFlag(flags, CUF_LOOP_FILTER_DELTA_UPDATE));
+    for (uint32_t packed : compact->ref_delta()) {
+      auto ref_delta = loop_filter_params->add_ref_delta();
+      ref_delta->set_update_ref_delta(UnpackFlag(packed, 0));
+      if (UnpackFlag(packed, 1)) {
+        UnpackSignedInteger(packed >> 2, ref_delta->mutable_loop_filter_ref_deltas());
+      }
+    }
+    for (uint32_t packed : compact->mode_delta()) {
+      auto mode_delta = loop_filter_params->add_mode_delta();
+      mode_delta->set_update_mode_delta(UnpackFlag(packed, 0));
+      if (UnpackFlag(packed, 1)) {
+        UnpackSignedInteger(packed >> 2, mode_delta->mutable_loop_filter_mode_deltas());
+      }
+    }
+  }
+
+  if ((present >> CUP_QUANTIZATION_PARAMS) & 0b1) {
+    auto quantization_params = header->mutable_quantization_params();
+    quantization_params->set_base_q_idx(values[CUV_BASE_Q_IDX]);
+    if ((present >> CUP_DELTA_Q_Y_DC) & 0b1) {
+      UnpackReadDeltaQ(values[CUV_DELTA_Q_Y_DC], quantization_params->mutable_delta_q_y_dc());
+    }
+    if ((present >> CUP_DELTA_Q_UV_DC) & 0b1) {
+      UnpackReadDeltaQ(values[CUV_DELTA_Q_UV_DC], quantization_params->mutable_delta_q_uv_dc());
+    }
+    if ((present >> CUP_DELTA_Q_UV_AC) & 0b1) {
+      UnpackReadDeltaQ(values[CUV_DELTA_Q_UV_AC], quantization_params->mutable_delta_q_uv_ac());
+    }
+  }
+
+  if ((present >> CUP_SEGMENTATION_PARAMS) & 0b1) {
+    auto segmentation_params = header->mutable_segmentation_params();
+    segmentation_params->set_segmentation_enabled(UnpackFlag(flags, CUF_SEGMENTATION_ENABLED));
+    segmentation_params->set_segmentation_update_map(UnpackFlag(flags, CUF_SEGMENTATION_UPDATE_MAP));
+    segmentation_params->set_segmentation_temporal_update(UnpackFlag(flags, CUF_SEGMENTATION_TEMPORAL_UPDATE));
+    segmentation_params->set_segmentation_update_data(UnpackFlag(flags, CUF_SEGMENTATION_UPDATE_DATA));
+    segmentation_params->set_segmentation_abs_or_delta_update(UnpackFlag(flags, CUF_SEGMENTATION_ABS_OR_DELTA_UPDATE));
+    for (uint32_t packed : compact->segmentation_prob()) {
+      auto prob = segmentation_params->add_prob();
+      prob->set_prob_coded(UnpackFlag(packed, 0));
+      prob->set_prob((packed >> 1) & 0xff);
+    }
+    for (uint32_t packed : compact->segmentation_features()) {
+      auto feature = segmentation_params->add_features();
+      feature->set_feature_enabled(UnpackFlag(packed, 0));
+      feature->set_feature_sign(UnpackFlag(packed, 1));
+      feature->set_feature_value(UnpackBytesValue((packed >> 2) & 0x1ff));
+    }
+  }
+
+  if ((present >> CUP_TILE_INFO) & 0b1) {
+    auto tile_info = header->mutable_tile_info();
+    UnpackBitList(compact->increment_tile_cols_log2(), tile_info->mutable_increment_tile_cols_log2());
+    tile_info->set_tile_rows_log2(UnpackFlag(flags, CUF_TILE_ROWS_LOG2));
+    tile_info->set_increment_tile_rows_log2(UnpackFlag(flags, CUF_INCREMENT_TILE_ROWS_LOG2));
+  }
+}
+
+inline void PackVP9CompressedHeader(const CompressedHeader* header, CompactCompressedHeader* compact) {
+  compact->set_present(PackFlag(header->has_read_tx_mode(), CCP_READ_TX_MODE)
+                       | PackFlag(header->has_tx_mode_probs(), CCP_TX_MODE_PROBS)
+                       | PackFlag(header->has_read_coef_probs(), CCP_READ_COEF_PROBS)
+                       | PackFlag(header->has_read_skip_prob(), CCP_READ_SKIP_PROB)
+                       | PackFlag(header->has_read_inter_mode_probs(), CCP_READ_INTER_MODE_PROBS)
+                       | PackFlag(header->has_read_interp_filter_probs(), CCP_READ_INTERP_FILTER_PROBS)
+                       | PackFlag(header->has_read_is_inter_probs(), CCP_READ_IS_INTER_PROBS)
+                       | PackFlag(header->has_frame_reference_mode(), CCP_FRAME_REFERENCE_MODE)
+                       | PackFlag(header->has_frame_reference_mode_probs(), CCP_FRAME_REFERENCE_MODE_PROBS)
+                       | PackFlag(header->has_read_y_mode_probs(), CCP_READ_Y_MODE_PROBS)
+                       | PackFlag(header->has_read_partition_probs(), CCP_READ_PARTITION_PROBS)
+                       | PackFlag(header->has_mv_probs(), CCP_MV_PROBS));
+
+  // bit 0: tx_mode_select, bits 1-3: tx_mode
+  compact->set_read_tx_mode(PackFlag(header->read_tx_mode().tx_mode_select(), 0)
+                            | ((header->read_tx_mode().tx_mode() & 0b111) << 1));
+
+  PackDiffUpdateProbs(header->tx_mode_probs().diff_update_prob(), compact->mutable_tx_mode_probs());
+  PackSparseDiffUpdateProbs(header->tx_mode_probs().sparse_diff_update_prob(), compact->mutable_tx_mode_probs_sparse());
+  for (const auto& loop_obj : header->read_coef_probs().read_coef_probs()) {
+    auto compact_loop_obj = compact->add_read_coef_probs();
+    compact_loop_obj->set_update_probs(loop_obj.update_probs() & 0b1);
+    PackDiffUpdateProbs(loop_obj.diff_update_prob(), compact_loop_obj->mutable_diff_update_prob());
+    PackSparseDiffUpdateProbs(loop_obj.sparse_diff_update_prob(), compact_loop_obj->mutable_sparse_diff_update_prob());
+  }
+  PackDiffUpdateProbs(header->read_skip_prob().diff_update_prob(), compact->mutable_read_skip_prob());
+  PackSparseDiffUpdateProbs(header->read_skip_prob().sparse_diff_update_prob(), compact->mutable_read_skip_prob_sparse());
+  PackDiffUpdateProbs(header->read_inter_mode_probs().diff_update_prob(), compact->mutable_read_inter_mode_probs());
+  PackSparseDiffUpdateProbs(header->read_inter_mode_probs().sparse_diff_update_prob(), compact->mutable_read_inter_mode_probs_sparse());
+  PackDiffUpdateProbs(header->read_interp_filter_probs().diff_update_prob(), compact->mutable_read_interp_filter_probs());
+  PackSparseDiffUpdateProbs(header->read_interp_filter_probs().sparse_diff_update_prob(), compact->mutable_read_interp_filter_probs_sparse());
+  PackDiffUpdateProbs(header->read_is_inter_probs().diff_update_prob(), compact->mutable_read_is_inter_probs());
+  PackSparseDiffUpdateProbs(header->read_is_inter_probs().sparse_diff_update_prob(), compact->mutable_read_is_inter_probs_sparse());
+
+  // bit 0: non_single_reference, bit 1: reference_select
+  compact->set_frame_reference_mode(PackFlag(header->frame_reference_mode().non_single_reference(), 0)
+                                    | PackFlag(header->frame_reference_mode().reference_select(), 1));
+  PackDiffUpdateProbs(header->frame_reference_mode_probs().diff_update_prob(), compact->mutable_frame_reference_mode_probs());
+  PackSparseDiffUpdateProbs(header->frame_reference_mode_probs().sparse_diff_update_prob(), compact->mutable_frame_reference_mode_probs_sparse());
+
+  PackDiffUpdateProbs(header->read_y_mode_probs().diff_update_prob(), compact->mutable_read_y_mode_probs());
+  PackSparseDiffUpdateProbs(header->read_y_mode_probs().sparse_diff_update_prob(), compact->mutable_read_y_mode_probs_sparse());
+  PackDiffUpdateProbs(header->read_partition_probs().diff_update_prob(), compact->mutable_read_partition_probs());
+  PackSparseDiffUpdateProbs(header->read_partition_probs().sparse_diff_update_prob(), compact->mutable_read_partition_probs_sparse());
+
+  for (const auto& mv_probs_loop : header->mv_probs().mv_probs()) {
+    // bit 0: update_mv_prob, bits 1-7: mv_prob
+    compact->add_mv_probs(PackFlag(mv_probs_loop.update_mv_prob(), 0) | ((mv_probs_loop.mv_prob() & 0x7f) << 1));
+  }
+}
+
+inline void UnpackVP9CompressedHeader(const CompactCompressedHeader* compact, CompressedHeader* header) {
+  uint32_t present = compact->present();
+
+  if ((present >> CCP_READ_TX_MODE) & 0b1) {
+    header->mutable_read_tx_mode()->set_tx_mode_select(UnpackFlag(compact->read_tx_mode(), 0));
+    header->mutable_read_tx_mode()->set_tx_mode((CompressedHeader_TxMode) ((compact->read_tx_mode() >> 1) & 0b111));
+  }
+  if ((present >> CCP_TX_MODE_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->tx_mode_probs(), header->mutable_tx_mode_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->tx_mode_probs_sparse(), header->mutable_tx_mode_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_COEF_PROBS) & 0b1) {
+    auto read_coef_probs = header->mutable_read_coef_probs();
+    for (const auto& compact_loop_obj : compact->read_coef_probs()) {
+      auto loop_obj = read_coef_probs->add_read_coef_probs();
+      loop_obj->set_update_probs(UnpackFlag(compact_loop_obj.update_probs(), 0));
+      UnpackDiffUpdateProbs(compact_loop_obj.diff_update_prob(), loop_obj->mutable_diff_update_prob());
+      UnpackSparseDiffUpdateProbs(compact_loop_obj.sparse_diff_update_prob(), loop_obj->mutable_sparse_diff_update_prob());
+    }
+  }
+  if ((present >> CCP_READ_SKIP_PROB) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_skip_prob(), header->mutable_read_skip_prob()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_skip_prob_sparse(), header->mutable_read_skip_prob()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_INTER_MODE_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_inter_mode_probs(), header->mutable_read_inter_mode_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_inter_mode_probs_sparse(), header->mutable_read_inter_mode_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_INTERP_FILTER_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_interp_filter_probs(), header->mutable_read_interp_filter_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_interp_filter_probs_sparse(), header->mutable_read_interp_filter_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_IS_INTER_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_is_inter_probs(), header->mutable_read_is_inter_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_is_inter_probs_sparse(), header->mutable_read_is_inter_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_FRAME_REFERENCE_MODE) & 0b1) {
+    header->mutable_frame_reference_mode()->set_non_single_reference(UnpackFlag(compact->frame_reference_mode(), 0));
+    header->mutable_frame_reference_mode()->set_reference_select(UnpackFlag(compact->frame_reference_mode(), 1));
+  }
+  if ((present >> CCP_FRAME_REFERENCE_MODE_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->frame_reference_mode_probs(), header->mutable_frame_reference_mode_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->frame_reference_mode_probs_sparse(), header->mutable_frame_reference_mode_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_Y_MODE_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_y_mode_probs(), header->mutable_read_y_mode_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_y_mode_probs_sparse(), header->mutable_read_y_mode_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_READ_PARTITION_PROBS) & 0b1) {
+    UnpackDiffUpdateProbs(compact->read_partition_probs(), header->mutable_read_partition_probs()->mutable_diff_update_prob());
+    UnpackSparseDiffUpdateProbs(compact->read_partition_probs_sparse(), header->mutable_read_partition_probs()->mutable_sparse_diff_update_prob());
+  }
+  if ((present >> CCP_MV_PROBS) & 0b1) {
+    auto mv_probs = header->mutable_mv_probs();
+    for (uint32_t packed : compact->mv_probs()) {
+      auto mv_probs_loop = mv_probs->add_mv_probs();
+      mv_probs_loop->set_update_mv_prob(UnpackFlag(packed, 0));
+      mv_probs_loop->set_mv_prob((packed >> 1) & 0x7f);
+    }
+  }
+}
+
+inline void PackVP9Frame(const VP9Frame* frame, CompactVP9Frame* compact) {
+  compact->set_present(PackFlag(frame->has_uncompressed_header(), 0) | PackFlag(frame->has_compressed_header(), 1));
+  if (frame->has_uncompressed_header()) {
+    PackVP9UncompressedHeader(&frame->uncompressed_header(), compact->mutable_uncompressed_header());
+  }
+  if (frame->has_compressed_header()) {
+    PackVP9CompressedHeader(&frame->compressed_header(), compact->mutable_compressed_header());
+  }
+  compact->mutable_tile()->CopyFrom(frame->tile());
+}
+
+inline void UnpackVP9Frame(const CompactVP9Frame* compact, VP9Frame* frame) {
+  if (UnpackFlag(compact->present(), 0)) {
+    UnpackVP9UncompressedHeader(&compact->uncompressed_header(), frame->mutable_uncompressed_header());
+  }
+  if (UnpackFlag(compact->present(), 1)) {
+    UnpackVP9CompressedHeader(&compact->compressed_header(), frame->mutable_compressed_header());
+  }
+  frame->mutable_tile()->CopyFrom(compact->tile());
+}
+
+}
+
+#endif
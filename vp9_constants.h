@@ -1,5 +1,3 @@
-#define MAX_TILES 3
-
 #define TX_MODES 5
 #define SEG_LVL_MAX 4
 
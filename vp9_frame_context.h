@@ -0,0 +1,426 @@
+#ifndef VP9_FRAME_CONTEXT_H_
+#define VP9_FRAME_CONTEXT_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "vp9.pb.h"
+#include "vp9_default_probs.h"
+#include "vp9_syntax.h"
+
+// The 4 saved probability contexts of a stream (frame_context_idx, reset_frame_context, refresh_frame_context)
+// Both converters feed every frame through ApplyVP9FrameContext in stream order. A frame's coded DiffUpdateProbs
+// are kept as a list of changed probabilities on top of the context it loaded, and a refresh only writes those back,
+// so a frame costs as much as it updates rather than a full context. Backward adaptation needs the symbol counts
+// of the decoded tiles, which neither converter has, so a context refreshed by an adapting frame only gets the coded
+// updates and is marked approximate.
+
+namespace VP9Fuzzer {
+
+struct VP9FrameContext {
+  // Probability tables of load_probs/save_probs, laid out in the order the compressed header codes them
+  uint8_t tx_probs_8x8[2][1];
+  uint8_t tx_probs_16x16[2][2];
+  uint8_t tx_probs_32x32[2][3];
+  uint8_t coef_probs[4][2][2][6][6][3];
+  uint8_t skip_prob[3];
+  uint8_t inter_mode_probs[7][3];
+  uint8_t interp_filter_probs[4][2];
+  uint8_t is_inter_prob[4];
+  uint8_t comp_mode_prob[5];
+  uint8_t single_ref_prob[5][2];
+  uint8_t comp_ref_prob[5];
+  uint8_t y_mode_probs[4][9];
+  uint8_t uv_mode_probs[10][9];
+  uint8_t partition_probs[16][3];
+  uint8_t mv_joint_probs[3];
+  uint8_t mv_sign_prob[2];
+  uint8_t mv_class_probs[2][10];
+  uint8_t mv_class0_bit_prob[2];
+  uint8_t mv_bits_prob[2][10];
+  uint8_t mv_class0_fr_probs[2][2][3];
+  uint8_t mv_fr_probs[2][3];
+  uint8_t mv_class0_hp_prob[2];
+  uint8_t mv_hp_prob[2];
+};
+
+struct VP9ProbUpdate {
+  uint16_t offset; // byte offset of the probability in VP9FrameContext
+  uint8_t prob;
+};
+
+struct VP9FrameContextStore {
+  VP9FrameContext contexts[4];
+  // Refreshed by a frame with backward adaptation since the last reset
+  bool approximate[4];
+  // Context the last frame loaded and the probabilities it coded on top of it
+  uint32_t frame_context_idx;
+  // The context it loaded was approximate
+  bool frame_approximate;
+  std::vector<VP9ProbUpdate> updates;
+};
+
+inline void SetupVP9DefaultProbs(VP9FrameContext* probs) {
+  memcpy(probs->tx_probs_8x8, default_tx_probs_8x8, sizeof(probs->tx_probs_8x8));
+  memcpy(probs->tx_probs_16x16, default_tx_probs_16x16, sizeof(probs->tx_probs_16x16));
+  memcpy(probs->tx_probs_32x32, default_tx_probs_32x32, sizeof(probs->tx_probs_32x32));
+  memcpy(probs->coef_probs, default_coef_probs, sizeof(probs->coef_probs));
+  memcpy(probs->skip_prob, default_skip_prob, sizeof(probs->skip_prob));
+  memcpy(probs->inter_mode_probs, default_inter_mode_probs, sizeof(probs->inter_mode_probs));
+  memcpy(probs->interp_filter_probs, default_interp_filter_probs, sizeof(probs->interp_filter_probs));
+  memcpy(probs->is_inter_prob, default_is_inter_prob, sizeof(probs->is_inter_prob));
+  memcpy(probs->comp_mode_prob, default_comp_mode_prob, sizeof(probs->comp_mode_prob));
+  memcpy(probs->single_ref_prob, default_single_ref_prob, sizeof(probs->single_ref_prob));
+  memcpy(probs->comp_ref_prob, default_comp_ref_prob, sizeof(probs->comp_ref_prob));
+  memcpy(probs->y_mode_probs, default_y_mode_probs, sizeof(probs->y_mode_probs));
+  memcpy(probs->uv_mode_probs, default_uv_mode_probs, sizeof(probs->uv_mode_probs));
+  memcpy(probs->partition_probs, default_partition_probs, sizeof(probs->partition_probs));
+  memcpy(probs->mv_joint_probs, default_mv_joint_probs, sizeof(probs->mv_joint_probs));
+  memcpy(probs->mv_sign_prob, default_mv_sign_prob, sizeof(probs->mv_sign_prob));
+  memcpy(probs->mv_class_probs, default_mv_class_probs, sizeof(probs->mv_class_probs));
+  memcpy(probs->mv_class0_bit_prob, default_mv_class0_bit_prob, sizeof(probs->mv_class0_bit_prob));
+  memcpy(probs->mv_bits_prob, default_mv_bits_prob, sizeof(probs->mv_bits_prob));
+  memcpy(probs->mv_class0_fr_probs, default_mv_class0_fr_probs, sizeof(probs->mv_class0_fr_probs));
+  memcpy(probs->mv_fr_probs, default_mv_fr_probs, sizeof(probs->mv_fr_probs));
+  memcpy(probs->mv_class0_hp_prob, default_mv_class0_hp_prob, sizeof(probs->mv_class0_hp_prob));
+  memcpy(probs->mv_hp_prob, default_mv_hp_prob, sizeof(probs->mv_hp_prob));
+}
+
+inline const VP9FrameContext& GetVP9DefaultProbs() {
+  static const VP9FrameContext defaults = [] {
+    VP9FrameContext probs;
+    SetupVP9DefaultProbs(&probs);
+    return probs;
+  }();
+  return defaults;
+}
+
+// Byte offset of a probability or table in VP9FrameContext, unlike offsetof the indexes don't have to be constants
+#define VP9_PROB_OFFSET(field) \
+  ((uint16_t) ((const uint8_t*) &VP9Fuzzer::GetVP9DefaultProbs().field - (const uint8_t*) &VP9Fuzzer::GetVP9DefaultProbs()))
+
+inline void ResetVP9FrameContextStore(VP9FrameContextStore* store) {
+  for (uint32_t i = 0; i < 4; i++) {
+    store->contexts[i] = GetVP9DefaultProbs();
+    store->approximate[i] = false;
+  }
+  store->frame_context_idx = 0;
+  store->frame_approximate = false;
+  store->updates.clear();
+}
+
+inline VP9FrameContextStore MakeVP9FrameContextStore() {
+  // Frames before the first key frame start from the defaults too
+  VP9FrameContextStore store;
+  ResetVP9FrameContextStore(&store);
+  return store;
+}
+
+inline uint32_t GetVP9SubexpDelta(const CompressedHeader_DecodeTermSubexp& decode_term_subexp) {
+  // decode_term_subexp, decode_uniform codes v in 7 bits and v >= 65 takes bit_4 as one more low bit
+  if (decode_term_subexp.bit_1() == 0) {
+    return decode_term_subexp.sub_exp_val();
+  }
+  if (decode_term_subexp.bit_2() == 0) {
+    return decode_term_subexp.sub_exp_val_minus_16() + 16;
+  }
+  if (decode_term_subexp.bit_3() == 0) {
+    return decode_term_subexp.sub_exp_val_minus_32() + 32;
+  }
+  uint32_t v = decode_term_subexp.v();
+  return (v < 65 ? v : (v << 1) - 65 + decode_term_subexp.bit_4()) + 64;
+}
+
+inline uint32_t InvRecenterVP9Nonneg(uint32_t v, uint32_t m) {
+  uint32_t recentered = (v & 1) ? m - ((v + 1) >> 1) : m + (v >> 1);
+  return v > 2 * m ? v : recentered;
+}
+
+inline uint8_t InvMapVP9Delta(uint32_t delta) {
+  // inv_map_table codes the 20 values 7 + 13 * n first, then the other values from 1 to 253, then 253 again
+  static const std::array<uint8_t, 255> inv_map_table = [] {
+    std::array<uint8_t, 255> table;
+    uint32_t size = 0;
+    for (uint32_t v = 7; v < 255; v += 13) {
+      table[size++] = v;
+    }
+    for (uint32_t v = 1; v < 254; v++) {
+      if (v % 13 != 7) {
+        table[size++] = v;
+      }
+    }
+    table[size] = 253;
+    return table;
+  }();
+  return inv_map_table[delta < 255 ? delta : 254];
+}
+
+inline uint8_t InvRemapVP9MappedProb(uint32_t v, uint8_t prob) {
+  // inv_remap_prob after inv_map_table, written without branches so that loops over it vectorize
+  uint32_t m = prob - 1;
+  bool low = (m << 1) <= 255;
+  uint32_t r = InvRecenterVP9Nonneg(v, low ? m : 255 - 1 - m);
+  return low ? 1 + r : 255 - r;
+}
+
+inline uint8_t InvRemapVP9Prob(uint32_t delta, uint8_t prob) {
+  return InvRemapVP9MappedProb(InvMapVP9Delta(delta), prob);
+}
+
+inline void AddVP9ProbUpdate(VP9FrameContextStore* store, int32_t offset, uint8_t prob) {
+  if (offset >= 0) {
+    store->updates.push_back(VP9ProbUpdate{(uint16_t) offset, prob});
+  }
+}
+
+template <typename DiffUpdateProbs, typename ProbOffset>
+inline void AddVP9DiffUpdateProbs(VP9FrameContextStore* store, const DiffUpdateProbs& diff_update_probs,
+                                  const ProbOffset& prob_offset) {
+  // prob_offset maps the loop index of a coded DiffUpdateProb to its probability, -1 for loop indexes
+  // past the end of its table
+  const uint8_t* base = (const uint8_t*) &store->contexts[store->frame_context_idx];
+  for (int32_t i = 0; i < diff_update_probs.diff_update_prob_size(); i++) {
+    const CompressedHeader_DiffUpdateProb& diff_update_prob = diff_update_probs.diff_update_prob(i);
+    int32_t offset = prob_offset(i);
+    if (diff_update_prob.update_prob() == 1 && offset >= 0) {
+      AddVP9ProbUpdate(store, offset, InvRemapVP9Prob(GetVP9SubexpDelta(diff_update_prob.decode_term_subexp()), base[offset]));
+    }
+  }
+  for (const CompressedHeader_SparseDiffUpdateProb& sparse_diff_update_prob : diff_update_probs.sparse_diff_update_prob()) {
+    int32_t offset = prob_offset(sparse_diff_update_prob.index());
+    if (offset >= 0) {
+      AddVP9ProbUpdate(store, offset, InvRemapVP9Prob(GetVP9SubexpDelta(sparse_diff_update_prob.decode_term_subexp()), base[offset]));
+    }
+  }
+}
+
+inline int32_t GetVP9TableOffset(uint16_t table_offset, uint32_t table_size, uint32_t index) {
+  return index < table_size ? table_offset + index : -1;
+}
+
+inline const std::vector<uint16_t>& GetVP9CoefProbOffsets() {
+  // The 396 coded coef probs of one tx size in loop order, band 0 only codes its first 3 contexts
+  static const std::vector<uint16_t> offsets = [] {
+    std::vector<uint16_t> table;
+    for (uint32_t i = 0; i < 2; i++) {
+      for (uint32_t j = 0; j < 2; j++) {
+        for (uint32_t k = 0; k < 6; k++) {
+          for (uint32_t l = 0; l < (k == 0 ? 3u : 6u); l++) {
+            for (uint32_t m = 0; m < 3; m++) {
+              table.push_back(VP9_PROB_OFFSET(coef_probs[0][i][j][k][l][m]));
+            }
+          }
+        }
+      }
+    }
+    return table;
+  }();
+  return offsets;
+}
+
+inline const std::vector<uint16_t>& GetVP9MvProbOffsets() {
+  // The 69 mv probs in loop order, components interleaved per group as the spec codes them
+  static const std::vector<uint16_t> offsets = [] {
+    std::vector<uint16_t> table;
+    for (uint32_t j = 0; j < 3; j++) {
+      table.push_back(VP9_PROB_OFFSET(mv_joint_probs[j]));
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+      table.push_back(VP9_PROB_OFFSET(mv_sign_prob[i]));
+      for (uint32_t j = 0; j < 10; j++) {
+        table.push_back(VP9_PROB_OFFSET(mv_class_probs[i][j]));
+      }
+      table.push_back(VP9_PROB_OFFSET(mv_class0_bit_prob[i]));
+      for (uint32_t j = 0; j < 10; j++) {
+        table.push_back(VP9_PROB_OFFSET(mv_bits_prob[i][j]));
+      }
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+      for (uint32_t j = 0; j < 2; j++) {
+        for (uint32_t k = 0; k < 3; k++) {
+          table.push_back(VP9_PROB_OFFSET(mv_class0_fr_probs[i][j][k]));
+        }
+      }
+      for (uint32_t k = 0; k < 3; k++) {
+        table.push_back(VP9_PROB_OFFSET(mv_fr_probs[i][k]));
+      }
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+      table.push_back(VP9_PROB_OFFSET(mv_class0_hp_prob[i]));
+      table.push_back(VP9_PROB_OFFSET(mv_hp_prob[i]));
+    }
+    return table;
+  }();
+  return offsets;
+}
+
+template <typename DiffUpdateProbs>
+inline void AddVP9CoefProbUpdates(VP9FrameContextStore* store, uint32_t tx_size, const DiffUpdateProbs& diff_update_probs) {
+  // The coef probs of a tx size are the one dense table of the header, up to 396 coded probs. The mapped deltas are
+  // scattered into its layout and remapped in one pass over the whole table that the compiler can run as SIMD
+  const uint32_t table_size = sizeof(VP9FrameContext::coef_probs[0]);
+  const std::vector<uint16_t>& offsets = GetVP9CoefProbOffsets();
+  uint16_t first_offset = VP9_PROB_OFFSET(coef_probs[0]);
+  uint8_t v[table_size] = {};
+  bool updated[table_size] = {};
+  uint16_t positions[table_size];
+  uint32_t update_count = 0;
+  auto add_delta = [&](uint32_t index, const CompressedHeader_DecodeTermSubexp& decode_term_subexp) {
+    uint32_t position = offsets[index] - first_offset;
+    v[position] = InvMapVP9Delta(GetVP9SubexpDelta(decode_term_subexp));
+    if (!updated[position]) {
+      updated[position] = true;
+      positions[update_count++] = position;
+    }
+  };
+  for (int32_t i = 0; i < diff_update_probs.diff_update_prob_size() && i < (int32_t) offsets.size(); i++) {
+    const CompressedHeader_DiffUpdateProb& diff_update_prob = diff_update_probs.diff_update_prob(i);
+    if (diff_update_prob.update_prob() == 1) {
+      add_delta(i, diff_update_prob.decode_term_subexp());
+    }
+  }
+  for (const CompressedHeader_SparseDiffUpdateProb& sparse_diff_update_prob : diff_update_probs.sparse_diff_update_prob()) {
+    if (sparse_diff_update_prob.index() < offsets.size()) {
+      add_delta(sparse_diff_update_prob.index(), sparse_diff_update_prob.decode_term_subexp());
+    }
+  }
+  if (update_count == 0) {
+    return;
+  }
+  uint16_t table_offset = VP9_PROB_OFFSET(coef_probs[tx_size]);
+  const uint8_t* base = (const uint8_t*) &store->contexts[store->frame_context_idx] + table_offset;
+  uint8_t probs[table_size];
+  for (uint32_t i = 0; i < table_size; i++) {
+    probs[i] = InvRemapVP9MappedProb(v[i], base[i]);
+  }
+  // Appended in one go, a push_back per probability costs more than the remap
+  size_t update_start = store->updates.size();
+  store->updates.resize(update_start + update_count);
+  for (uint32_t i = 0; i < update_count; i++) {
+    store->updates[update_start + i] = VP9ProbUpdate{(uint16_t) (table_offset + positions[i]), probs[positions[i]]};
+  }
+}
+
+inline void AddVP9CompressedHeaderUpdates(VP9FrameContextStore* store, const CompressedHeader& compressed_header) {
+  // Loop counts of the sections come from vp9_syntax.h, the same ones both converters code
+  if (compressed_header.has_tx_mode_probs()) {
+    AddVP9DiffUpdateProbs(store, compressed_header.tx_mode_probs(), [](uint32_t i) {
+      return GetVP9TableOffset(VP9_PROB_OFFSET(tx_probs_8x8), VP9_SYNTAX_TX_MODE_PROBS.count, i);
+    });
+  }
+  for (int32_t tx_size = 0; tx_size < compressed_header.read_coef_probs().read_coef_probs_size() && tx_size < 4; tx_size++) {
+    AddVP9CoefProbUpdates(store, tx_size, compressed_header.read_coef_probs().read_coef_probs(tx_size));
+  }
+  AddVP9DiffUpdateProbs(store, compressed_header.read_skip_prob(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(skip_prob), VP9_SYNTAX_SKIP_PROB.count, i);
+  });
+  if (!compressed_header.has_read_inter_mode_probs()) {
+    // Intra frames stop after the skip probs
+    return;
+  }
+  AddVP9DiffUpdateProbs(store, compressed_header.read_inter_mode_probs(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(inter_mode_probs), VP9_SYNTAX_INTER_MODE_PROBS.count, i);
+  });
+  AddVP9DiffUpdateProbs(store, compressed_header.read_interp_filter_probs(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(interp_filter_probs), VP9_SYNTAX_INTERP_FILTER_PROBS.count, i);
+  });
+  AddVP9DiffUpdateProbs(store, compressed_header.read_is_inter_probs(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(is_inter_prob), VP9_SYNTAX_IS_INTER_PROBS.count, i);
+  });
+
+  // comp_mode, single_ref and comp_ref follow each other, only the ones reference_mode codes
+  const CompressedHeader_FrameReferenceMode& frame_reference_mode = compressed_header.frame_reference_mode();
+  std::vector<std::pair<uint16_t, uint32_t>> reference_groups;
+  bool reference_select = frame_reference_mode.non_single_reference() == 1 && frame_reference_mode.reference_select() == 1;
+  bool compound_reference = frame_reference_mode.non_single_reference() == 1 && frame_reference_mode.reference_select() == 0;
+  if (reference_select) {
+    reference_groups.emplace_back(VP9_PROB_OFFSET(comp_mode_prob), VP9_SYNTAX_COMP_MODE_PROB.count);
+  }
+  if (!compound_reference) {
+    reference_groups.emplace_back(VP9_PROB_OFFSET(single_ref_prob), VP9_SYNTAX_SINGLE_REF_PROB.count);
+  }
+  if (frame_reference_mode.non_single_reference() == 1) {
+    reference_groups.emplace_back(VP9_PROB_OFFSET(comp_ref_prob), VP9_SYNTAX_COMP_REF_PROB.count);
+  }
+  AddVP9DiffUpdateProbs(store, compressed_header.frame_reference_mode_probs(), [&reference_groups](uint32_t i) {
+    for (const std::pair<uint16_t, uint32_t>& group : reference_groups) {
+      if (i < group.second) {
+        return (int32_t) (group.first + i);
+      }
+      i -= group.second;
+    }
+    return -1;
+  });
+
+  AddVP9DiffUpdateProbs(store, compressed_header.read_y_mode_probs(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(y_mode_probs), VP9_SYNTAX_Y_MODE_PROBS.count, i);
+  });
+  AddVP9DiffUpdateProbs(store, compressed_header.read_partition_probs(), [](uint32_t i) {
+    return GetVP9TableOffset(VP9_PROB_OFFSET(partition_probs), VP9_SYNTAX_PARTITION_PROBS.count, i);
+  });
+
+  // mv probs are coded as 7 bits, not as a delta
+  const std::vector<uint16_t>& mv_offsets = GetVP9MvProbOffsets();
+  for (int32_t i = 0; i < compressed_header.mv_probs().mv_probs_size() && i < (int32_t) mv_offsets.size(); i++) {
+    const CompressedHeader_MvProbs_MvProbsLoop& mv_probs_loop = compressed_header.mv_probs().mv_probs(i);
+    if (mv_probs_loop.update_mv_prob() == 1) {
+      AddVP9ProbUpdate(store, mv_offsets[i], (mv_probs_loop.mv_prob() << 1) | 1);
+    }
+  }
+}
+
+inline void ApplyVP9FrameContext(VP9FrameContextStore* store, const VP9Frame& vp9_frame) {
+  // Resets, loads and refreshes the saved contexts for one frame (setup_past_independence, load_probs,
+  // the compressed header updates and save_probs in refresh_probs)
+  const UncompressedHeader& uncompressed_header = vp9_frame.uncompressed_header();
+  store->updates.clear();
+  if (uncompressed_header.show_existing_frame() == 1) {
+    return;
+  }
+  bool key_frame = uncompressed_header.frame_type() == UncompressedHeader_FrameType_KEY_FRAME;
+  bool error_resilient_mode = uncompressed_header.error_resilient_mode() == 1;
+  uint32_t frame_context_idx = uncompressed_header.frame_context_idx() & 0b11;
+  if (key_frame || uncompressed_header.intra_only() == 1 || error_resilient_mode) {
+    uint32_t reset_frame_context = uncompressed_header.reset_frame_context();
+    if (key_frame || error_resilient_mode || reset_frame_context == 3) {
+      ResetVP9FrameContextStore(store);
+    }
+    else if (reset_frame_context == 2) {
+      store->contexts[frame_context_idx] = GetVP9DefaultProbs();
+      store->approximate[frame_context_idx] = false;
+    }
+    frame_context_idx = 0;
+  }
+  store->frame_context_idx = frame_context_idx;
+  store->frame_approximate = store->approximate[frame_context_idx];
+  if (vp9_frame.has_compressed_header()) {
+    AddVP9CompressedHeaderUpdates(store, vp9_frame.compressed_header());
+  }
+
+  // refresh_frame_context is only coded without error_resilient_mode
+  bool refresh_frame_context = !error_resilient_mode && uncompressed_header.refresh_frame_context() == 1;
+  bool adapt = !error_resilient_mode && uncompressed_header.frame_parallel_decoding_mode() == 0;
+  if (refresh_frame_context) {
+    uint8_t* saved = (uint8_t*) &store->contexts[frame_context_idx];
+    for (const VP9ProbUpdate& update : store->updates) {
+      saved[update.offset] = update.prob;
+    }
+    store->approximate[frame_context_idx] = store->approximate[frame_context_idx] || adapt;
+  }
+}
+
+inline void LoadVP9FrameContext(const VP9FrameContextStore* store, VP9FrameContext* probs) {
+  // Probabilities the last frame was coded with, its context with its updates on top
+  *probs = store->contexts[store->frame_context_idx];
+  uint8_t* bytes = (uint8_t*) probs;
+  for (const VP9ProbUpdate& update : store->updates) {
+    bytes[update.offset] = update.prob;
+  }
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_FRAME_CONTEXT_H_
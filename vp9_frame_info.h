@@ -0,0 +1,189 @@
+#ifndef VP9_FRAME_INFO_H_
+#define VP9_FRAME_INFO_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vp9_bit_reader.h"
+#include "vp9_syntax.h"
+
+// Header-only peek at a VP9 frame for indexing tools
+// PeekFrameInfo decodes the uncompressed header up to base_q_idx into a plain struct without allocating,
+// using the same BitReader as ReadVP9UncompressedHeader and the element widths and counts of vp9_syntax.h.
+// The compressed header and tiles are never touched.
+
+#define VP9_FRAME_MARKER 2
+#define VP9_FRAME_SYNC_CODE 0x498342
+#define VP9_CS_RGB 7
+
+namespace VP9Fuzzer {
+
+struct FrameInfo {
+  bool valid; // false on a bad frame marker or sync code, or when the data ends early
+  uint32_t profile;
+  uint32_t show_existing_frame;
+  uint32_t frame_to_show_map_idx;
+  uint32_t frame_type; // 0 for key frames
+  uint32_t show_frame;
+  uint32_t error_resilient_mode;
+  uint32_t intra_only;
+  uint32_t bit_depth;
+  uint32_t width; // 0 when the size is copied from a reference frame
+  uint32_t height;
+  int32_t size_ref_frame_idx; // ref_frame_idx the size is copied from, -1 when coded
+  uint32_t refresh_frame_flags;
+  uint32_t base_q_idx;
+};
+
+template <const VP9SyntaxElement& Element>
+inline uint32_t PeekVP9Element(BitReader* reader) {
+  // Reads one element of vp9_syntax.h without recording it, the peek only covers f(n) elements
+  static_assert(Element.coding == VP9_SYNTAX_RAW, "only the uncompressed header is peeked");
+  return ReadBits(reader, Element.bits);
+}
+
+inline void PeekColorConfig(BitReader* reader, FrameInfo* info) {
+  info->bit_depth = 8;
+  if (info->profile >= 2) {
+    info->bit_depth = PeekVP9Element<VP9_SYNTAX_TEN_OR_TWELVE_BIT>(reader) ? 12 : 10;
+  }
+  uint32_t color_space = PeekVP9Element<VP9_SYNTAX_COLOR_SPACE>(reader);
+  if (color_space != VP9_CS_RGB) {
+    PeekVP9Element<VP9_SYNTAX_COLOR_RANGE>(reader);
+    if (info->profile == 1 || info->profile == 3) {
+      PeekVP9Element<VP9_SYNTAX_SUBSAMPLING_X>(reader);
+      PeekVP9Element<VP9_SYNTAX_SUBSAMPLING_Y>(reader);
+      PeekVP9Element<VP9_SYNTAX_RESERVED_ZERO>(reader);
+    }
+  }
+  else if (info->profile == 1 || info->profile == 3) {
+    PeekVP9Element<VP9_SYNTAX_RESERVED_ZERO>(reader);
+  }
+}
+
+inline void PeekFrameSize(BitReader* reader, FrameInfo* info) {
+  info->width = PeekVP9Element<VP9_SYNTAX_FRAME_WIDTH_MINUS_1>(reader) + 1;
+  info->height = PeekVP9Element<VP9_SYNTAX_FRAME_HEIGHT_MINUS_1>(reader) + 1;
+}
+
+inline void PeekRenderSize(BitReader* reader) {
+  if (PeekVP9Element<VP9_SYNTAX_RENDER_AND_FRAME_SIZE_DIFFERENT>(reader) == 1) {
+    PeekVP9Element<VP9_SYNTAX_RENDER_WIDTH_MINUS_1>(reader);
+    PeekVP9Element<VP9_SYNTAX_RENDER_HEIGHT_MINUS_1>(reader);
+  }
+}
+
+inline FrameInfo PeekFrameInfo(const uint8_t* data, size_t size) {
+  FrameInfo info = {};
+  info.size_ref_frame_idx = -1;
+  BitReader reader = MakeBitReader(data, size);
+
+  if (PeekVP9Element<VP9_SYNTAX_FRAME_MARKER>(&reader) != VP9_FRAME_MARKER) {
+    return info;
+  }
+  uint32_t profile_low_bit = PeekVP9Element<VP9_SYNTAX_PROFILE_LOW_BIT>(&reader);
+  uint32_t profile_high_bit = PeekVP9Element<VP9_SYNTAX_PROFILE_HIGH_BIT>(&reader);
+  info.profile = (profile_high_bit << 1) + profile_low_bit;
+  if (info.profile == 3) {
+    PeekVP9Element<VP9_SYNTAX_RESERVED_ZERO>(&reader);
+  }
+
+  info.show_existing_frame = PeekVP9Element<VP9_SYNTAX_SHOW_EXISTING_FRAME>(&reader);
+  if (info.show_existing_frame == 1) {
+    info.frame_to_show_map_idx = PeekVP9Element<VP9_SYNTAX_FRAME_TO_SHOW_MAP_IDX>(&reader);
+    info.valid = !BitReaderOverrun(&reader);
+    return info;
+  }
+
+  info.frame_type = PeekVP9Element<VP9_SYNTAX_FRAME_TYPE>(&reader);
+  info.show_frame = PeekVP9Element<VP9_SYNTAX_SHOW_FRAME>(&reader);
+  info.error_resilient_mode = PeekVP9Element<VP9_SYNTAX_ERROR_RESILIENT_MODE>(&reader);
+
+  if (info.frame_type == 0) {
+    if (PeekVP9Element<VP9_SYNTAX_FRAME_SYNC_CODE>(&reader) != VP9_FRAME_SYNC_CODE) {
+      return info;
+    }
+    PeekColorConfig(&reader, &info);
+    PeekFrameSize(&reader, &info);
+    PeekRenderSize(&reader);
+    info.refresh_frame_flags = 0xff;
+  }
+  else {
+    if (info.show_frame == 0) {
+      info.intra_only = PeekVP9Element<VP9_SYNTAX_INTRA_ONLY>(&reader);
+    }
+    if (info.error_resilient_mode == 0) {
+      PeekVP9Element<VP9_SYNTAX_RESET_FRAME_CONTEXT>(&reader);
+    }
+    if (info.intra_only == 1) {
+      if (PeekVP9Element<VP9_SYNTAX_FRAME_SYNC_CODE>(&reader) != VP9_FRAME_SYNC_CODE) {
+        return info;
+      }
+      if (info.profile > 0) {
+        PeekColorConfig(&reader, &info);
+      }
+      else {
+        info.bit_depth = 8;
+      }
+      info.refresh_frame_flags = PeekVP9Element<VP9_SYNTAX_REFRESH_FRAME_FLAGS>(&reader);
+      PeekFrameSize(&reader, &info);
+      PeekRenderSize(&reader);
+    }
+    else {
+      info.refresh_frame_flags = PeekVP9Element<VP9_SYNTAX_REFRESH_FRAME_FLAGS>(&reader);
+      uint32_t ref_frame_idx[VP9_SYNTAX_REF_FRAME_IDX.count];
+      for (uint32_t i = 0; i < VP9_SYNTAX_REF_FRAME_IDX.count; i++) {
+        ref_frame_idx[i] = PeekVP9Element<VP9_SYNTAX_REF_FRAME_IDX>(&reader);
+        PeekVP9Element<VP9_SYNTAX_REF_FRAME_SIGN_BIAS>(&reader);
+      }
+      // frame_size_with_refs, found_ref stops at the first reference with a matching size
+      for (uint32_t i = 0; i < VP9_SYNTAX_FRAME_SIZE_FOUND_REF.count; i++) {
+        if (PeekVP9Element<VP9_SYNTAX_FRAME_SIZE_FOUND_REF>(&reader) == 1) {
+          info.size_ref_frame_idx = ref_frame_idx[i];
+          break;
+        }
+      }
+      if (info.size_ref_frame_idx == -1) {
+        PeekFrameSize(&reader, &info);
+      }
+      PeekRenderSize(&reader);
+      PeekVP9Element<VP9_SYNTAX_ALLOW_HIGH_PRECISION_MV>(&reader);
+      if (PeekVP9Element<VP9_SYNTAX_IS_FILTER_SWITCHABLE>(&reader) == 0) {
+        PeekVP9Element<VP9_SYNTAX_RAW_INTERPOLATION_FILTER>(&reader);
+      }
+    }
+  }
+
+  if (info.error_resilient_mode == 0) {
+    PeekVP9Element<VP9_SYNTAX_REFRESH_FRAME_CONTEXT>(&reader);
+    PeekVP9Element<VP9_SYNTAX_FRAME_PARALLEL_DECODING_MODE>(&reader);
+  }
+  PeekVP9Element<VP9_SYNTAX_FRAME_CONTEXT_IDX>(&reader);
+
+  // loop_filter_params, the deltas are an update bit and an optional su(6) each
+  PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_LEVEL>(&reader);
+  PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_SHARPNESS>(&reader);
+  if (PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_DELTA_ENABLED>(&reader) == 1 &&
+      PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_DELTA_UPDATE>(&reader) == 1) {
+    for (uint32_t i = 0; i < VP9_SYNTAX_UPDATE_REF_DELTA.count; i++) {
+      if (PeekVP9Element<VP9_SYNTAX_UPDATE_REF_DELTA>(&reader) == 1) {
+        PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_REF_DELTAS>(&reader);
+        PeekVP9Element<VP9_SYNTAX_SIGN>(&reader);
+      }
+    }
+    for (uint32_t i = 0; i < VP9_SYNTAX_UPDATE_MODE_DELTA.count; i++) {
+      if (PeekVP9Element<VP9_SYNTAX_UPDATE_MODE_DELTA>(&reader) == 1) {
+        PeekVP9Element<VP9_SYNTAX_LOOP_FILTER_MODE_DELTAS>(&reader);
+        PeekVP9Element<VP9_SYNTAX_SIGN>(&reader);
+      }
+    }
+  }
+
+  info.base_q_idx = PeekVP9Element<VP9_SYNTAX_BASE_Q_IDX>(&reader);
+  info.valid = !BitReaderOverrun(&reader);
+  return info;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_FRAME_INFO_H_
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+
+#include "vp9_index.h"
+
+// Builds and queries the sidecar frame index of an IVF file (vp9_index.h)
+
+bool OpenOrBuildIndex(const std::string& ivf_path, const std::string& index_path, bool rebuild, VP9Fuzzer::VP9Index* index) {
+  // Rebuilds the index when asked to, when it is missing, when OpenVP9Index rejects it (an older VP9_INDEX_VERSION
+  // reads intra_only from a reserved byte) or when the IVF changed size since it was built
+  struct stat ivf_stat;
+  if (stat(ivf_path.c_str(), &ivf_stat) != 0) {
+    std::cerr << "Failed to read file: " << ivf_path << std::endl;
+    return false;
+  }
+  if (!rebuild && VP9Fuzzer::OpenVP9Index(index_path.c_str(), index)) {
+    if (index->header->source_size == (uint64_t) ivf_stat.st_size) {
+      return true;
+    }
+    VP9Fuzzer::CloseVP9Index(index);
+  }
+  std::cout << "Building index " << index_path << std::endl;
+  if (!VP9Fuzzer::BuildVP9Index(ivf_path.c_str(), index_path.c_str())) {
+    std::cerr << "Failed to index file: " << ivf_path << std::endl;
+    return false;
+  }
+  return VP9Fuzzer::OpenVP9Index(index_path.c_str(), index);
+}
+
+void PrintEntry(const VP9Fuzzer::VP9Index* index, const VP9Fuzzer::VP9IndexEntry* entry) {
+  std::cout << "Frame: " << (entry - index->entries) << std::endl;
+  std::cout << "Offset: " << entry->offset << std::endl;
+  std::cout << "Size: " << entry->size << std::endl;
+  std::cout << "Timestamp: " << entry->timestamp << std::endl;
+  std::cout << "Valid: " << (uint32_t) entry->valid << std::endl;
+  std::cout << "Frame Type: " << (uint32_t) entry->frame_type << std::endl;
+  std::cout << "Intra Only: " << (uint32_t) entry->intra_only << std::endl;
+  std::cout << "Show Frame: " << (uint32_t) entry->show_frame << std::endl;
+  std::cout << "Show Existing Frame: " << (uint32_t) entry->show_existing_frame << std::endl;
+  std::cout << "Dimensions: " << entry->width << "x" << entry->height << std::endl;
+  std::cout << "Refresh Frame Flags: " << (uint32_t) entry->refresh_frame_flags << std::endl;
+  std::cout << "Base Q Index: " << (uint32_t) entry->base_q_idx << std::endl;
+  std::cout << "Key Frame: " << (int64_t) (int32_t) entry->keyframe_entry << std::endl;
+}
+
+bool ExtractFrames(const std::string& ivf_path, const VP9Fuzzer::VP9Index* index, uint64_t first, uint64_t last, const std::string& out_path) {
+  // Copies frames first to last (inclusive) into a new IVF with the source file header
+  FILE* ivf = fopen(ivf_path.c_str(), "rb");
+  FILE* out = fopen(out_path.c_str(), "wb");
+  if (ivf == nullptr || out == nullptr) {
+    if (ivf != nullptr) fclose(ivf);
+    if (out != nullptr) fclose(out);
+    return false;
+  }
+
+  uint8_t file_header[IVF_FILE_HEADER_SIZE];
+  bool ok = fread(file_header, 1, IVF_FILE_HEADER_SIZE, ivf) == IVF_FILE_HEADER_SIZE;
+  // Frame count at byte 24
+  uint32_t frame_count = last - first + 1;
+  memcpy(file_header + 24, &frame_count, sizeof(uint32_t));
+  fwrite(file_header, 1, IVF_FILE_HEADER_SIZE, out);
+
+  std::vector<char> buffer;
+  for (uint64_t frame = first; ok && frame <= last; frame++) {
+    const VP9Fuzzer::VP9IndexEntry* entry = VP9Fuzzer::GetVP9IndexEntry(index, frame);
+    // The frame header comes along with the frame
+    buffer.resize(IVF_FRAME_HEADER_SIZE + entry->size);
+    ok = fseeko(ivf, entry->offset - IVF_FRAME_HEADER_SIZE, SEEK_SET) == 0
+         && fread(buffer.data(), 1, buffer.size(), ivf) == buffer.size()
+         && fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+  }
+
+  fclose(ivf);
+  ok = (fclose(out) == 0) && ok;
+  return ok;
+}
+
+int main(int argc, char** argv) {
+
+  // Check args
+  if (argc < 2) {
+    std::cout << "usage: " << argv[0] << " <ivf_file> [--index <index_file>] [--rebuild] [--frame <n>] [--keyframe <n>]"
+              << " [--extract <first> <last> <out_file>] [--extract-from-keyframe <first> <last> <out_file>]" << std::endl;
+    return 0;
+  }
+  std::string ivf_path = argv[1];
+  std::string index_path = ivf_path + ".idx";
+  bool rebuild = false;
+  for (int i = 2; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--index" && i + 1 < argc) index_path = argv[++i];
+    if (option == "--rebuild") rebuild = true;
+  }
+
+  VP9Fuzzer::VP9Index index;
+  if (!OpenOrBuildIndex(ivf_path, index_path, rebuild, &index)) {
+    return 1;
+  }
+  std::cout << "Frames: " << index.header->entry_count << std::endl;
+
+  int status = 0;
+  for (int i = 2; i < argc; i++) {
+    std::string option = argv[i];
+    if ((option == "--frame" || option == "--keyframe") && i + 1 < argc) {
+      uint64_t frame = std::stoull(argv[++i]);
+      const VP9Fuzzer::VP9IndexEntry* entry = option == "--frame" ? VP9Fuzzer::GetVP9IndexEntry(&index, frame)
+                                                                  : VP9Fuzzer::GetVP9KeyframeEntry(&index, frame);
+      if (entry == nullptr) {
+        std::cerr << "No such frame: " << frame << std::endl;
+        status = 1;
+        continue;
+      }
+      PrintEntry(&index, entry);
+    }
+    if ((option == "--extract" || option == "--extract-from-keyframe") && i + 3 < argc) {
+      uint64_t first = std::stoull(argv[++i]);
+      uint64_t last = std::stoull(argv[++i]);
+      std::string out_path = argv[++i];
+      // Start at the key frame before first so the extracted range decodes on its own
+      if (option == "--extract-from-keyframe" && VP9Fuzzer::GetVP9KeyframeEntry(&index, first) != nullptr) {
+        first = VP9Fuzzer::GetVP9KeyframeEntry(&index, first) - index.entries;
+      }
+      if (first > last || last >= index.header->entry_count || !ExtractFrames(ivf_path, &index, first, last, out_path)) {
+        std::cerr << "Failed to extract frames " << first << " to " << last << std::endl;
+        status = 1;
+        continue;
+      }
+      std::cout << "Wrote frames " << first << " to " << last << " to " << out_path << std::endl;
+    }
+  }
+
+  VP9Fuzzer::CloseVP9Index(&index);
+  return status;
+}
@@ -0,0 +1,232 @@
+#ifndef VP9_INDEX_H_
+#define VP9_INDEX_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "vp9_frame_info.h"
+
+// Sidecar frame index for IVF files (vp9_index.cpp builds it, <file>.ivf.idx by default)
+// The file is a VP9IndexHeader followed by one fixed-size VP9IndexEntry per IVF frame, little endian as written,
+// so it can be mmapped and frame n, its key frame and any frame range are found without reading the IVF again.
+// Superframes are indexed as a single frame described by their first frame.
+
+#define VP9_INDEX_MAGIC 0x49395056 // "VP9I"
+// Version 2 records intra_only in the byte version 1 left reserved, indexes of another version are rebuilt
+#define VP9_INDEX_VERSION 2
+#define VP9_INDEX_NO_KEYFRAME 0xffffffff
+
+#define IVF_FILE_HEADER_SIZE 32
+#define IVF_FRAME_HEADER_SIZE 12
+// Enough bytes of a frame for PeekFrameInfo to reach base_q_idx
+#define VP9_INDEX_PEEK_SIZE 64
+
+namespace VP9Fuzzer {
+
+struct VP9IndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t entry_count;
+  uint64_t source_size; // size of the indexed IVF file, to catch stale indexes
+};
+
+struct VP9IndexEntry {
+  uint64_t offset; // file offset of the frame data, after its 12 byte frame header
+  uint64_t timestamp;
+  uint32_t size;
+  uint32_t keyframe_entry; // entry of the last key frame at or before this one, VP9_INDEX_NO_KEYFRAME if none
+  uint32_t width; // resolved through the reference slots when the size is copied from a reference
+  uint32_t height;
+  uint8_t valid; // PeekFrameInfo could parse the header
+  uint8_t frame_type;
+  uint8_t show_frame;
+  uint8_t show_existing_frame;
+  uint8_t refresh_frame_flags;
+  uint8_t base_q_idx;
+  uint8_t intra_only; // since version 2
+  uint8_t reserved;
+};
+
+static_assert(sizeof(VP9IndexHeader) == 24, "VP9IndexHeader layout is part of the file format");
+static_assert(sizeof(VP9IndexEntry) == 40, "VP9IndexEntry layout is part of the file format");
+
+inline uint32_t ReadLE32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+inline uint64_t ReadLE64(const uint8_t* bytes) {
+  return ReadLE32(bytes) | ((uint64_t) ReadLE32(bytes + 4) << 32);
+}
+
+inline bool ScanVP9Frames(FILE* ivf, const std::function<void(const VP9IndexEntry&)>& on_entry) {
+  // One streaming pass over the IVF from its start, only the first VP9_INDEX_PEEK_SIZE bytes of every frame are read
+  // False when the file header is not an IVF one
+  uint8_t file_header[IVF_FILE_HEADER_SIZE];
+  if (fread(file_header, 1, IVF_FILE_HEADER_SIZE, ivf) != IVF_FILE_HEADER_SIZE || memcmp(file_header, "DKIF", 4) != 0) {
+    return false;
+  }
+
+  // Frame sizes of the 8 reference slots, for frames that copy their size from a reference
+  uint32_t slot_width[8] = {};
+  uint32_t slot_height[8] = {};
+  uint32_t keyframe_entry = VP9_INDEX_NO_KEYFRAME;
+  uint64_t entry_count = 0;
+  uint64_t offset = IVF_FILE_HEADER_SIZE;
+
+  uint8_t frame_header[IVF_FRAME_HEADER_SIZE];
+  uint8_t peek[VP9_INDEX_PEEK_SIZE];
+  while (fread(frame_header, 1, IVF_FRAME_HEADER_SIZE, ivf) == IVF_FRAME_HEADER_SIZE) {
+    VP9IndexEntry entry = {};
+    entry.offset = offset + IVF_FRAME_HEADER_SIZE;
+    entry.size = ReadLE32(frame_header);
+    entry.timestamp = ReadLE64(frame_header + 4);
+
+    size_t peek_size = fread(peek, 1, entry.size < VP9_INDEX_PEEK_SIZE ? entry.size : VP9_INDEX_PEEK_SIZE, ivf);
+    FrameInfo info = PeekFrameInfo(peek, peek_size);
+    if (info.valid) {
+      if (info.show_existing_frame == 1) {
+        info.width = slot_width[info.frame_to_show_map_idx];
+        info.height = slot_height[info.frame_to_show_map_idx];
+        info.show_frame = 1;
+      }
+      else if (info.size_ref_frame_idx >= 0) {
+        info.width = slot_width[info.size_ref_frame_idx];
+        info.height = slot_height[info.size_ref_frame_idx];
+      }
+      for (uint32_t slot = 0; slot < 8; slot++) {
+        if ((info.refresh_frame_flags >> slot) & 0b1) {
+          slot_width[slot] = info.width;
+          slot_height[slot] = info.height;
+        }
+      }
+      if (info.show_existing_frame == 0 && info.frame_type == 0) {
+        keyframe_entry = entry_count;
+      }
+    }
+
+    entry.keyframe_entry = keyframe_entry;
+    entry.width = info.width;
+    entry.height = info.height;
+    entry.valid = info.valid;
+    entry.frame_type = info.frame_type;
+    entry.show_frame = info.show_frame;
+    entry.show_existing_frame = info.show_existing_frame;
+    entry.refresh_frame_flags = info.refresh_frame_flags;
+    entry.base_q_idx = info.base_q_idx;
+    entry.intra_only = info.intra_only;
+    on_entry(entry);
+    entry_count++;
+
+    offset = entry.offset + entry.size;
+    if (fseeko(ivf, offset, SEEK_SET) != 0) {
+      break;
+    }
+  }
+  return true;
+}
+
+inline bool BuildVP9Index(const char* ivf_path, const char* index_path) {
+  FILE* ivf = fopen(ivf_path, "rb");
+  if (ivf == nullptr) {
+    return false;
+  }
+  FILE* index = fopen(index_path, "wb");
+  if (index == nullptr) {
+    fclose(ivf);
+    return false;
+  }
+
+  VP9IndexHeader header = {VP9_INDEX_MAGIC, VP9_INDEX_VERSION, 0, 0};
+  fwrite(&header, sizeof(header), 1, index);
+
+  std::vector<VP9IndexEntry> entries;
+  entries.reserve(4096);
+  bool ok = ScanVP9Frames(ivf, [&](const VP9IndexEntry& entry) {
+    entries.push_back(entry);
+    // Write entries out in batches so multi-GB files don't keep their whole index in memory
+    if (entries.size() == entries.capacity()) {
+      fwrite(entries.data(), sizeof(VP9IndexEntry), entries.size(), index);
+      header.entry_count += entries.size();
+      entries.clear();
+    }
+  });
+  fwrite(entries.data(), sizeof(VP9IndexEntry), entries.size(), index);
+  header.entry_count += entries.size();
+
+  fseeko(ivf, 0, SEEK_END);
+  header.source_size = ftello(ivf);
+  fseeko(index, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, index);
+
+  ok = ok && ferror(index) == 0;
+  fclose(ivf);
+  ok = (fclose(index) == 0) && ok;
+  return ok;
+}
+
+struct VP9Index {
+  const VP9IndexHeader* header = nullptr;
+  const VP9IndexEntry* entries = nullptr;
+  size_t mapped_size = 0;
+};
+
+inline bool OpenVP9Index(const char* index_path, VP9Index* index) {
+  // Maps the index read-only, fails on a bad magic, version or a truncated file
+  int fd = open(index_path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat index_stat;
+  if (fstat(fd, &index_stat) != 0 || (size_t) index_stat.st_size < sizeof(VP9IndexHeader)) {
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, index_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  index->header = (const VP9IndexHeader*) mapped;
+  index->entries = (const VP9IndexEntry*) ((const uint8_t*) mapped + sizeof(VP9IndexHeader));
+  index->mapped_size = index_stat.st_size;
+  if (index->header->magic != VP9_INDEX_MAGIC
+      || index->header->version != VP9_INDEX_VERSION
+      || index->header->entry_count > (index->mapped_size - sizeof(VP9IndexHeader)) / sizeof(VP9IndexEntry)) {
+    munmap(mapped, index->mapped_size);
+    *index = VP9Index();
+    return false;
+  }
+  return true;
+}
+
+inline void CloseVP9Index(VP9Index* index) {
+  if (index->header != nullptr) {
+    munmap((void*) index->header, index->mapped_size);
+  }
+  *index = VP9Index();
+}
+
+inline const VP9IndexEntry* GetVP9IndexEntry(const VP9Index* index, uint64_t frame) {
+  return frame < index->header->entry_count ? &index->entries[frame] : nullptr;
+}
+
+inline const VP9IndexEntry* GetVP9KeyframeEntry(const VP9Index* index, uint64_t frame) {
+  // Key frame to start decoding from to reach frame
+  const VP9IndexEntry* entry = GetVP9IndexEntry(index, frame);
+  if (entry == nullptr || entry->keyframe_entry == VP9_INDEX_NO_KEYFRAME) {
+    return nullptr;
+  }
+  return &index->entries[entry->keyframe_entry];
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_INDEX_H_
@@ -0,0 +1,108 @@
+#ifndef VP9_PROVENANCE_H_
+#define VP9_PROVENANCE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Side table of where every syntax element came from (vp9_to_proto <in_file> <out_file> --provenance <file>)
+// One entry per element read, keyed by its field path in vp9.proto. Raw header bits are file bit offsets.
+// Bool-coded fields are positions in the bool decoder, the bits it had shifted out of the compressed header
+// before and after the read, added to the file offset of the header. A bool at a high probability can take 0 bits.
+
+#define VP9_PROVENANCE_MAGIC 0x50395056 // "VP9P"
+#define VP9_PROVENANCE_VERSION 1
+#define VP9_PROVENANCE_NO_INDEX 0xffffffff
+
+namespace VP9Fuzzer {
+
+struct VP9ProvenanceEntry {
+  uint32_t path; // index into VP9Provenance::paths
+  uint32_t index; // element of a repeated field or first flag of a run, VP9_PROVENANCE_NO_INDEX otherwise
+  uint32_t elements; // more than 1 for a run of zero update flags read in one step
+  uint8_t bool_coded;
+  uint8_t prob; // bool probability, 0 for raw bits and 128 for bool literals
+  uint8_t reserved[2];
+  uint64_t start_bit;
+  uint64_t length_in_bits;
+};
+
+static_assert(sizeof(VP9ProvenanceEntry) == 32, "VP9ProvenanceEntry layout is part of the file format");
+
+struct VP9Provenance {
+  std::vector<std::string> paths;
+  std::unordered_map<std::string, uint32_t> path_ids;
+  std::vector<VP9ProvenanceEntry> entries;
+};
+
+inline uint32_t InternVP9ProvenancePath(VP9Provenance* provenance, const std::string& path) {
+  auto it = provenance->path_ids.find(path);
+  if (it != provenance->path_ids.end()) {
+    return it->second;
+  }
+  uint32_t id = provenance->paths.size();
+  provenance->paths.push_back(path);
+  provenance->path_ids.emplace(path, id);
+  return id;
+}
+
+inline bool WriteVP9Provenance(const VP9Provenance* provenance, const char* provenance_path) {
+  // Magic, version, path count, entry count, the paths as a length and its bytes, then the entries
+  FILE* out = fopen(provenance_path, "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  uint32_t header[4] = {VP9_PROVENANCE_MAGIC, VP9_PROVENANCE_VERSION, (uint32_t) provenance->paths.size(),
+                        (uint32_t) provenance->entries.size()};
+  fwrite(header, sizeof(header), 1, out);
+  for (const std::string& path : provenance->paths) {
+    uint32_t path_size = path.size();
+    fwrite(&path_size, sizeof(path_size), 1, out);
+    fwrite(path.data(), 1, path_size, out);
+  }
+  fwrite(provenance->entries.data(), sizeof(VP9ProvenanceEntry), provenance->entries.size(), out);
+  bool ok = ferror(out) == 0;
+  return (fclose(out) == 0) && ok;
+}
+
+inline bool ReadVP9Provenance(const char* provenance_path, VP9Provenance* provenance) {
+  FILE* in = fopen(provenance_path, "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  uint32_t header[4];
+  bool ok = fread(header, sizeof(header), 1, in) == 1 && header[0] == VP9_PROVENANCE_MAGIC
+            && header[1] == VP9_PROVENANCE_VERSION;
+  *provenance = VP9Provenance();
+  for (uint32_t i = 0; ok && i < header[2]; i++) {
+    uint32_t path_size = 0;
+    ok = fread(&path_size, sizeof(path_size), 1, in) == 1;
+    std::string path(ok ? path_size : 0, '\0');
+    ok = ok && fread(&path[0], 1, path_size, in) == path_size;
+    InternVP9ProvenancePath(provenance, path);
+  }
+  if (ok) {
+    provenance->entries.resize(header[3]);
+    ok = fread(provenance->entries.data(), sizeof(VP9ProvenanceEntry), header[3], in) == header[3];
+  }
+  fclose(in);
+  return ok;
+}
+
+inline std::vector<const VP9ProvenanceEntry*> FindVP9ProvenanceEntries(const VP9Provenance* provenance, uint64_t bit) {
+  // Every element covering bit in read order. A bool-coded element that took 0 bits covers its start bit
+  std::vector<const VP9ProvenanceEntry*> found;
+  for (const VP9ProvenanceEntry& entry : provenance->entries) {
+    uint64_t length = entry.length_in_bits > 0 ? entry.length_in_bits : 1;
+    if (bit >= entry.start_bit && bit - entry.start_bit < length) {
+      found.push_back(&entry);
+    }
+  }
+  return found;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_PROVENANCE_H_
@@ -0,0 +1,100 @@
+#ifndef VP9_REF_SLOTS_H_
+#define VP9_REF_SLOTS_H_
+
+#include <cstdint>
+
+#include "vp9.pb.h"
+
+// The 8 reference slots of a stream, only the frame format each one holds (size, subsampling, bit depth)
+// Inter frames with frame_size_found_ref take their size from a slot and every frame inherits the color format
+// of the frame before, so both converters resolve the format of a frame here before its tile info and then
+// store it in the slots its refresh_frame_flags name. Constant work per frame.
+
+namespace VP9Fuzzer {
+
+struct VP9FrameFormat {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint8_t subsampling_x = 1;
+  uint8_t subsampling_y = 1;
+  uint8_t bit_depth = 8;
+};
+
+struct VP9RefSlots {
+  VP9FrameFormat slots[8];
+  // Bit n is set once slot n was refreshed, a stream cut before its key frame can point at empty slots
+  uint8_t valid = 0;
+  // Format of the last frame, inter frames keep its color format
+  VP9FrameFormat current;
+};
+
+inline uint32_t GetVP9FoundRef(uint32_t frame_size_found_ref) {
+  // found_ref of reference i is bit 2 - i of the field, the first set bit (the highest) picks the reference
+  return frame_size_found_ref >= 4 ? 0 : (frame_size_found_ref >= 2 ? 1 : 2);
+}
+
+inline void SetVP9ColorFormat(const UncompressedHeader& uncompressed_header, VP9FrameFormat* format) {
+  // Only the coded bits, the block writer shifts by the subsampling of a mutated frame
+  uint32_t profile = ((uncompressed_header.profile_high_bit() & 0x1) << 1) + (uncompressed_header.profile_low_bit() & 0x1);
+  if (!uncompressed_header.has_color_config()) {
+    // Intra only frames in profile 0 code no color config
+    format->subsampling_x = 1;
+    format->subsampling_y = 1;
+    format->bit_depth = 8;
+    return;
+  }
+  const UncompressedHeader_ColorConfig& color_config = uncompressed_header.color_config();
+  format->bit_depth = profile >= 2 ? (color_config.ten_or_twelve_bit() ? 12 : 10) : 8;
+  if (color_config.color_space() == UncompressedHeader_ColorConfig::CS_RGB) {
+    format->subsampling_x = 0;
+    format->subsampling_y = 0;
+  }
+  else if (profile == 1 || profile == 3) {
+    format->subsampling_x = color_config.subsampling_x() & 0x1;
+    format->subsampling_y = color_config.subsampling_y() & 0x1;
+  }
+  else {
+    format->subsampling_x = 1;
+    format->subsampling_y = 1;
+  }
+}
+
+inline const VP9FrameFormat& ResolveVP9FrameFormat(VP9RefSlots* ref_slots, const UncompressedHeader& uncompressed_header) {
+  // Call once the frame size or frame_size_with_refs is parsed (or written)
+  VP9FrameFormat* format = &ref_slots->current;
+  bool intra = uncompressed_header.frame_type() == UncompressedHeader_FrameType_KEY_FRAME ||
+               uncompressed_header.intra_only() == 1;
+  if (intra) {
+    SetVP9ColorFormat(uncompressed_header, format);
+  }
+  // Bits above the 3 flags aren't coded
+  if (!intra && (uncompressed_header.frame_size_found_ref() & 0x7) != 0) {
+    uint32_t ref = GetVP9FoundRef(uncompressed_header.frame_size_found_ref());
+    uint32_t slot = ref < (uint32_t) uncompressed_header.ref_frame_idx_size() ? uncompressed_header.ref_frame_idx(ref) & 0x7 : 0;
+    // An empty slot keeps the size of the frame before
+    if ((ref_slots->valid >> slot) & 0b1) {
+      format->width = ref_slots->slots[slot].width;
+      format->height = ref_slots->slots[slot].height;
+    }
+  }
+  else {
+    // The writer codes 16 bits of a mutated size, larger values would size the tile layout past what a frame can have
+    format->width = (uncompressed_header.frame_size().frame_width_minus_1() & 0xffff) + 1;
+    format->height = (uncompressed_header.frame_size().frame_height_minus_1() & 0xffff) + 1;
+  }
+  return *format;
+}
+
+inline void RefreshVP9RefSlots(VP9RefSlots* ref_slots, uint32_t refresh_frame_flags) {
+  // Stores the current frame format in the slots named by the 8 refresh_frame_flags bits (all of them for key frames)
+  for (uint32_t slot = 0; slot < 8; slot++) {
+    if ((refresh_frame_flags >> slot) & 0b1) {
+      ref_slots->slots[slot] = ref_slots->current;
+    }
+  }
+  ref_slots->valid |= refresh_frame_flags & 0xff;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_REF_SLOTS_H_
@@ -0,0 +1,75 @@
+#ifndef VP9_RESYNC_H_
+#define VP9_RESYNC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "vp9_frame_info.h"
+#include "vp9_index.h"
+
+// Plausibility checks for IVF records and the scan for the next usable record after a corrupt one (--resync)
+// A record is plausible when its size is below VP9_RESYNC_MAX_FRAME_SIZE and its frame starts with a header
+// PeekFrameInfo can parse. After a corrupt record the stream continues at the next record that holds a key frame,
+// the first frame that doesn't depend on anything before it. Key frames are found by their byte-aligned sync code
+// with memchr, which the C library runs as a vectorized byte search.
+
+// No VP9 frame of a sane stream comes near this, a larger size is taken as a corrupt record header
+#define VP9_RESYNC_MAX_FRAME_SIZE (1 << 24)
+
+namespace VP9Fuzzer {
+
+struct VP9SkippedRange {
+  // Stream offsets of the bytes dropped between the last good record and the next one, end exclusive
+  uint64_t start;
+  uint64_t end;
+};
+
+inline bool IsPlausibleVP9Frame(const uint8_t* data, uint64_t size) {
+  // Empty records are kept as empty frames, as without --resync
+  if (size == 0) {
+    return true;
+  }
+  return PeekFrameInfo(data, size < VP9_INDEX_PEEK_SIZE ? size : VP9_INDEX_PEEK_SIZE).valid;
+}
+
+inline size_t FindVP9KeyFrameRecord(const uint8_t* data, size_t size, size_t* checked) {
+  // First record of data whose frame is a plausible key frame, npos when there is none yet. checked is set to
+  // how many leading bytes can't start one, the rest has to be scanned again with more data after it.
+  // The sync code 0x49 0x83 0x42 follows the first byte of the frame, profile 3 frames have it a bit later and
+  // aren't found
+  const size_t sync_at = IVF_FRAME_HEADER_SIZE + 2; // the 0x83 byte, from the start of the record
+  size_t pos = sync_at;
+  while (pos + 1 < size) {
+    const uint8_t* hit = (const uint8_t*) memchr(data + pos, 0x83, size - pos - 1);
+    if (hit == nullptr) {
+      break;
+    }
+    pos = hit - data;
+    size_t record = pos - sync_at;
+    uint8_t first_byte = data[record + IVF_FRAME_HEADER_SIZE];
+    // frame_marker, a profile below 3, then show_existing_frame and frame_type both 0
+    bool key_frame = (first_byte >> 6) == VP9_FRAME_MARKER && (first_byte & 0x30) != 0x30 && (first_byte & 0x0c) == 0;
+    uint32_t frame_size = ReadLE32(data + record);
+    if (data[pos - 1] == 0x49 && data[pos + 1] == 0x42 && key_frame && frame_size <= VP9_RESYNC_MAX_FRAME_SIZE) {
+      size_t peek_size = frame_size < VP9_INDEX_PEEK_SIZE ? frame_size : VP9_INDEX_PEEK_SIZE;
+      if (size - record - IVF_FRAME_HEADER_SIZE < peek_size) {
+        // Wait for the rest of the header
+        *checked = record;
+        return std::string::npos;
+      }
+      if (IsPlausibleVP9Frame(data + record + IVF_FRAME_HEADER_SIZE, peek_size)) {
+        *checked = record;
+        return record;
+      }
+    }
+    pos++;
+  }
+  // A record at or after size - sync_at - 1 has its sync code past the end
+  *checked = size > sync_at + 1 ? size - sync_at - 1 : 0;
+  return std::string::npos;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_RESYNC_H_
@@ -0,0 +1,200 @@
+#ifndef VP9_SYNTAX_H_
+#define VP9_SYNTAX_H_
+
+#include <cstdint>
+
+// Hand-maintained table of the VP9 frame header syntax, shared by vp9_to_proto.cpp and proto_to_vp9.cpp so the reader
+// and the writer can't disagree on a width or a loop count. Each element has its name (also its provenance field),
+// width, coding, loop count and the condition the compressed header codes it under. The converters read and write
+// elements with ReadVP9Element / WriteVP9Element and the probability sections with the element as a template
+// argument, so widths and counts stay compile time constants. vp9_frame_context.h maps the updates with the same
+// counts. The uncompressed header's control flow stays in the converters, its elements are VP9_SYNTAX_ALWAYS, the
+// compressed header sections are picked by IsVP9SyntaxPresent on both sides. PeekFrameInfo (vp9_frame_info.h) reads
+// the uncompressed header with the same widths
+
+namespace VP9Fuzzer {
+
+enum VP9SyntaxCoding {
+  // f(n), read most significant bit first from the uncompressed header
+  VP9_SYNTAX_RAW,
+  // L(n), bool-coded bits with probability 128
+  VP9_SYNTAX_LITERAL,
+  // B(p), one bool-coded flag with probability prob
+  VP9_SYNTAX_BOOL,
+  // diff_update_prob(), a B(prob) update flag followed by decode_term_subexp() when set, count times
+  VP9_SYNTAX_DIFF_UPDATE,
+  // update_mv_prob(), a B(prob) update flag followed by mv_prob when set, count times
+  VP9_SYNTAX_MV_UPDATE,
+};
+
+enum VP9SyntaxCondition {
+  VP9_SYNTAX_ALWAYS,
+  VP9_SYNTAX_IF_TX_MODE_SELECT,
+  VP9_SYNTAX_IF_INTER_FRAME,
+  VP9_SYNTAX_IF_SWITCHABLE_INTERP_FILTER,
+  VP9_SYNTAX_IF_COMPOUND_REFERENCE_ALLOWED,
+  VP9_SYNTAX_IF_REFERENCE_SELECT,
+  VP9_SYNTAX_IF_NOT_COMPOUND_REFERENCE,
+  VP9_SYNTAX_IF_NOT_SINGLE_REFERENCE,
+  VP9_SYNTAX_IF_HIGH_PRECISION_MV,
+};
+
+struct VP9SyntaxElement {
+  const char* name;
+  uint32_t bits;
+  VP9SyntaxCoding coding;
+  uint32_t prob;
+  uint32_t count;
+  VP9SyntaxCondition condition;
+};
+
+struct VP9SyntaxState {
+  // What the conditions of the compressed header depend on
+  uint32_t tx_mode;
+  bool frame_is_intra;
+  uint32_t interpolation_filter;
+  bool compound_reference_allowed;
+  // ReferenceMode of vp9_constants.h
+  uint32_t reference_mode;
+  bool allow_high_precision_mv;
+};
+
+// uncompressed_header()
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_MARKER = {"frame_marker", 2, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_PROFILE_LOW_BIT = {"profile_low_bit", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_PROFILE_HIGH_BIT = {"profile_high_bit", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RESERVED_ZERO = {"reserved_zero", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SHOW_EXISTING_FRAME = {"show_existing_frame", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_TO_SHOW_MAP_IDX = {"frame_to_show_map_idx", 3, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_TYPE = {"frame_type", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SHOW_FRAME = {"show_frame", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_ERROR_RESILIENT_MODE = {"error_resilient_mode", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_SYNC_CODE = {"frame_sync_code", 24, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_INTRA_ONLY = {"intra_only", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RESET_FRAME_CONTEXT = {"reset_frame_context", 2, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_REFRESH_FRAME_FLAGS = {"refresh_frame_flags", 8, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_REF_FRAME_IDX = {"ref_frame_idx", 3, VP9_SYNTAX_RAW, 0, 3, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_REF_FRAME_SIGN_BIAS = {"ref_frame_sign_bias", 1, VP9_SYNTAX_RAW, 0, 3, VP9_SYNTAX_ALWAYS};
+// Up to 3 found_ref flags of frame_size_with_refs(), they stop at the first set one
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_SIZE_FOUND_REF = {"frame_size_found_ref", 1, VP9_SYNTAX_RAW, 0, 3, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_ALLOW_HIGH_PRECISION_MV = {"allow_high_precision_mv", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_REFRESH_FRAME_CONTEXT = {"refresh_frame_context", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_PARALLEL_DECODING_MODE = {"frame_parallel_decoding_mode", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_CONTEXT_IDX = {"frame_context_idx", 2, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_HEADER_SIZE_IN_BYTES = {"header_size_in_bytes", 16, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SIGN = {"sign", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// color_config()
+constexpr VP9SyntaxElement VP9_SYNTAX_TEN_OR_TWELVE_BIT = {"ten_or_twelve_bit", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_COLOR_SPACE = {"color_space", 3, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_COLOR_RANGE = {"color_range", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SUBSAMPLING_X = {"subsampling_x", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SUBSAMPLING_Y = {"subsampling_y", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// frame_size() and render_size()
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_WIDTH_MINUS_1 = {"frame_width_minus_1", 16, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FRAME_HEIGHT_MINUS_1 = {"frame_height_minus_1", 16, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RENDER_AND_FRAME_SIZE_DIFFERENT = {"render_and_frame_size_different", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RENDER_WIDTH_MINUS_1 = {"render_width_minus_1", 16, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RENDER_HEIGHT_MINUS_1 = {"render_height_minus_1", 16, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// read_interpolation_filter()
+constexpr VP9SyntaxElement VP9_SYNTAX_IS_FILTER_SWITCHABLE = {"is_filter_switchable", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_RAW_INTERPOLATION_FILTER = {"raw_interpolation_filter", 2, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// loop_filter_params(), the deltas are signed with the sign after the value
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_LEVEL = {"loop_filter_level", 6, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_SHARPNESS = {"loop_filter_sharpness", 3, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_DELTA_ENABLED = {"loop_filter_delta_enabled", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_DELTA_UPDATE = {"loop_filter_delta_update", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_UPDATE_REF_DELTA = {"update_ref_delta", 1, VP9_SYNTAX_RAW, 0, 4, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_REF_DELTAS = {"loop_filter_ref_deltas", 6, VP9_SYNTAX_RAW, 0, 4, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_UPDATE_MODE_DELTA = {"update_mode_delta", 1, VP9_SYNTAX_RAW, 0, 2, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_LOOP_FILTER_MODE_DELTAS = {"loop_filter_mode_deltas", 6, VP9_SYNTAX_RAW, 0, 2, VP9_SYNTAX_ALWAYS};
+
+// quantization_params()
+constexpr VP9SyntaxElement VP9_SYNTAX_BASE_Q_IDX = {"base_q_idx", 8, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_DELTA_CODED = {"delta_coded", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_DELTA_Q = {"delta_q", 4, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// segmentation_params(), the tree probs and then the prediction probs of a temporal update. The width of a
+// feature_value depends on the feature, see segmentation_feature_bits
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_ENABLED = {"segmentation_enabled", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_UPDATE_MAP = {"segmentation_update_map", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_TREE_PROBS = {"prob", 8, VP9_SYNTAX_RAW, 0, 7, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_PRED_PROBS = {"prob", 8, VP9_SYNTAX_RAW, 0, 3, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_PROB_CODED = {"prob_coded", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_TEMPORAL_UPDATE = {"segmentation_temporal_update", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_UPDATE_DATA = {"segmentation_update_data", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SEGMENTATION_ABS_OR_DELTA_UPDATE = {"segmentation_abs_or_delta_update", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FEATURE_ENABLED = {"feature_enabled", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_FEATURE_SIGN = {"feature_sign", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// tile_info()
+constexpr VP9SyntaxElement VP9_SYNTAX_INCREMENT_TILE_COLS_LOG2 = {"increment_tile_cols_log2", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_TILE_ROWS_LOG2 = {"tile_rows_log2", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_INCREMENT_TILE_ROWS_LOG2 = {"increment_tile_rows_log2", 1, VP9_SYNTAX_RAW, 0, 1, VP9_SYNTAX_ALWAYS};
+
+// compressed_header()
+constexpr VP9SyntaxElement VP9_SYNTAX_TX_MODE = {"tx_mode", 2, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_TX_MODE_SELECT = {"tx_mode_select", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_TX_MODE_PROBS = {"tx_mode_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 12, VP9_SYNTAX_IF_TX_MODE_SELECT};
+// Once per transform size up to the largest tx_mode allows
+constexpr VP9SyntaxElement VP9_SYNTAX_UPDATE_PROBS = {"update_probs", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_COEF_PROBS = {"read_coef_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 396, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SKIP_PROB = {"read_skip_prob", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 3, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_INTER_MODE_PROBS = {"read_inter_mode_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 21, VP9_SYNTAX_IF_INTER_FRAME};
+constexpr VP9SyntaxElement VP9_SYNTAX_INTERP_FILTER_PROBS = {"read_interp_filter_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 8, VP9_SYNTAX_IF_SWITCHABLE_INTERP_FILTER};
+constexpr VP9SyntaxElement VP9_SYNTAX_IS_INTER_PROBS = {"read_is_inter_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 4, VP9_SYNTAX_IF_INTER_FRAME};
+constexpr VP9SyntaxElement VP9_SYNTAX_NON_SINGLE_REFERENCE = {"non_single_reference", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_IF_COMPOUND_REFERENCE_ALLOWED};
+constexpr VP9SyntaxElement VP9_SYNTAX_REFERENCE_SELECT = {"reference_select", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_IF_COMPOUND_REFERENCE_ALLOWED};
+// frame_reference_mode_probs(), the loop indexes of the three groups follow each other
+constexpr VP9SyntaxElement VP9_SYNTAX_COMP_MODE_PROB = {"comp_mode_prob", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 5, VP9_SYNTAX_IF_REFERENCE_SELECT};
+constexpr VP9SyntaxElement VP9_SYNTAX_SINGLE_REF_PROB = {"single_ref_prob", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 10, VP9_SYNTAX_IF_NOT_COMPOUND_REFERENCE};
+constexpr VP9SyntaxElement VP9_SYNTAX_COMP_REF_PROB = {"comp_ref_prob", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 5, VP9_SYNTAX_IF_NOT_SINGLE_REFERENCE};
+constexpr VP9SyntaxElement VP9_SYNTAX_Y_MODE_PROBS = {"read_y_mode_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 36, VP9_SYNTAX_IF_INTER_FRAME};
+constexpr VP9SyntaxElement VP9_SYNTAX_PARTITION_PROBS = {"read_partition_probs", 1, VP9_SYNTAX_DIFF_UPDATE, 252, 48, VP9_SYNTAX_IF_INTER_FRAME};
+// mv_probs(), joints, sign, classes, class0_bit and bits, then class0_fr and fr, then the high precision ones
+constexpr VP9SyntaxElement VP9_SYNTAX_MV_PROBS = {"mv_probs", 1, VP9_SYNTAX_MV_UPDATE, 252, 65, VP9_SYNTAX_IF_INTER_FRAME};
+constexpr VP9SyntaxElement VP9_SYNTAX_MV_HP_PROBS = {"mv_probs", 1, VP9_SYNTAX_MV_UPDATE, 252, 4, VP9_SYNTAX_IF_HIGH_PRECISION_MV};
+constexpr VP9SyntaxElement VP9_SYNTAX_MV_PROB = {"mv_prob", 7, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+
+// decode_term_subexp()
+constexpr VP9SyntaxElement VP9_SYNTAX_BIT_1 = {"bit_1", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SUB_EXP_VAL = {"sub_exp_val", 4, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_BIT_2 = {"bit_2", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SUB_EXP_VAL_MINUS_16 = {"sub_exp_val_minus_16", 4, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_BIT_3 = {"bit_3", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_SUB_EXP_VAL_MINUS_32 = {"sub_exp_val_minus_32", 5, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_V = {"v", 7, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+constexpr VP9SyntaxElement VP9_SYNTAX_BIT_4 = {"bit_4", 1, VP9_SYNTAX_LITERAL, 128, 1, VP9_SYNTAX_ALWAYS};
+
+inline bool IsVP9SyntaxPresent(VP9SyntaxCondition condition, const VP9SyntaxState& state) {
+  switch (condition) {
+    case VP9_SYNTAX_ALWAYS:
+      return true;
+    case VP9_SYNTAX_IF_TX_MODE_SELECT:
+      // TX_MODE_SELECT, tx_mode 4 of the spec
+      return state.tx_mode == 4;
+    case VP9_SYNTAX_IF_INTER_FRAME:
+      return !state.frame_is_intra;
+    case VP9_SYNTAX_IF_SWITCHABLE_INTERP_FILTER:
+      // SWITCHABLE, interp_filter 4 of the spec
+      return !state.frame_is_intra && state.interpolation_filter == 4;
+    case VP9_SYNTAX_IF_COMPOUND_REFERENCE_ALLOWED:
+      return !state.frame_is_intra && state.compound_reference_allowed;
+    case VP9_SYNTAX_IF_REFERENCE_SELECT:
+      return !state.frame_is_intra && state.reference_mode == 2; // REFERENCE_MODE_SELECT
+    case VP9_SYNTAX_IF_NOT_COMPOUND_REFERENCE:
+      return !state.frame_is_intra && state.reference_mode != 1; // COMPOUND_REFERENCE
+    case VP9_SYNTAX_IF_NOT_SINGLE_REFERENCE:
+      return !state.frame_is_intra && state.reference_mode != 0; // SINGLE_REFERENCE
+    case VP9_SYNTAX_IF_HIGH_PRECISION_MV:
+      return !state.frame_is_intra && state.allow_high_precision_mv;
+  }
+  return false;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_SYNTAX_H_
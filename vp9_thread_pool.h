@@ -0,0 +1,105 @@
+#ifndef VP9_THREAD_POOL_H_
+#define VP9_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small persistent thread pool for independent per-tile work inside a frame
+// RunVP9ThreadPool calls job(i) for every i below count across the workers and the calling thread,
+// and returns once all of them are done. Jobs write their result to slot i, so results keep the original order.
+
+namespace VP9Fuzzer {
+
+struct VP9ThreadPool;
+inline void StopVP9ThreadPool(VP9ThreadPool* pool);
+
+struct VP9ThreadPool {
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  const std::function<void(uint32_t)>* job = nullptr;
+  uint32_t job_count = 0;
+  uint32_t next_index = 0;
+  uint32_t running = 0;
+  bool stopping = false;
+
+  // Joins the workers, a pool can be a global that is still running at exit
+  ~VP9ThreadPool() { StopVP9ThreadPool(this); }
+};
+
+inline bool TakeVP9ThreadPoolJob(VP9ThreadPool* pool, std::unique_lock<std::mutex>* lock) {
+  // Runs one job index with the lock released, false when there is none left
+  if (pool->job == nullptr || pool->next_index >= pool->job_count) {
+    return false;
+  }
+  uint32_t index = pool->next_index++;
+  const std::function<void(uint32_t)>* job = pool->job;
+  pool->running++;
+  lock->unlock();
+  (*job)(index);
+  lock->lock();
+  if (--pool->running == 0 && pool->next_index >= pool->job_count) {
+    pool->work_done.notify_all();
+  }
+  return true;
+}
+
+inline void RunVP9ThreadPoolWorker(VP9ThreadPool* pool) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  while (true) {
+    pool->work_ready.wait(lock, [pool] {
+      return pool->stopping || (pool->job != nullptr && pool->next_index < pool->job_count);
+    });
+    if (pool->stopping) {
+      return;
+    }
+    TakeVP9ThreadPoolJob(pool, &lock);
+  }
+}
+
+inline void StartVP9ThreadPool(VP9ThreadPool* pool, uint32_t threads) {
+  // threads includes the calling thread, so 1 starts no workers
+  for (uint32_t i = 1; i < threads; i++) {
+    pool->workers.emplace_back(RunVP9ThreadPoolWorker, pool);
+  }
+}
+
+inline void StopVP9ThreadPool(VP9ThreadPool* pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stopping = true;
+  }
+  pool->work_ready.notify_all();
+  for (std::thread& worker : pool->workers) {
+    worker.join();
+  }
+  pool->workers.clear();
+}
+
+inline void RunVP9ThreadPool(VP9ThreadPool* pool, uint32_t count, const std::function<void(uint32_t)>& job) {
+  if (pool->workers.empty() || count <= 1) {
+    for (uint32_t i = 0; i < count; i++) {
+      job(i);
+    }
+    return;
+  }
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->job = &job;
+  pool->job_count = count;
+  pool->next_index = 0;
+  pool->work_ready.notify_all();
+  while (TakeVP9ThreadPoolJob(pool, &lock)) {
+  }
+  pool->work_done.wait(lock, [pool] { return pool->running == 0; });
+  pool->job = nullptr;
+  pool->job_count = 0;
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_THREAD_POOL_H_
@@ -0,0 +1,70 @@
+#ifndef VP9_TILE_LAYOUT_H_
+#define VP9_TILE_LAYOUT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Tile grid of a frame from its size in 8x8 mode info units and the tile_cols_log2/tile_rows_log2 it codes
+// (get_tile_offset in the spec). Shared by both converters so they agree on the tile count and which tile is last.
+
+namespace VP9Fuzzer {
+
+struct VP9TileBounds {
+  uint32_t mi_row_start;
+  uint32_t mi_row_end;
+  uint32_t mi_col_start;
+  uint32_t mi_col_end;
+};
+
+struct VP9TileLayout {
+  // Frame size and tiling the tiles were built for, a layout with no tiles isn't built yet
+  uint32_t mi_cols = 0;
+  uint32_t mi_rows = 0;
+  uint32_t tile_cols_log2 = 0;
+  uint32_t tile_rows_log2 = 0;
+  uint32_t tile_cols = 0;
+  uint32_t tile_rows = 0;
+  // In coding order, row by row. Every tile but the last is preceded by its 32 bit size
+  std::vector<VP9TileBounds> tiles;
+};
+
+inline uint32_t GetVP9TileOffset(uint32_t tile_num, uint32_t mis, uint32_t tile_size_log2) {
+  uint32_t sbs = (mis + 7) >> 3;
+  uint32_t offset = ((tile_num * sbs) >> tile_size_log2) << 3;
+  return std::min(offset, mis);
+}
+
+inline void BuildVP9TileLayout(uint32_t mi_cols, uint32_t mi_rows, uint32_t tile_cols_log2, uint32_t tile_rows_log2,
+                               VP9TileLayout* layout) {
+  layout->mi_cols = mi_cols;
+  layout->mi_rows = mi_rows;
+  layout->tile_cols_log2 = tile_cols_log2;
+  layout->tile_rows_log2 = tile_rows_log2;
+  layout->tile_cols = 1 << tile_cols_log2;
+  layout->tile_rows = 1 << tile_rows_log2;
+  layout->tiles.clear();
+  for (uint32_t tile_row = 0; tile_row < layout->tile_rows; tile_row++) {
+    for (uint32_t tile_col = 0; tile_col < layout->tile_cols; tile_col++) {
+      VP9TileBounds bounds;
+      bounds.mi_row_start = GetVP9TileOffset(tile_row, mi_rows, tile_rows_log2);
+      bounds.mi_row_end = GetVP9TileOffset(tile_row + 1, mi_rows, tile_rows_log2);
+      bounds.mi_col_start = GetVP9TileOffset(tile_col, mi_cols, tile_cols_log2);
+      bounds.mi_col_end = GetVP9TileOffset(tile_col + 1, mi_cols, tile_cols_log2);
+      layout->tiles.push_back(bounds);
+    }
+  }
+}
+
+inline void UpdateVP9TileLayout(uint32_t mi_cols, uint32_t mi_rows, uint32_t tile_cols_log2, uint32_t tile_rows_log2,
+                                VP9TileLayout* layout) {
+  // The owner keeps its layout between frames, it is only built again when the frame size or tiling changes
+  if (layout->tiles.empty() || layout->mi_cols != mi_cols || layout->mi_rows != mi_rows ||
+      layout->tile_cols_log2 != tile_cols_log2 || layout->tile_rows_log2 != tile_rows_log2) {
+    BuildVP9TileLayout(mi_cols, mi_rows, tile_cols_log2, tile_rows_log2, layout);
+  }
+}
+
+} // namespace VP9Fuzzer
+
+#endif // VP9_TILE_LAYOUT_H_
@@ -3,52 +3,178 @@
 #include <fstream>
 #include <vector>
 #include <bitset>
+#include <iostream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "vp9.pb.h"
 #include "vp9_constants.h"
+#include "vp9_compact.h"
+#include "vp9_bool_run.h"
+#include "vp9_bit_reader.h"
+#include "vp9_frame_info.h"
+#include "vp9_index.h"
+#include "vp9_resync.h"
+#include "vp9_provenance.h"
+#include "vp9_tile_layout.h"
+#include "vp9_thread_pool.h"
+#include "vp9_frame_context.h"
+#include "vp9_ref_slots.h"
+#include "vp9_block_context.h"
+#include "vp9_syntax.h"
 
 // Written by Mitchell Zakocs, 2022
 // Experimental code, use at your own risk
 
-std::ifstream file;
-std::vector<bool> bit_buffer;
-uint64_t bit_counter = 0;
-
-UncompressedHeader_FrameType frame_type = (UncompressedHeader_FrameType) 0;
-uint32_t profile = 0;
-bool FrameIsIntra = false;
-bool Lossless = false;
-bool allow_high_precision_mv = false;
-bool compoundReferenceAllowed = false;
-uint32_t reference_mode = 0;
-uint32_t interpolation_filter = 0;
-uint32_t tx_mode = 0;
-uint32_t header_size_in_bytes = 0;
-
-uint32_t FrameWidth = 0;
-uint32_t FrameHeight = 0;
-uint32_t MiCols = 0;
-uint32_t MiRows = 0;
-uint32_t Sb64Cols = 0;
-uint32_t Sb64Rows = 0;
-
-std::string StringBoolBuffer;
-const uint8_t* BoolBuffer = 0;
-const uint8_t* BoolBufferEnd = 0;
-uint64_t BoolValue = 0;
-uint64_t BoolRange = 0;
-int64_t BoolCount = 0;
-
-uint64_t ReadBitUInt(int bits) {
-  uint64_t return_num = 0;
-  uint64_t bound_bits = std::min(bits, 64);
-  for (uint32_t i = 0; i < bound_bits; i++) {
-    return_num = (return_num << 1) + bit_buffer.at(bit_counter++);
-  }
-  return return_num;
-}
-
-std::string ReadBitString(uint32_t bits) {
+// Reader state is per thread so frames can be read on several threads at once (--gop-threads)
+// Every thread opens its own handle on the input
+thread_local std::ifstream file;
+uint64_t file_size = 0;
+// The reader only holds a window of the input, window_offset is the file offset of byte_buffer[0]
+thread_local std::string byte_buffer;
+thread_local uint64_t window_offset = 0;
+thread_local VP9Fuzzer::BitReader bit_reader = {};
+
+thread_local UncompressedHeader_FrameType frame_type = (UncompressedHeader_FrameType) 0;
+thread_local uint32_t profile = 0;
+thread_local bool FrameIsIntra = false;
+thread_local bool Lossless = false;
+thread_local bool allow_high_precision_mv = false;
+thread_local bool compoundReferenceAllowed = false;
+thread_local uint32_t reference_mode = 0;
+thread_local uint32_t interpolation_filter = 0;
+thread_local uint32_t tx_mode = 0;
+thread_local uint32_t header_size_in_bytes = 0;
+
+thread_local uint32_t FrameWidth = 0;
+thread_local uint32_t FrameHeight = 0;
+thread_local uint32_t MiCols = 0;
+thread_local uint32_t MiRows = 0;
+thread_local uint32_t Sb64Cols = 0;
+thread_local uint32_t Sb64Rows = 0;
+thread_local uint32_t TileColsLog2 = 0;
+thread_local uint32_t TileRowsLog2 = 0;
+// Frame formats held by the 8 reference slots, for frames that take their size from a reference
+thread_local VP9Fuzzer::VP9RefSlots ref_slots;
+// Above and left contexts of the block level syntax, and the frame level inputs it is parsed with (--blocks)
+thread_local VP9Fuzzer::VP9TileContext tile_context;
+thread_local VP9Fuzzer::VP9BlockFrameInfo block_frame_info;
+// Saved probability contexts of the frames read so far in this stream, or in this shard
+thread_local VP9Fuzzer::VP9FrameContextStore frame_contexts = VP9Fuzzer::MakeVP9FrameContextStore();
+// Where the reader prints what it parses, a shard reading on another thread logs to a buffer instead
+thread_local std::ostream* reader_log = &std::cout;
+
+// Store only the updating DiffUpdateProbs as SparseDiffUpdateProbs
+bool SparseProbs = false;
+// Also parse the tiles of intra frames into Partition and Block messages
+bool ParseBlocks = false;
+// Tiles of a frame are copied out on these threads once their ranges are known (--threads), only started on the main thread
+thread_local VP9Fuzzer::VP9ThreadPool tile_pool;
+
+thread_local const uint8_t* BoolBufferStart = 0;
+thread_local const uint8_t* BoolBuffer = 0;
+thread_local const uint8_t* BoolBufferEnd = 0;
+thread_local uint64_t BoolValue = 0;
+thread_local uint64_t BoolRange = 0;
+thread_local int64_t BoolCount = 0;
+
+enum VP9ReadStatus {
+  VP9_READ_OK = 0,
+  VP9_READ_TRUNCATED_IVF_HEADER,
+  VP9_READ_TRUNCATED_UNCOMPRESSED_HEADER,
+  VP9_READ_TRUNCATED_COMPRESSED_HEADER,
+  VP9_READ_TRUNCATED_TILES,
+};
+
+struct VP9ReadResult {
+  VP9ReadStatus status = VP9_READ_OK;
+  uint64_t bit_offset = 0; // where the data ran out, from the start of the file
+};
+
+// First truncation hit while reading, everything parsed up to it is kept in the proto
+thread_local VP9ReadResult read_result;
+
+void SetVP9ReadError(VP9ReadStatus status, uint64_t bit_offset) {
+  if (read_result.status == VP9_READ_OK) {
+    read_result.status = status;
+    read_result.bit_offset = window_offset * 8 + bit_offset;
+  }
+}
+
+bool LoadVP9Window(uint64_t offset, uint64_t size) {
+  // Replaces the window with the bytes of the file at [offset, offset + size), cut short at the end of the file
+  // Memory stays at the size of the largest window (one frame) however large the file is
+  size = offset < file_size ? std::min(size, file_size - offset) : 0;
+  byte_buffer.resize(size);
+  file.clear();
+  file.seekg(offset);
+  file.read(&byte_buffer[0], size);
+  byte_buffer.resize(file.gcount());
+  window_offset = offset;
+  bit_reader = VP9Fuzzer::MakeBitReader((const uint8_t*) byte_buffer.data(), byte_buffer.size());
+  return byte_buffer.size() == size;
+}
+
+// Where every syntax element came from, only recorded with --provenance
+VP9Fuzzer::VP9Provenance* provenance = nullptr;
+// Field path of the message being read
+thread_local std::string provenance_scope;
+// File bit offset of the compressed header the bool decoder is reading
+thread_local uint64_t BoolStartBit = 0;
+
+struct VP9ProvenanceScope {
+  // Appends a message field to provenance_scope for the reads inside this C++ scope, [index] for repeated ones
+  size_t parent_size;
+  VP9ProvenanceScope(const char* field, int64_t index = -1) : parent_size(provenance_scope.size()) {
+    if (provenance == nullptr) {
+      return;
+    }
+    if (!provenance_scope.empty()) {
+      provenance_scope += ".";
+    }
+    provenance_scope += field;
+    if (index >= 0) {
+      provenance_scope += "[" + std::to_string(index) + "]";
+    }
+  }
+  ~VP9ProvenanceScope() {
+    provenance_scope.resize(parent_size);
+  }
+};
+
+void RecordVP9Provenance(const char* field, uint64_t start_bit, uint64_t length_in_bits, bool bool_coded, uint8_t prob,
+                         uint32_t index = VP9_PROVENANCE_NO_INDEX, uint32_t elements = 1) {
+  std::string path = provenance_scope.empty() ? field : provenance_scope + "." + field;
+  VP9Fuzzer::VP9ProvenanceEntry entry = {};
+  entry.path = VP9Fuzzer::InternVP9ProvenancePath(provenance, path);
+  entry.index = index;
+  entry.elements = elements;
+  entry.bool_coded = bool_coded;
+  entry.prob = prob;
+  entry.start_bit = start_bit;
+  entry.length_in_bits = length_in_bits;
+  provenance->entries.push_back(entry);
+}
+
+uint64_t ReadBitUInt(int bits, const char* field = nullptr, uint32_t index = VP9_PROVENANCE_NO_INDEX) {
+  // Bits past the end read as zeros, callers check BitReaderOverrun once per header instead of per read
+  uint64_t start_bit = bit_reader.bit_counter;
+  uint64_t value = VP9Fuzzer::ReadBits(&bit_reader, std::min(bits, 64));
+  if (provenance != nullptr && field != nullptr) {
+    RecordVP9Provenance(field, window_offset * 8 + start_bit, bits, false, 0, index);
+  }
+  return value;
+}
+
+std::string ReadBitString(uint32_t bits, const char* field = nullptr) {
+  uint64_t start_bit = bit_reader.bit_counter;
+  if (provenance != nullptr && field != nullptr) {
+    RecordVP9Provenance(field, window_offset * 8 + start_bit, bits, false, 0);
+  }
   std::string return_string;
   uint64_t bits_written = 0;
   while (true) {
@@ -66,7 +192,7 @@ std::string ReadBitString(uint32_t bits) {
   return return_string;
 }
 
-uint32_t BoolReaderFill() {
+void BoolReaderFill() {
   // stolen from bitreader.c in libvpx
   const uint8_t *const buffer_end = BoolBufferEnd;
   const uint8_t *buffer = BoolBuffer;
@@ -146,16 +272,46 @@ int64_t ReadBool(int64_t p) {
   return bit;
 }
 
-void InitBool(uint32_t sz) {
-  StringBoolBuffer = std::string(sz, 0);
+uint32_t ReadBoolZeroRun(int64_t p, uint32_t max_run) {
+  // Reads zero bools at probability p until the next bool is a one (left unread) or max_run is reached
+  // Bit-exact with ReadBool, a run of 2^level zeros is taken in one step when the value stays below
+  // the range the run ends with, since every zero in between keeps it inside a larger range
+  const VP9Fuzzer::BoolRunTable* table = VP9Fuzzer::GetBoolRunTable(p);
+  uint32_t run = 0;
+  while (run < max_run) {
+    if (BoolCount < 0) BoolReaderFill();
+
+    bool skipped = false;
+    for (uint32_t level = BOOL_RUN_LEVELS; level --> 0;) {
+      if ((1u << level) > max_run - run) continue;
+      // Only take runs that are fully inside the buffered bits
+      int64_t shift = table->shift[level][BoolRange];
+      if (shift > BoolCount || shift > BD_VALUE_SIZE - CHAR_BIT) continue;
+      BD_VALUE end_range = (BD_VALUE) table->range[level][BoolRange] << (BD_VALUE_SIZE - CHAR_BIT - shift);
+      if (BoolValue >= end_range) continue;
+
+      BoolValue <<= shift;
+      BoolCount -= shift;
+      BoolRange = table->range[level][BoolRange];
+      run += 1u << level;
+      skipped = true;
+    }
 
-  // Fill bool buffer
-  for (uint32_t i = 0; i < sz; i++) {
-    StringBoolBuffer[i] = (const uint8_t) ReadBitUInt(8);
+    if (!skipped) {
+      // Either the next bool is a one or the buffered bits ran out, check it the slow way
+      unsigned int split = (BoolRange * p + (256 - p)) >> CHAR_BIT;
+      if (BoolValue >= (BD_VALUE) split << (BD_VALUE_SIZE - CHAR_BIT)) break;
+      ReadBool(p);
+      run++;
+    }
   }
+  return run;
+}
 
-  // initialize the rest of the bool reader
-  BoolBuffer = (const uint8_t*) StringBoolBuffer.c_str();
+void InitBool(const uint8_t* data, uint32_t sz) {
+  // Decodes straight out of data, which has to outlive the bool reader
+  BoolBufferStart = data;
+  BoolBuffer = data;
   BoolBufferEnd = BoolBuffer + sz;
   BoolValue = 0;
   BoolRange = 255;
@@ -165,46 +321,92 @@ void InitBool(uint32_t sz) {
   ReadBool(128);
 }
 
-void ExitBool() {
-  std::cout << "Bytes Left: " << std::hex << (BoolBufferEnd - BoolBuffer) << std::dec << std::endl;
+bool ExitBool() {
+  // False when the bool decoder needed bits past the end of its buffer (vpx_reader_has_error in libvpx)
+  *reader_log << "Bytes Left: " << std::hex << (BoolBufferEnd - BoolBuffer) << std::dec << std::endl;
   // uint32_t padding_value = ReadBitUInt(BoolMaxBits);
+  return !(BoolCount > BD_VALUE_SIZE && BoolCount < LOTS_OF_BITS);
+}
+
+uint64_t BoolPosition() {
+  // Bits the bool decoder has shifted out since InitBool, the value holds BoolCount + 8 bits not shifted out yet
+  int64_t count = BoolCount >= LOTS_OF_BITS / 2 ? BoolCount - LOTS_OF_BITS : BoolCount;
+  return (BoolBuffer - BoolBufferStart) * CHAR_BIT - (count + CHAR_BIT);
+}
+
+void RecordVP9BoolProvenance(const char* field, uint64_t start_position, uint8_t prob,
+                             uint32_t index = VP9_PROVENANCE_NO_INDEX, uint32_t elements = 1) {
+  // Records the bool-coded element read since start_position
+  RecordVP9Provenance(field, BoolStartBit + start_position, BoolPosition() - start_position, true, prob, index, elements);
+}
+
+int64_t ReadBoolElement(int64_t p, const char* field, uint32_t index = VP9_PROVENANCE_NO_INDEX) {
+  // ReadBool for a whole syntax element, recorded in the provenance table
+  if (provenance == nullptr) {
+    return ReadBool(p);
+  }
+  uint64_t start_position = BoolPosition();
+  int64_t bit = ReadBool(p);
+  RecordVP9BoolProvenance(field, start_position, p, index);
+  return bit;
 }
 
-int64_t ReadLiteral(int32_t bits) {
+int64_t ReadLiteral(int32_t bits, const char* field = nullptr) {
   int64_t literal = 0, bit;
+  uint64_t start_position = provenance != nullptr ? BoolPosition() : 0;
 
   for (bit = bits - 1; bit >= 0; bit--) literal |= ReadBool(128) << bit;
 
+  if (provenance != nullptr && field != nullptr) {
+    RecordVP9BoolProvenance(field, start_position, 128);
+  }
   return literal;
 }
 
-VP9SignedInteger* ReadVP9SignedInteger(uint32_t number_bits) {
+template <const VP9Fuzzer::VP9SyntaxElement& Element>
+int64_t ReadVP9Element(uint32_t index = VP9_PROVENANCE_NO_INDEX) {
+  // Reads one element of vp9_syntax.h with its coding and width, recorded under its name
+  static_assert(Element.coding == VP9Fuzzer::VP9_SYNTAX_RAW || Element.coding == VP9Fuzzer::VP9_SYNTAX_LITERAL ||
+                Element.coding == VP9Fuzzer::VP9_SYNTAX_BOOL, "probability updates are read by their section");
+  if (Element.coding == VP9Fuzzer::VP9_SYNTAX_RAW) {
+    return ReadBitUInt(Element.bits, Element.name, index);
+  }
+  if (Element.coding == VP9Fuzzer::VP9_SYNTAX_LITERAL) {
+    return ReadLiteral(Element.bits, Element.name);
+  }
+  return ReadBoolElement(Element.prob, Element.name, index);
+}
+
+template <const VP9Fuzzer::VP9SyntaxElement& Element>
+VP9SignedInteger* ReadVP9SignedInteger() {
   auto signed_int = new VP9SignedInteger();
+  VP9ProvenanceScope scope(Element.name);
 
-  signed_int->set_value(ReadBitString(number_bits));
-  signed_int->set_sign((VP9BitField) ReadBitUInt(1));
+  signed_int->set_value(ReadBitString(Element.bits, "value"));
+  signed_int->set_sign((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SIGN>());
 
   return signed_int;
 }
 
 UncompressedHeader_ColorConfig* ReadVP9ColorConfig() {
   auto color_config = new UncompressedHeader_ColorConfig();
+  VP9ProvenanceScope scope("color_config");
   if (profile >= 2) {
-    color_config->set_ten_or_twelve_bit((VP9BitField) ReadBitUInt(1));
+    color_config->set_ten_or_twelve_bit((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_TEN_OR_TWELVE_BIT>());
   }
-  uint32_t color_space = ReadBitUInt(3);
+  uint32_t color_space = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_COLOR_SPACE>();
   color_config->set_color_space(color_space);
   if (color_space != UncompressedHeader_ColorConfig::CS_RGB) {
-    color_config->set_color_range((VP9BitField) ReadBitUInt(1));
+    color_config->set_color_range((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_COLOR_RANGE>());
     if (profile == 1 || profile == 3) {
-      color_config->set_subsampling_x((VP9BitField) ReadBitUInt(1));
-      color_config->set_subsampling_y((VP9BitField) ReadBitUInt(1));
-      color_config->set_reserved_zero((VP9BitField) ReadBitUInt(1));
+      color_config->set_subsampling_x((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SUBSAMPLING_X>());
+      color_config->set_subsampling_y((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SUBSAMPLING_Y>());
+      color_config->set_reserved_zero((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>());
     }
   }
   else {
     if (profile == 1 || profile == 3) {
-      color_config->set_reserved_zero((VP9BitField) ReadBitUInt(1));
+      color_config->set_reserved_zero((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>());
     }
   }
   return color_config;
@@ -220,9 +422,10 @@ void ComputeImageSize() {
 
 UncompressedHeader_FrameSize* ReadVP9FrameSize() {
   auto frame_size = new UncompressedHeader_FrameSize();
+  VP9ProvenanceScope scope("frame_size");
 
-  uint32_t frame_width_minus_1 = ReadBitUInt(16);
-  uint32_t frame_height_minus_1 = ReadBitUInt(16);
+  uint32_t frame_width_minus_1 = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_WIDTH_MINUS_1>();
+  uint32_t frame_height_minus_1 = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_HEIGHT_MINUS_1>();
 
   frame_size->set_frame_width_minus_1(frame_width_minus_1);
   frame_size->set_frame_height_minus_1(frame_height_minus_1);
@@ -237,49 +440,53 @@ UncompressedHeader_FrameSize* ReadVP9FrameSize() {
 
 UncompressedHeader_RenderSize* ReadVP9RenderSize() {
   auto render_size = new UncompressedHeader_RenderSize();
+  VP9ProvenanceScope scope("render_size");
 
-  VP9BitField render_and_frame_size_different = (VP9BitField) ReadBitUInt(1);
+  VP9BitField render_and_frame_size_different = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_AND_FRAME_SIZE_DIFFERENT>();
   render_size->set_render_and_frame_size_different(render_and_frame_size_different);
   if (render_and_frame_size_different == 1) {
-    render_size->set_render_width_minus_1(ReadBitUInt(16));
-    render_size->set_render_height_minus_1(ReadBitUInt(16));
+    render_size->set_render_width_minus_1(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_WIDTH_MINUS_1>());
+    render_size->set_render_height_minus_1(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RENDER_HEIGHT_MINUS_1>());
   }
   return render_size;
 }
 
 UncompressedHeader_LoopFilterParams* ReadVP9LoopFilterParams() {
   auto loop_filter_params = new UncompressedHeader_LoopFilterParams();
+  VP9ProvenanceScope scope("loop_filter_params");
 
-  loop_filter_params->set_loop_filter_level(ReadBitUInt(6));
-  loop_filter_params->set_loop_filter_sharpness(ReadBitUInt(3));
+  loop_filter_params->set_loop_filter_level(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_LEVEL>());
+  loop_filter_params->set_loop_filter_sharpness(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_SHARPNESS>());
 
-  VP9BitField loop_filter_delta_enabled = (VP9BitField) ReadBitUInt(1);
+  VP9BitField loop_filter_delta_enabled = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_DELTA_ENABLED>();
   loop_filter_params->set_loop_filter_delta_enabled(loop_filter_delta_enabled);
 
-  std::cout << "Loop Filter Delta Enabled: " << loop_filter_delta_enabled << std::endl;
+  *reader_log << "Loop Filter Delta Enabled: " << loop_filter_delta_enabled << std::endl;
 
   if (loop_filter_delta_enabled == 1) {
-    VP9BitField loop_filter_delta_update = (VP9BitField) ReadBitUInt(1);
+    VP9BitField loop_filter_delta_update = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_DELTA_UPDATE>();
     loop_filter_params->set_loop_filter_delta_update(loop_filter_delta_update);
 
-    std::cout << "Loop Filter Delta Update: " << loop_filter_delta_update << std::endl;
+    *reader_log << "Loop Filter Delta Update: " << loop_filter_delta_update << std::endl;
 
     if (loop_filter_delta_update == 1) {
       for (int i = 0; i < 4; i++) {
         loop_filter_params->add_ref_delta();
-        bool update_ref_delta = ReadBitUInt(1);
+        VP9ProvenanceScope ref_delta_scope("ref_delta", i);
+        bool update_ref_delta = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_REF_DELTA>();
         loop_filter_params->mutable_ref_delta(i)->set_update_ref_delta((VP9BitField) update_ref_delta);
         if (update_ref_delta == 1) {
-          loop_filter_params->mutable_ref_delta(i)->set_allocated_loop_filter_ref_deltas(ReadVP9SignedInteger(6));
+          loop_filter_params->mutable_ref_delta(i)->set_allocated_loop_filter_ref_deltas(ReadVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_REF_DELTAS>());
         }
-        std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
+        *reader_log << "Bits Read: " << bit_reader.bit_counter << " / " << bit_reader.size_in_bits << std::endl;
       }
       for (int i = 0; i < 2; i++) {
         loop_filter_params->add_mode_delta();
-        bool update_mode_delta = ReadBitUInt(1);
+        VP9ProvenanceScope mode_delta_scope("mode_delta", i);
+        bool update_mode_delta = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_MODE_DELTA>();
         loop_filter_params->mutable_mode_delta(i)->set_update_mode_delta((VP9BitField) update_mode_delta);
         if (update_mode_delta == 1) {
-          loop_filter_params->mutable_mode_delta(i)->set_allocated_loop_filter_mode_deltas(ReadVP9SignedInteger(6));
+          loop_filter_params->mutable_mode_delta(i)->set_allocated_loop_filter_mode_deltas(ReadVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_LOOP_FILTER_MODE_DELTAS>());
         }
       }
     }
@@ -288,25 +495,27 @@ UncompressedHeader_LoopFilterParams* ReadVP9LoopFilterParams() {
   return loop_filter_params;
 }
 
-UncompressedHeader_QuantizationParams_ReadDeltaQ* ReadVP9ReadDeltaQ() {
+UncompressedHeader_QuantizationParams_ReadDeltaQ* ReadVP9ReadDeltaQ(const char* field) {
   auto read_delta_q = new UncompressedHeader_QuantizationParams_ReadDeltaQ();
+  VP9ProvenanceScope scope(field);
 
-  VP9BitField delta_coded = (VP9BitField) ReadBitUInt(1);
+  VP9BitField delta_coded = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_DELTA_CODED>();
   read_delta_q->set_delta_coded(delta_coded);
-  std::cout << "Delta Coded: " << delta_coded << std::endl;
+  *reader_log << "Delta Coded: " << delta_coded << std::endl;
   if (delta_coded) {
-    read_delta_q->set_allocated_delta_q(ReadVP9SignedInteger(4));
+    read_delta_q->set_allocated_delta_q(ReadVP9SignedInteger<VP9Fuzzer::VP9_SYNTAX_DELTA_Q>());
   }
   return read_delta_q;
 }
 
 UncompressedHeader_QuantizationParams* ReadVP9QuantizationParams() {
   auto quantization_params = new UncompressedHeader_QuantizationParams();
+  VP9ProvenanceScope scope("quantization_params");
 
-  uint32_t base_q_idx = ReadBitUInt(8);
-  auto delta_q_y_dc = ReadVP9ReadDeltaQ();
-  auto delta_q_uv_dc = ReadVP9ReadDeltaQ();
-  auto delta_q_uv_ac = ReadVP9ReadDeltaQ();
+  uint32_t base_q_idx = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_BASE_Q_IDX>();
+  auto delta_q_y_dc = ReadVP9ReadDeltaQ("delta_q_y_dc");
+  auto delta_q_uv_dc = ReadVP9ReadDeltaQ("delta_q_uv_dc");
+  auto delta_q_uv_ac = ReadVP9ReadDeltaQ("delta_q_uv_ac");
 
   quantization_params->set_base_q_idx(base_q_idx);
   quantization_params->set_allocated_delta_q_y_dc(delta_q_y_dc);
@@ -323,62 +532,66 @@ UncompressedHeader_QuantizationParams* ReadVP9QuantizationParams() {
 
 UncompressedHeader_SegmentationParams* ReadVP9SegmentationParams() {
   auto segmentation_params = new UncompressedHeader_SegmentationParams();
+  VP9ProvenanceScope scope("segmentation_params");
 
-  VP9BitField segmentation_enabled = (VP9BitField) ReadBitUInt(1);
-  std::cout << "Segmentation Enabled: " << segmentation_enabled << std::endl;
+  VP9BitField segmentation_enabled = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_ENABLED>();
+  *reader_log << "Segmentation Enabled: " << segmentation_enabled << std::endl;
   segmentation_params->set_segmentation_enabled(segmentation_enabled);
 
   if (segmentation_enabled == 1) {
-    VP9BitField segmentation_update_map = (VP9BitField) ReadBitUInt(1);
+    VP9BitField segmentation_update_map = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_UPDATE_MAP>();
     segmentation_params->set_segmentation_update_map(segmentation_update_map);
 
     if (segmentation_update_map == 1) {
       // Read probabilities
       uint32_t probs_read = 0;
-      for (int i = 0; i < 7; i++) {
+      for (uint32_t i = 0; i < VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TREE_PROBS.count; i++) {
         segmentation_params->add_prob();
+        VP9ProvenanceScope prob_scope("prob", probs_read);
         auto prob = segmentation_params->mutable_prob(probs_read++);
 
-        bool prob_coded = ReadBitUInt(1);
+        bool prob_coded = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_PROB_CODED>();
         prob->set_prob_coded((VP9BitField) prob_coded);
         if (prob_coded) {
-          prob->set_prob(ReadBitUInt(8));
+          prob->set_prob(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TREE_PROBS>());
         }
       }
-      bool segmentation_temporal_update = ReadBitUInt(1);
+      bool segmentation_temporal_update = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_TEMPORAL_UPDATE>();
       segmentation_params->set_segmentation_temporal_update((VP9BitField) segmentation_temporal_update);
-      if (segmentation_temporal_update) {
+      for (uint32_t i = 0; segmentation_temporal_update && i < VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_PRED_PROBS.count; i++) {
         segmentation_params->add_prob();
+        VP9ProvenanceScope prob_scope("prob", probs_read);
         auto prob = segmentation_params->mutable_prob(probs_read++);
 
-        bool prob_coded = ReadBitUInt(1);
+        bool prob_coded = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_PROB_CODED>();
         prob->set_prob_coded((VP9BitField) prob_coded);
         if (prob_coded) {
-          prob->set_prob(ReadBitUInt(8));
+          prob->set_prob(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_PRED_PROBS>());
         }
       }
     }
 
-    VP9BitField segmentation_update_data = (VP9BitField) ReadBitUInt(1);
+    VP9BitField segmentation_update_data = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_UPDATE_DATA>();
     segmentation_params->set_segmentation_update_data(segmentation_update_data);
 
     // Read segmentation features
     uint32_t feature_index = 0;
     if (segmentation_update_data == 1) {
-      segmentation_params->set_segmentation_abs_or_delta_update((VP9BitField) ReadBitUInt(1));
+      segmentation_params->set_segmentation_abs_or_delta_update((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SEGMENTATION_ABS_OR_DELTA_UPDATE>());
       for (int i = 0; i < 8; i++) {
         for (int j = 0; j < SEG_LVL_MAX; j++) {
           segmentation_params->add_features();
+          VP9ProvenanceScope feature_scope("features", feature_index);
 
           auto feature = segmentation_params->mutable_features(feature_index++);
 
-          VP9BitField feature_enabled = (VP9BitField) ReadBitUInt(1);
+          VP9BitField feature_enabled = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FEATURE_ENABLED>();
           feature->set_feature_enabled(feature_enabled);
 
           if (feature_enabled == 1) {
-            feature->set_feature_value(ReadBitString(VP9Fuzzer::segmentation_feature_bits[j]));
+            feature->set_feature_value(ReadBitString(VP9Fuzzer::segmentation_feature_bits[j], "feature_value"));
             if (VP9Fuzzer::segmentation_feature_signed[j] == 1) {
-              feature->set_feature_sign((VP9BitField) ReadBitUInt(1));
+              feature->set_feature_sign((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FEATURE_SIGN>());
             }
           }
         }
@@ -405,13 +618,14 @@ uint32_t CalcMaxLog2TileCols() {
 }
 
 UncompressedHeader_TileInfo* ReadVP9TileInfo() {
-  // TODO: Revise this, although a full ref tracking system would be needed to make 100% accurate
+  // Sb64Cols is the resolved frame size, frames with frame_size_found_ref get it from ref_slots
   auto tile_info = new UncompressedHeader_TileInfo();
+  VP9ProvenanceScope scope("tile_info");
   uint32_t minLog2TileCols = CalcMinLog2TileCols();  
   uint32_t maxLog2TileCols = CalcMaxLog2TileCols();
   uint32_t tile_cols_log2 = minLog2TileCols;
   while (tile_cols_log2 < maxLog2TileCols) {
-    VP9BitField increment_tile_cols_log2 = (VP9BitField) ReadBitUInt(1);
+    VP9BitField increment_tile_cols_log2 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_INCREMENT_TILE_COLS_LOG2>(tile_info->increment_tile_cols_log2_size());
     tile_info->add_increment_tile_cols_log2(increment_tile_cols_log2);
     if (increment_tile_cols_log2 == 1) {
       ++tile_cols_log2;
@@ -419,27 +633,32 @@ UncompressedHeader_TileInfo* ReadVP9TileInfo() {
     else break;
   } 
   // Read tile_rows_log2
-  VP9BitField tile_rows_log2 = (VP9BitField) ReadBitUInt(1);
+  VP9BitField tile_rows_log2 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_TILE_ROWS_LOG2>();
   tile_info->set_tile_rows_log2(tile_rows_log2);
   // Read increment bit if tile_rows_log2 is set
+  VP9BitField increment_tile_rows_log2 = (VP9BitField) 0;
   if (tile_rows_log2 == 1) {
-    VP9BitField increment_tile_rows_log2 = (VP9BitField) ReadBitUInt(1);
+    increment_tile_rows_log2 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_INCREMENT_TILE_ROWS_LOG2>();
     tile_info->set_increment_tile_rows_log2(increment_tile_rows_log2);
   }
+  TileColsLog2 = tile_cols_log2;
+  TileRowsLog2 = tile_rows_log2 + increment_tile_rows_log2;
   return tile_info;
 }
 
 UncompressedHeader_ReadInterpolationFilter* ReadVP9ReadInterpolationFilter() {
   auto read_interpolation_filter = new UncompressedHeader_ReadInterpolationFilter();
+  VP9ProvenanceScope scope("read_interpolation_filter");
 
-  VP9BitField is_filter_switchable = (VP9BitField) ReadBitUInt(1);
+  VP9BitField is_filter_switchable = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_IS_FILTER_SWITCHABLE>();
   read_interpolation_filter->set_is_filter_switchable(is_filter_switchable);
 
   if (is_filter_switchable == 1) {
     interpolation_filter = UncompressedHeader_InterpolationFilter_SWITCHABLE;
   }
   else {
-    read_interpolation_filter->set_raw_interpolation_filter((UncompressedHeader_InterpolationFilter) ReadBitUInt(2));
+    interpolation_filter = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RAW_INTERPOLATION_FILTER>();
+    read_interpolation_filter->set_raw_interpolation_filter((UncompressedHeader_InterpolationFilter) interpolation_filter);
   }
 
   return read_interpolation_filter;
@@ -447,44 +666,50 @@ UncompressedHeader_ReadInterpolationFilter* ReadVP9ReadInterpolationFilter() {
 
 UncompressedHeader* ReadVP9UncompressedHeader() {
   auto uncompressed_header = new UncompressedHeader();
+  VP9ProvenanceScope scope("uncompressed_header");
 
   // Read marker
-  ReadBitUInt(2);
+  ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_MARKER>();
 
-  uint32_t profile_low_bit = ReadBitUInt(1);
-  uint32_t profile_high_bit = ReadBitUInt(1);
+  uint32_t profile_low_bit = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_PROFILE_LOW_BIT>();
+  uint32_t profile_high_bit = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_PROFILE_HIGH_BIT>();
   profile = (profile_high_bit << 1) + profile_low_bit;
 
-  std::cout << "Profile: " << profile << std::endl;
+  *reader_log << "Profile: " << profile << std::endl;
 
   uncompressed_header->set_profile_low_bit((VP9BitField) profile_low_bit);
   uncompressed_header->set_profile_high_bit((VP9BitField) profile_high_bit);
   if (profile == 3) {
-    uncompressed_header->set_reserved_zero(ReadBitUInt(1));
+    uncompressed_header->set_reserved_zero(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RESERVED_ZERO>());
   }
 
-  VP9BitField show_existing_frame = (VP9BitField) ReadBitUInt(1);
+  VP9BitField show_existing_frame = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SHOW_EXISTING_FRAME>();
   uncompressed_header->set_show_existing_frame(show_existing_frame);
 
   if (show_existing_frame == 1) {
-    uncompressed_header->set_frame_to_show_map_idx(ReadBitUInt(3));
+    uncompressed_header->set_frame_to_show_map_idx(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_TO_SHOW_MAP_IDX>());
     header_size_in_bytes = 0;
     return uncompressed_header;
   }
-  frame_type = (UncompressedHeader_FrameType) ReadBitUInt(1);
+  frame_type = (UncompressedHeader_FrameType) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_TYPE>();
   uncompressed_header->set_frame_type(frame_type);
   
-  VP9BitField show_frame = (VP9BitField) ReadBitUInt(1);
+  VP9BitField show_frame = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SHOW_FRAME>();
   uncompressed_header->set_show_frame(show_frame);
 
-  VP9BitField error_resilient_mode = (VP9BitField) ReadBitUInt(1);
+  VP9BitField error_resilient_mode = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_ERROR_RESILIENT_MODE>();
   uncompressed_header->set_error_resilient_mode(error_resilient_mode);
 
-  std::cout << "Frame Type: " << frame_type << std::endl;
+  *reader_log << "Frame Type: " << frame_type << std::endl;
   
+  // Reference slots that take this frame's size
+  uint32_t refresh_frame_flags = 0;
+  // Only set by this frame's sign biases, it doesn't carry over from the frame before
+  compoundReferenceAllowed = false;
   if (frame_type == UncompressedHeader_FrameType_KEY_FRAME) {
     FrameIsIntra = true;
-    uncompressed_header->set_frame_sync_code(ReadBitUInt(24));
+    refresh_frame_flags = 0xff;
+    uncompressed_header->set_frame_sync_code(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_SYNC_CODE>());
     uncompressed_header->set_allocated_color_config(ReadVP9ColorConfig());
     uncompressed_header->set_allocated_frame_size(ReadVP9FrameSize());
     uncompressed_header->set_allocated_render_size(ReadVP9RenderSize());
@@ -493,33 +718,35 @@ UncompressedHeader* ReadVP9UncompressedHeader() {
     uint32_t intra_only = 0;
 
     if (show_frame == 0) {
-      intra_only = ReadBitUInt(1);
+      intra_only = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_INTRA_ONLY>();
       uncompressed_header->set_intra_only((VP9BitField) intra_only);
     }
     FrameIsIntra = intra_only;
 
     if (error_resilient_mode == 0) {
-      uncompressed_header->set_reset_frame_context(ReadBitUInt(2));
+      uncompressed_header->set_reset_frame_context(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_RESET_FRAME_CONTEXT>());
     }
 
     if (intra_only == 1) {
-      uncompressed_header->set_frame_sync_code(ReadBitUInt(3));
+      uncompressed_header->set_frame_sync_code(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_SYNC_CODE>());
       if (profile > 0) {
         uncompressed_header->set_allocated_color_config(ReadVP9ColorConfig());
       }
-      uncompressed_header->set_refresh_frame_flags(ReadBitUInt(8));
+      refresh_frame_flags = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_FLAGS>();
+      uncompressed_header->set_refresh_frame_flags(refresh_frame_flags);
       uncompressed_header->set_allocated_frame_size(ReadVP9FrameSize());
       uncompressed_header->set_allocated_render_size(ReadVP9RenderSize());
     }
     else {
       // refresh_frame_flags
-      uncompressed_header->set_refresh_frame_flags(ReadBitUInt(8));
+      refresh_frame_flags = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_FLAGS>();
+      uncompressed_header->set_refresh_frame_flags(refresh_frame_flags);
       // ref_frame_idx and ref_frame_sign_bias
       VP9BitField first_ref_frame_sign_bias = (VP9BitField) 0;
       for (uint32_t i = 0; i < 3; i++) {
-        uncompressed_header->add_ref_frame_idx(ReadBitUInt(3));
+        uncompressed_header->add_ref_frame_idx(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_IDX>(i));
 
-        VP9BitField ref_frame_sign_bias = (VP9BitField) ReadBitUInt(1);
+        VP9BitField ref_frame_sign_bias = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REF_FRAME_SIGN_BIAS>(i);
         uncompressed_header->add_ref_frame_sign_bias(ref_frame_sign_bias);
 
         if (i == 0) {
@@ -529,35 +756,45 @@ UncompressedHeader* ReadVP9UncompressedHeader() {
           compoundReferenceAllowed = true;
         }
       }
-      // frame_size_with_refs
-      uint32_t frame_size_found_ref = ReadBitUInt(3);
+      // frame_size_with_refs, the flag of reference i is kept as bit 2 - i so the field reads like the 3 flags
+      uint32_t frame_size_found_ref = 0;
+      for (uint32_t i = 0; i < VP9Fuzzer::VP9_SYNTAX_FRAME_SIZE_FOUND_REF.count && frame_size_found_ref == 0; i++) {
+        frame_size_found_ref = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_SIZE_FOUND_REF>(i) << (2 - i);
+      }
       uncompressed_header->set_frame_size_found_ref(frame_size_found_ref);
       if (frame_size_found_ref == 0) {
         uncompressed_header->set_allocated_frame_size(ReadVP9FrameSize());
       }
       uncompressed_header->set_allocated_render_size(ReadVP9RenderSize());
       // allow_high_precision_mv
-      allow_high_precision_mv = ReadBitUInt(1);
+      allow_high_precision_mv = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_ALLOW_HIGH_PRECISION_MV>();
       uncompressed_header->set_allow_high_precision_mv((VP9BitField) allow_high_precision_mv);
       uncompressed_header->set_allocated_read_interpolation_filter(ReadVP9ReadInterpolationFilter());
     }
   }
 
-  std::cout << "Error Resilient Mode: " << error_resilient_mode << std::endl;
+  *reader_log << "Error Resilient Mode: " << error_resilient_mode << std::endl;
+
+  // Size from the frame or its reference slot, tile info below depends on it
+  const VP9Fuzzer::VP9FrameFormat& frame_format = VP9Fuzzer::ResolveVP9FrameFormat(&ref_slots, *uncompressed_header);
+  FrameWidth = frame_format.width;
+  FrameHeight = frame_format.height;
+  ComputeImageSize();
+  VP9Fuzzer::RefreshVP9RefSlots(&ref_slots, refresh_frame_flags);
 
   if (error_resilient_mode == 0) {
-    uncompressed_header->set_refresh_frame_flags(ReadBitUInt(1));
-    uncompressed_header->set_frame_parallel_decoding_mode((VP9BitField)ReadBitUInt(1));
+    uncompressed_header->set_refresh_frame_context((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REFRESH_FRAME_CONTEXT>());
+    uncompressed_header->set_frame_parallel_decoding_mode((VP9BitField)ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_PARALLEL_DECODING_MODE>());
   }
-  uncompressed_header->set_frame_context_idx(ReadBitUInt(2));
+  uncompressed_header->set_frame_context_idx(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_FRAME_CONTEXT_IDX>());
 
   uncompressed_header->set_allocated_loop_filter_params(ReadVP9LoopFilterParams());
   uncompressed_header->set_allocated_quantization_params(ReadVP9QuantizationParams());
   uncompressed_header->set_allocated_segmentation_params(ReadVP9SegmentationParams());
   uncompressed_header->set_allocated_tile_info(ReadVP9TileInfo());
 
-  header_size_in_bytes = ReadBitUInt(16);
-  std::cout << "Compressed Header Size: " << header_size_in_bytes << std::endl;
+  header_size_in_bytes = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_HEADER_SIZE_IN_BYTES>();
+  *reader_log << "Compressed Header Size: " << header_size_in_bytes << std::endl;
   // uncompressed_header->set_header_size_in_bytes(header_size_in_bytes);
 
   return uncompressed_header;
@@ -565,15 +802,16 @@ UncompressedHeader* ReadVP9UncompressedHeader() {
 
 CompressedHeader_ReadTxMode* ReadVP9ReadTxMode() {
   auto read_tx_mode = new CompressedHeader_ReadTxMode();
+  VP9ProvenanceScope scope("read_tx_mode");
 
   if (Lossless == true) {
     tx_mode = CompressedHeader_TxMode_ONLY_4X4;
   }
   else {
-    tx_mode = ReadLiteral(2);
+    tx_mode = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_TX_MODE>();
     read_tx_mode->set_tx_mode((CompressedHeader_TxMode) tx_mode);
     if (tx_mode == CompressedHeader_TxMode_ALLOW_32X32) {
-      VP9BitField tx_mode_select = (VP9BitField) ReadLiteral(1);
+      VP9BitField tx_mode_select = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_TX_MODE_SELECT>();
       read_tx_mode->set_tx_mode_select(tx_mode_select);
       tx_mode += tx_mode_select;
     }
@@ -582,146 +820,146 @@ CompressedHeader_ReadTxMode* ReadVP9ReadTxMode() {
   return read_tx_mode;
 }
 
-uint32_t ReadVP9Uniform() {
-  const int l = 8;
-  const int m = (1 << l) - 191;
-  const int v = ReadLiteral(l - 1);
-  return v < m ? v : (v << 1) - m + ReadBool(128);
-}
-
 CompressedHeader_DecodeTermSubexp* ReadVP9DecodeTermSubexp() {
   auto decode_term_subexp = new CompressedHeader_DecodeTermSubexp();
+  VP9ProvenanceScope scope("decode_term_subexp");
 
-  VP9BitField bit_1 = (VP9BitField) ReadLiteral(1);
+  VP9BitField bit_1 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_1>();
   decode_term_subexp->set_bit_1(bit_1);
   if (bit_1 == 0) {
-    decode_term_subexp->set_sub_exp_val(ReadLiteral(4));
+    decode_term_subexp->set_sub_exp_val(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL>());
     return decode_term_subexp;
   }
 
-  VP9BitField bit_2 = (VP9BitField) ReadLiteral(1);
+  VP9BitField bit_2 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_2>();
   decode_term_subexp->set_bit_2(bit_2);
   if (bit_2 == 0) {
-    decode_term_subexp->set_sub_exp_val_minus_16(ReadLiteral(4));
+    decode_term_subexp->set_sub_exp_val_minus_16(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL_MINUS_16>());
     return decode_term_subexp;
   }
 
-  VP9BitField bit_3 = (VP9BitField) ReadLiteral(1);
+  VP9BitField bit_3 = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_3>();
   decode_term_subexp->set_bit_3(bit_3);
   if (bit_3 == 0) {
-    decode_term_subexp->set_sub_exp_val_minus_32(ReadLiteral(5));
+    decode_term_subexp->set_sub_exp_val_minus_32(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_SUB_EXP_VAL_MINUS_32>());
     return decode_term_subexp;
   }
 
-  uint32_t v = ReadVP9Uniform();
+  // decode_uniform, the 7 bits of v and the extra bit_4 when v >= 65
+  uint32_t v = ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_V>();
   decode_term_subexp->set_v(v);
   if (v < 65) {
     return decode_term_subexp;
   }
 
-  decode_term_subexp->set_bit_4((VP9BitField) ReadLiteral(1));
+  decode_term_subexp->set_bit_4((VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_BIT_4>());
 
   return decode_term_subexp;
 }
 
-void ReadVP9DiffUpdateProb(CompressedHeader_DiffUpdateProb* diff_update_prob) {
+void ReadVP9DiffUpdateProb(CompressedHeader_DiffUpdateProb* diff_update_prob, int64_t prob, uint32_t index) {
   // Reads values into ptr arg because of how repeated ptr fields work in protobuf lib
-  VP9BitField update_prob = (VP9BitField) ReadBool(252);
+  VP9BitField update_prob = (VP9BitField) ReadBoolElement(prob, "diff_update_prob.update_prob", index);
   diff_update_prob->set_update_prob(update_prob);
   if (update_prob == 1) {
+    VP9ProvenanceScope scope("diff_update_prob", index);
     diff_update_prob->set_allocated_decode_term_subexp(ReadVP9DecodeTermSubexp());
   }
 }
 
-CompressedHeader_TxModeProbs* ReadVP9TxModeProbs() {
-  auto tx_mode_probs = new CompressedHeader_TxModeProbs();
+template <const VP9Fuzzer::VP9SyntaxElement& Element>
+void ReadVP9DiffUpdateProbs(google::protobuf::RepeatedPtrField<CompressedHeader_DiffUpdateProb>* diff_update_probs,
+                            google::protobuf::RepeatedPtrField<CompressedHeader_SparseDiffUpdateProb>* sparse_diff_update_probs,
+                            uint32_t first_index = 0) {
+  // Reads the Element.count DiffUpdateProbs of a section, either all of them or only the updating ones when
+  // SparseProbs is set
+  static_assert(Element.coding == VP9Fuzzer::VP9_SYNTAX_DIFF_UPDATE, "not a diff_update_prob() loop");
+  uint32_t end_index = first_index + Element.count;
+  for (uint32_t i = first_index; i < end_index; i++) {
+    // Skip the run of zero update flags up to the next update
+    uint64_t run_position = provenance != nullptr ? BoolPosition() : 0;
+    uint32_t zero_run = ReadBoolZeroRun(Element.prob, end_index - i);
+    if (provenance != nullptr && zero_run > 0) {
+      RecordVP9BoolProvenance("diff_update_prob.update_prob", run_position, Element.prob, i, zero_run);
+    }
+    if (!SparseProbs) {
+      diff_update_probs->Reserve(diff_update_probs->size() + zero_run);
+      for (uint32_t j = 0; j < zero_run; j++) {
+        diff_update_probs->Add();
+      }
+    }
+    i += zero_run;
+    if (i == end_index) {
+      break;
+    }
 
-  for (uint32_t i = 0; i < 12; i++) {
-    tx_mode_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(tx_mode_probs->mutable_diff_update_prob(i));
+    if (SparseProbs) {
+      if (ReadBoolElement(Element.prob, "diff_update_prob.update_prob", i) == 1) {
+        VP9ProvenanceScope scope("sparse_diff_update_prob", sparse_diff_update_probs->size());
+        auto sparse_diff_update_prob = sparse_diff_update_probs->Add();
+        sparse_diff_update_prob->set_index(i);
+        sparse_diff_update_prob->set_allocated_decode_term_subexp(ReadVP9DecodeTermSubexp());
+      }
+    }
+    else {
+      ReadVP9DiffUpdateProb(diff_update_probs->Add(), Element.prob, i);
+    }
   }
+}
+
+template <const VP9Fuzzer::VP9SyntaxElement& Element, typename Section>
+Section* ReadVP9ProbsSection() {
+  // Sections that are a single diff_update_prob() loop, recorded under the name of the element
+  auto section = new Section();
+  VP9ProvenanceScope scope(Element.name);
 
-  return tx_mode_probs;
+  ReadVP9DiffUpdateProbs<Element>(section->mutable_diff_update_prob(), section->mutable_sparse_diff_update_prob());
+
+  return section;
+}
+
+bool IsVP9SectionPresent(const VP9Fuzzer::VP9SyntaxElement& element) {
+  // Condition of a compressed header element of vp9_syntax.h, from the header read so far
+  VP9Fuzzer::VP9SyntaxState state = {tx_mode, FrameIsIntra, interpolation_filter, compoundReferenceAllowed, reference_mode,
+                                     allow_high_precision_mv};
+  return VP9Fuzzer::IsVP9SyntaxPresent(element.condition, state);
 }
 
 CompressedHeader_ReadCoefProbs* ReadVP9ReadCoefProbs() {
   auto read_coef_probs = new CompressedHeader_ReadCoefProbs();
+  VP9ProvenanceScope scope(VP9Fuzzer::VP9_SYNTAX_COEF_PROBS.name);
   for (uint32_t txSz = VP9Fuzzer::TX_4X4; txSz <= VP9Fuzzer::tx_mode_to_biggest_tx_size[tx_mode]; ++txSz) {
     read_coef_probs->add_read_coef_probs();
     auto loop_obj = read_coef_probs->mutable_read_coef_probs(txSz);
+    VP9ProvenanceScope loop_scope(VP9Fuzzer::VP9_SYNTAX_COEF_PROBS.name, txSz);
 
     // Write the update_probs indicator bit
-    VP9BitField update_probs = (VP9BitField) ReadLiteral(1);
-    std::cout << "Update Read Coef Probs: " << update_probs << std::endl;
+    VP9BitField update_probs = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_UPDATE_PROBS>();
+    *reader_log << "Update Read Coef Probs: " << update_probs << std::endl;
     loop_obj->set_update_probs(update_probs);
     if (update_probs == 1) {
-      for (uint32_t i = 0; i < 396; i ++) {
-        loop_obj->add_diff_update_prob();
-        ReadVP9DiffUpdateProb(loop_obj->mutable_diff_update_prob(i));
-      }
+      ReadVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COEF_PROBS>(loop_obj->mutable_diff_update_prob(),
+                                                               loop_obj->mutable_sparse_diff_update_prob());
     }
   }
   return read_coef_probs; 
 }
 
-CompressedHeader_ReadSkipProb* ReadVP9ReadSkipProb() {
-  auto read_skip_prob = new CompressedHeader_ReadSkipProb();
-
-  for (uint32_t i = 0; i < 3; i++) {
-    read_skip_prob->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_skip_prob->mutable_diff_update_prob(i));
-  }
-
-  return read_skip_prob;
-}
-
-CompressedHeader_ReadInterModeProbs* ReadVP9ReadInterModeProbs() {
-  auto read_inter_mode_probs = new CompressedHeader_ReadInterModeProbs();
-
-  for (uint32_t i = 0; i < 21; i++) {
-    read_inter_mode_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_inter_mode_probs->mutable_diff_update_prob(i));
-  }
-
-  return read_inter_mode_probs;
-}
-
-CompressedHeader_ReadInterpFilterProbs* ReadVP9ReadInterpFilterProbs() {
-  auto read_interp_filter_probs = new CompressedHeader_ReadInterpFilterProbs();
-
-  for (uint32_t i = 0; i < 14; i++) {
-    read_interp_filter_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_interp_filter_probs->mutable_diff_update_prob(i));
-  } 
-
-  return read_interp_filter_probs;
-}
-
-CompressedHeader_ReadIsInterProbs* ReadVP9ReadIsInterProbs() {
-  auto read_is_inter_probs = new CompressedHeader_ReadIsInterProbs();
-
-  for (uint32_t i = 0; i < 4; i++) {
-    read_is_inter_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_is_inter_probs->mutable_diff_update_prob(i));
-  }
-
-  return read_is_inter_probs;
-}
-
 CompressedHeader_FrameReferenceMode* ReadVP9FrameReferenceMode() {
   auto frame_reference_mode = new CompressedHeader_FrameReferenceMode();
+  VP9ProvenanceScope scope("frame_reference_mode");
 
-  std::cout << "Compound Reference Allowed: " << compoundReferenceAllowed << std::endl;
+  *reader_log << "Compound Reference Allowed: " << compoundReferenceAllowed << std::endl;
 
-  if (compoundReferenceAllowed == 1) {
-    VP9BitField non_single_reference = (VP9BitField) ReadLiteral(1);
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_NON_SINGLE_REFERENCE)) {
+    VP9BitField non_single_reference = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_NON_SINGLE_REFERENCE>();
     frame_reference_mode->set_non_single_reference(non_single_reference);
 
     if (non_single_reference == 0) {
       reference_mode = VP9Fuzzer::SINGLE_REFERENCE;
     }
     else {
-      VP9BitField reference_select = (VP9BitField) ReadLiteral(1);
+      VP9BitField reference_select = (VP9BitField) ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_REFERENCE_SELECT>();
       frame_reference_mode->set_reference_select(reference_select);
 
       if (reference_select == 0) {
@@ -741,113 +979,121 @@ CompressedHeader_FrameReferenceMode* ReadVP9FrameReferenceMode() {
 
 CompressedHeader_FrameReferenceModeProbs* ReadVP9FrameReferenceModeProbs() {
   auto frame_reference_mode_probs = new CompressedHeader_FrameReferenceModeProbs();
+  VP9ProvenanceScope scope("frame_reference_mode_probs");
   
+  // Loops continue each other's indexes
+  auto diff_update_probs = frame_reference_mode_probs->mutable_diff_update_prob();
+  auto sparse_diff_update_probs = frame_reference_mode_probs->mutable_sparse_diff_update_prob();
   uint32_t written_count = 0;
-  if (reference_mode == VP9Fuzzer::REFERENCE_MODE_SELECT) {
-    for (uint32_t i = 0; i < 5; i++) {
-      frame_reference_mode_probs->add_diff_update_prob();
-      ReadVP9DiffUpdateProb(frame_reference_mode_probs->mutable_diff_update_prob(written_count++));
-    }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB)) {
+    ReadVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+    written_count += VP9Fuzzer::VP9_SYNTAX_COMP_MODE_PROB.count;
   }
-  if (reference_mode != VP9Fuzzer::COMPOUND_REFERENCE) {
-    for (uint32_t i = 0; i < 5; i++) {
-      frame_reference_mode_probs->add_diff_update_prob();
-      ReadVP9DiffUpdateProb(frame_reference_mode_probs->mutable_diff_update_prob(written_count++));
-    }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB)) {
+    ReadVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+    written_count += VP9Fuzzer::VP9_SYNTAX_SINGLE_REF_PROB.count;
   }
-  if (reference_mode != VP9Fuzzer::SINGLE_REFERENCE) {
-    for (uint32_t i = 0; i < 5; i++) {
-      frame_reference_mode_probs->add_diff_update_prob();
-      ReadVP9DiffUpdateProb(frame_reference_mode_probs->mutable_diff_update_prob(written_count++));
-    }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB)) {
+    ReadVP9DiffUpdateProbs<VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB>(diff_update_probs, sparse_diff_update_probs, written_count);
+    written_count += VP9Fuzzer::VP9_SYNTAX_COMP_REF_PROB.count;
   }
 
   return frame_reference_mode_probs;
 }
 
-CompressedHeader_ReadYModeProbs* ReadVP9ReadYModeProbs() {
-  auto read_y_mode_probs = new CompressedHeader_ReadYModeProbs();
-
-  for (uint32_t i = 0; i < 36; i++) {
-    read_y_mode_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_y_mode_probs->mutable_diff_update_prob(i));
-  }
-
-  return read_y_mode_probs;
-}
-
-CompressedHeader_ReadPartitionProbs* ReadVP9ReadPartitionProbs() {
-  auto read_partition_probs = new CompressedHeader_ReadPartitionProbs();
-
-  for (uint32_t i = 0; i < 48; i++) {
-    read_partition_probs->add_diff_update_prob();
-    ReadVP9DiffUpdateProb(read_partition_probs->mutable_diff_update_prob(i));
-  }
-
-  return read_partition_probs;
-}
-
-void ReadVP9MvProbsLoop(CompressedHeader_MvProbs_MvProbsLoop* mv_probs_loop) {
-  VP9BitField update_mv_prob = (VP9BitField) ReadBool(252);
+void ReadVP9MvProbsLoop(CompressedHeader_MvProbs_MvProbsLoop* mv_probs_loop, uint32_t index) {
+  VP9BitField update_mv_prob = (VP9BitField) ReadBoolElement(VP9Fuzzer::VP9_SYNTAX_MV_PROBS.prob, "mv_probs.update_mv_prob", index);
   mv_probs_loop->set_update_mv_prob(update_mv_prob);
   if (update_mv_prob == 1) {
-    mv_probs_loop->set_mv_prob(ReadLiteral(7));
+    VP9ProvenanceScope scope(VP9Fuzzer::VP9_SYNTAX_MV_PROBS.name, index);
+    mv_probs_loop->set_mv_prob(ReadVP9Element<VP9Fuzzer::VP9_SYNTAX_MV_PROB>());
   }
 }
 
 CompressedHeader_MvProbs* ReadVP9MvProbs() {
   auto mv_probs = new CompressedHeader_MvProbs();
+  VP9ProvenanceScope scope(VP9Fuzzer::VP9_SYNTAX_MV_PROBS.name);
 
-  for (uint32_t i = 0; i < 65; i++) {
-    mv_probs->add_mv_probs();
-    ReadVP9MvProbsLoop(mv_probs->mutable_mv_probs(i));
+  // The high precision loops are conditional
+  const uint32_t prob = VP9Fuzzer::VP9_SYNTAX_MV_PROBS.prob;
+  uint32_t mv_probs_count = VP9Fuzzer::VP9_SYNTAX_MV_PROBS.count;
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_MV_HP_PROBS)) {
+    mv_probs_count += VP9Fuzzer::VP9_SYNTAX_MV_HP_PROBS.count;
   }
-
-  if (allow_high_precision_mv) {
-    for (uint32_t i = 65; i < (65 + 4); i++) {
+  for (uint32_t i = 0; i < mv_probs_count; i++) {
+    // Skip the run of zero update flags up to the next update
+    uint64_t run_position = provenance != nullptr ? BoolPosition() : 0;
+    uint32_t zero_run = ReadBoolZeroRun(prob, mv_probs_count - i);
+    if (provenance != nullptr && zero_run > 0) {
+      RecordVP9BoolProvenance("mv_probs.update_mv_prob", run_position, prob, i, zero_run);
+    }
+    for (uint32_t j = 0; j < zero_run; j++) {
       mv_probs->add_mv_probs();
-      ReadVP9MvProbsLoop(mv_probs->mutable_mv_probs(i));
     }
+    i += zero_run;
+    if (i == mv_probs_count) {
+      break;
+    }
+
+    ReadVP9MvProbsLoop(mv_probs->add_mv_probs(), i);
   }
 
   return mv_probs;
 }
 
 CompressedHeader* ReadVP9CompressedHeader() {
+  // Sections are read when their condition in vp9_syntax.h holds
   auto compressed_header = new CompressedHeader();
+  VP9ProvenanceScope scope("compressed_header");
 
-  std::cout << "Bytes Left: " << (BoolBufferEnd - BoolBuffer) << std::endl;
+  *reader_log << "Bytes Left: " << (BoolBufferEnd - BoolBuffer) << std::endl;
 
   compressed_header->set_allocated_read_tx_mode(ReadVP9ReadTxMode());
   
-  std::cout << "Compressed Header TxMode: " << tx_mode << std::endl;
+  *reader_log << "Compressed Header TxMode: " << tx_mode << std::endl;
 
-  if (tx_mode == CompressedHeader_TxMode_TX_MODE_SELECT) {
-    compressed_header->set_allocated_tx_mode_probs(ReadVP9TxModeProbs());
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_TX_MODE_PROBS)) {
+    compressed_header->set_allocated_tx_mode_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_TX_MODE_PROBS, CompressedHeader_TxModeProbs>());
   }
 
-  std::cout << "Bytes Left: " << (BoolBufferEnd - BoolBuffer) << std::endl;
+  *reader_log << "Bytes Left: " << (BoolBufferEnd - BoolBuffer) << std::endl;
 
   compressed_header->set_allocated_read_coef_probs(ReadVP9ReadCoefProbs());
-  compressed_header->set_allocated_read_skip_prob(ReadVP9ReadSkipProb());
-
-  
+  compressed_header->set_allocated_read_skip_prob(
+      ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_SKIP_PROB, CompressedHeader_ReadSkipProb>());
 
-  std::cout << "FrameIsIntra: " << FrameIsIntra << std::endl;
+  *reader_log << "FrameIsIntra: " << FrameIsIntra << std::endl;
 
-  if (FrameIsIntra == 0) {
-    compressed_header->set_allocated_read_inter_mode_probs(ReadVP9ReadInterModeProbs());
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_INTER_MODE_PROBS)) {
+    compressed_header->set_allocated_read_inter_mode_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_INTER_MODE_PROBS, CompressedHeader_ReadInterModeProbs>());
+  }
 
-    std::cout << "Interpolation Filter: " << interpolation_filter << std::endl;
+  *reader_log << "Interpolation Filter: " << interpolation_filter << std::endl;
 
-    if (interpolation_filter == UncompressedHeader_InterpolationFilter_SWITCHABLE) {
-      compressed_header->set_allocated_read_interp_filter_probs(ReadVP9ReadInterpFilterProbs());
-    }
-    compressed_header->set_allocated_read_is_inter_probs(ReadVP9ReadIsInterProbs());
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_INTERP_FILTER_PROBS)) {
+    compressed_header->set_allocated_read_interp_filter_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_INTERP_FILTER_PROBS, CompressedHeader_ReadInterpFilterProbs>());
+  }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_IS_INTER_PROBS)) {
+    compressed_header->set_allocated_read_is_inter_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_IS_INTER_PROBS, CompressedHeader_ReadIsInterProbs>());
+  }
+  // frame_reference_mode() and its probs pick their elements themselves
+  if (FrameIsIntra == 0) {
     compressed_header->set_allocated_frame_reference_mode(ReadVP9FrameReferenceMode());
     compressed_header->set_allocated_frame_reference_mode_probs(ReadVP9FrameReferenceModeProbs());
-    compressed_header->set_allocated_read_y_mode_probs(ReadVP9ReadYModeProbs());
-    compressed_header->set_allocated_read_partition_probs(ReadVP9ReadPartitionProbs());
+  }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_Y_MODE_PROBS)) {
+    compressed_header->set_allocated_read_y_mode_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_Y_MODE_PROBS, CompressedHeader_ReadYModeProbs>());
+  }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_PARTITION_PROBS)) {
+    compressed_header->set_allocated_read_partition_probs(
+        ReadVP9ProbsSection<VP9Fuzzer::VP9_SYNTAX_PARTITION_PROBS, CompressedHeader_ReadPartitionProbs>());
+  }
+  if (IsVP9SectionPresent(VP9Fuzzer::VP9_SYNTAX_MV_PROBS)) {
     compressed_header->set_allocated_mv_probs(ReadVP9MvProbs());
   }
 
@@ -855,113 +1101,939 @@ CompressedHeader* ReadVP9CompressedHeader() {
 }
 
 void ReadVP9TrailingBits() {
-  while (bit_counter & 7) {
+  while (bit_reader.bit_counter & 7) {
     ReadBitUInt(1);
   }
 }
 
-void ReadVP9Tile(Tile* tile, uint32_t frame_size_in_bits) {
-  uint32_t remaining_bytes = floor((frame_size_in_bits - bit_counter) / 8);
-  // Check if this is the last tile
-  //  32 bytes for tile_size and 12 for at least 1 bool-coded tile
-  uint32_t tile_size = ReadBitUInt(32);
-  if (tile_size > remaining_bytes) {
-    tile_size = remaining_bytes;
-    bit_counter -= 32;
-  }
-  // Decode tile
-  // tile->set_tile_size(tile_size);
+struct VP9ByteRange {
+  // Byte offset and size in byte_buffer
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+struct VP9HeaderState {
+  // Reader globals set by the uncompressed header that the compressed header depends on
+  UncompressedHeader_FrameType frame_type;
+  uint32_t profile;
+  bool FrameIsIntra;
+  bool Lossless;
+  bool allow_high_precision_mv;
+  bool compoundReferenceAllowed;
+  uint32_t interpolation_filter;
+  uint32_t header_size_in_bytes;
+  uint32_t FrameWidth;
+  uint32_t FrameHeight;
+  uint32_t TileColsLog2;
+  uint32_t TileRowsLog2;
+};
+
+VP9HeaderState SaveVP9HeaderState() {
+  return VP9HeaderState{frame_type, profile, FrameIsIntra, Lossless, allow_high_precision_mv, compoundReferenceAllowed,
+                        interpolation_filter, header_size_in_bytes, FrameWidth, FrameHeight, TileColsLog2, TileRowsLog2};
+}
 
-  std::cout << "Tile Size: " << tile_size << std::endl;
-  
-  tile->set_partition(ReadBitString(tile_size * 8));
+void RestoreVP9HeaderState(const VP9HeaderState& state) {
+  frame_type = state.frame_type;
+  profile = state.profile;
+  FrameIsIntra = state.FrameIsIntra;
+  Lossless = state.Lossless;
+  allow_high_precision_mv = state.allow_high_precision_mv;
+  compoundReferenceAllowed = state.compoundReferenceAllowed;
+  interpolation_filter = state.interpolation_filter;
+  header_size_in_bytes = state.header_size_in_bytes;
+  FrameWidth = state.FrameWidth;
+  FrameHeight = state.FrameHeight;
+  TileColsLog2 = state.TileColsLog2;
+  TileRowsLog2 = state.TileRowsLog2;
+  ComputeImageSize();
+}
+
+struct LazyVP9Frame {
+  // A frame whose uncompressed header is parsed and whose compressed header and tiles
+  // are only located, they get decoded into vp9_frame on first access
+  VP9Frame* vp9_frame = nullptr;
+  VP9HeaderState header_state = {};
+  VP9ByteRange compressed_header_range;
+  bool compressed_header_truncated = false;
+  VP9Fuzzer::VP9TileLayout tile_layout;
+  std::vector<VP9ByteRange> tile_ranges;
+  bool compressed_header_read = false;
+  // Not std::vector<bool>, tiles are marked read from several threads
+  std::vector<uint8_t> tiles_read;
+};
+
+void ReadVP9TileRanges(LazyVP9Frame* lazy_frame, uint64_t frame_end_in_bits) {
+  // The tile count comes from the tile layout, every tile but the last starts with a 32 bit size
+  // A missing tile or a size that runs past the frame marks the frame as truncated
+  uint32_t tile_count = lazy_frame->tile_layout.tiles.size();
+  for (uint32_t i = 0; i < tile_count; i++) {
+    uint64_t remaining_bytes = (frame_end_in_bits - bit_reader.bit_counter) / 8;
+    uint64_t tile_size = remaining_bytes;
+    if (i + 1 < tile_count) {
+      if (remaining_bytes < 4) {
+        SetVP9ReadError(VP9_READ_TRUNCATED_TILES, frame_end_in_bits);
+        break;
+      }
+      tile_size = ReadBitUInt(32);
+      if (tile_size > remaining_bytes - 4) {
+        SetVP9ReadError(VP9_READ_TRUNCATED_TILES, frame_end_in_bits);
+        tile_size = remaining_bytes - 4;
+      }
+    }
+    VP9ByteRange tile_range;
+    tile_range.offset = bit_reader.bit_counter / 8;
+    tile_range.size = tile_size;
+    lazy_frame->tile_ranges.push_back(tile_range);
+    bit_reader.bit_counter += tile_size * 8;
+  }
+  lazy_frame->tiles_read.assign(lazy_frame->tile_ranges.size(), false);
 }
 
-void ReadVP9Frame(VP9Frame* vp9_frame, uint32_t frame_size) {
-  // Read Headers
+VP9ReadStatus ReadVP9FrameLazy(LazyVP9Frame* lazy_frame, VP9Frame* vp9_frame, uint32_t frame_size) {
+  // Parses the uncompressed header and locates the compressed header and tiles, leaves the reader at the end of the frame
+  // A truncated frame keeps the parts that were read and returns where the data ran out in read_result
+  uint64_t frame_start_in_bits = bit_reader.bit_counter;
+  uint64_t frame_end_in_bits = std::min<uint64_t>(frame_start_in_bits + (uint64_t) frame_size * 8, bit_reader.size_in_bits);
+
+  lazy_frame->vp9_frame = vp9_frame;
   vp9_frame->set_allocated_uncompressed_header(ReadVP9UncompressedHeader());
-  std::cout << "Wrote Uncompressed Header" << std::endl;
-  
-  std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
-  
+  *reader_log << "Wrote Uncompressed Header" << std::endl;
+
+  *reader_log << "Bits Read: " << bit_reader.bit_counter << " / " << bit_reader.size_in_bits << std::endl;
+
   ReadVP9TrailingBits();
+  lazy_frame->header_state = SaveVP9HeaderState();
+  if (bit_reader.bit_counter > frame_end_in_bits) {
+    SetVP9ReadError(VP9_READ_TRUNCATED_UNCOMPRESSED_HEADER, frame_end_in_bits);
+    bit_reader.bit_counter = frame_end_in_bits;
+    return read_result.status;
+  }
 
   if (header_size_in_bytes == 0) {
-    std::cout << "Repeat Frame, " << bit_counter << " / " << bit_buffer.size() << std::endl;
-    return;
+    *reader_log << "Repeat Frame, " << bit_reader.bit_counter << " / " << bit_reader.size_in_bits << std::endl;
+    return read_result.status;
   }
 
-  std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
-
-  InitBool(header_size_in_bytes);
-  vp9_frame->set_allocated_compressed_header(ReadVP9CompressedHeader());
-  ExitBool();
+  // A compressed header cut short is bool-decoded from the bytes that are there
+  uint64_t compressed_header_size = std::min<uint64_t>(header_size_in_bytes, (frame_end_in_bits - bit_reader.bit_counter) / 8);
+  if (compressed_header_size < header_size_in_bytes) {
+    SetVP9ReadError(VP9_READ_TRUNCATED_COMPRESSED_HEADER, frame_end_in_bits);
+    lazy_frame->compressed_header_truncated = true;
+  }
+  lazy_frame->compressed_header_range.offset = bit_reader.bit_counter / 8;
+  lazy_frame->compressed_header_range.size = compressed_header_size;
+  bit_reader.bit_counter += compressed_header_size * 8;
 
-  std::cout << "Wrote Compressed Header" << std::endl;
-  std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
-  // Read Tiles
-  uint32_t tile_count = 0;
-  uint32_t frame_size_in_bits = (frame_size * 8);
-  while (bit_counter < frame_size_in_bits) {
+  VP9Fuzzer::UpdateVP9TileLayout(MiCols, MiRows, TileColsLog2, TileRowsLog2, &lazy_frame->tile_layout);
+  ReadVP9TileRanges(lazy_frame, frame_end_in_bits);
+  for (uint32_t i = 0; i < lazy_frame->tile_ranges.size(); i++) {
     vp9_frame->add_tile();
-    ReadVP9Tile(vp9_frame->mutable_tile(tile_count++), frame_size_in_bits);
-    std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
   }
-  std::cout << "Bits Read: " << bit_counter << " / " << bit_buffer.size() << std::endl;
+  *reader_log << "Tiles: " << lazy_frame->tile_ranges.size() << std::endl;
+  // The IVF frame size promised more data than the file has, the last tile is cut short
+  if (frame_end_in_bits < frame_start_in_bits + (uint64_t) frame_size * 8) {
+    SetVP9ReadError(VP9_READ_TRUNCATED_TILES, frame_end_in_bits);
+  }
+  return read_result.status;
+}
+
+const CompressedHeader* GetVP9CompressedHeader(LazyVP9Frame* lazy_frame) {
+  // Bool-decodes the compressed header on first access, nullptr for a repeat frame
+  if (lazy_frame->compressed_header_range.size == 0) {
+    return nullptr;
+  }
+  if (!lazy_frame->compressed_header_read) {
+    VP9HeaderState reader_state = SaveVP9HeaderState();
+    RestoreVP9HeaderState(lazy_frame->header_state);
+
+    const VP9ByteRange& range = lazy_frame->compressed_header_range;
+    BoolStartBit = (window_offset + range.offset) * 8;
+    if (provenance != nullptr) {
+      RecordVP9Provenance("compressed_header", BoolStartBit, range.size * 8, false, 0);
+    }
+    InitBool(bit_reader.data + range.offset, range.size);
+    lazy_frame->vp9_frame->set_allocated_compressed_header(ReadVP9CompressedHeader());
+    if (!ExitBool() || lazy_frame->compressed_header_truncated) {
+      // Runs past the end of the header read as zeros, the probabilities decoded before that are kept
+      SetVP9ReadError(VP9_READ_TRUNCATED_COMPRESSED_HEADER, (range.offset + range.size) * 8);
+    }
+    *reader_log << "Wrote Compressed Header" << std::endl;
+
+    RestoreVP9HeaderState(reader_state);
+    lazy_frame->compressed_header_read = true;
+  }
+  return &lazy_frame->vp9_frame->compressed_header();
+}
+
+void NoteVP9Tile(const LazyVP9Frame* lazy_frame, uint32_t tile_index) {
+  // Logs the tile and records its provenance, done in tile order on the reading thread
+  const VP9ByteRange& tile_range = lazy_frame->tile_ranges[tile_index];
+  *reader_log << "Tile Size: " << tile_range.size << std::endl;
+  if (provenance != nullptr) {
+    VP9ProvenanceScope scope("tile", tile_index);
+    RecordVP9Provenance("partition", (window_offset + tile_range.offset) * 8, tile_range.size * 8, false, 0);
+  }
+}
+
+void ReadVP9TileData(LazyVP9Frame* lazy_frame, uint32_t tile_index) {
+  // Only touches this tile's message and flag, so different tiles can be read at the same time
+  const VP9ByteRange& tile_range = lazy_frame->tile_ranges[tile_index];
+  Tile* tile = lazy_frame->vp9_frame->mutable_tile(tile_index);
+  tile->set_partition((const char*) bit_reader.data + tile_range.offset, tile_range.size);
+  lazy_frame->tiles_read[tile_index] = true;
+}
+
+const Tile* GetVP9Tile(LazyVP9Frame* lazy_frame, uint32_t tile_index) {
+  // Copies the tile out of the frame on first access
+  if (tile_index >= lazy_frame->tile_ranges.size()) {
+    return nullptr;
+  }
+  if (!lazy_frame->tiles_read[tile_index]) {
+    NoteVP9Tile(lazy_frame, tile_index);
+    ReadVP9TileData(lazy_frame, tile_index);
+  }
+  return &lazy_frame->vp9_frame->tile(tile_index);
+}
+
+void ReadVP9Tiles(LazyVP9Frame* lazy_frame) {
+  // The tile ranges are already split by ReadVP9TileRanges, so the tiles not read yet are copied on tile_pool
+  // Each one lands in its own Tile message, which keeps them in coding order
+  uint32_t tile_count = lazy_frame->tile_ranges.size();
+  for (uint32_t i = 0; i < tile_count; i++) {
+    if (!lazy_frame->tiles_read[i]) {
+      NoteVP9Tile(lazy_frame, i);
+    }
+  }
+  RunVP9ThreadPool(&tile_pool, tile_count, [&](uint32_t tile_index) {
+    if (!lazy_frame->tiles_read[tile_index]) {
+      ReadVP9TileData(lazy_frame, tile_index);
+    }
+  });
+}
+
+uint32_t ReadVP9Tree(const int8_t* tree, const uint8_t* probs) {
+  int32_t i = 0;
+  while ((i = tree[i + ReadBool(probs[i >> 1])]) > 0) {
+  }
+  return -i;
 }
 
-void ReadVP9Frames(VP9Fuzz* fuzz) {
+uint32_t ReadVP9CoefLevel(uint32_t token) {
+  // read_coef() in spec, category 6 has BitDepth - 8 more high bits at probability 255
+  if (token < VP9Fuzzer::DCT_VAL_CAT1) {
+    return token;
+  }
+  uint32_t cat = token - VP9Fuzzer::DCT_VAL_CAT1;
+  uint32_t extra = 0;
+  if (token == VP9Fuzzer::DCT_VAL_CAT6) {
+    for (uint32_t bit = 8; bit < block_frame_info.bit_depth; bit++) {
+      extra = (extra << 1) | ReadBool(255);
+    }
+  }
+  for (uint32_t bit = 0; bit < VP9Fuzzer::cat_bits[cat]; bit++) {
+    extra = (extra << 1) | ReadBool(VP9Fuzzer::cat_probs[cat][bit]);
+  }
+  return VP9Fuzzer::cat_min_level[cat] + extra;
+}
+
+uint32_t ReadVP9Tokens(TransformBlock* transform_block, uint32_t plane, uint32_t tx_size, uint32_t tx_type, uint32_t ctx) {
+  // tokens() in spec, returns the end of block
+  const uint8_t (*coef_probs)[6][3] = block_frame_info.probs.coef_probs[tx_size][plane > 0][0];
+  const uint16_t* scan = VP9Fuzzer::GetVP9Scan(tx_size, tx_type);
+  uint32_t max_eob = 16 << (tx_size << 1);
+  uint32_t c = 0;
+  bool check_eob = true;
+  while (c < max_eob) {
+    if (c > 0) {
+      ctx = VP9Fuzzer::GetVP9CoefContext(&tile_context, scan, tx_size, tx_type, c);
+    }
+    const uint8_t* prob = coef_probs[VP9Fuzzer::GetVP9CoefBand(tx_size, c)][ctx];
+    if (check_eob && !ReadBool(prob[0])) {
+      break;
+    }
+    if (!ReadBool(prob[1])) {
+      transform_block->add_coef(0);
+      tile_context.token_cache[scan[c]] = 0;
+      check_eob = false;
+      c++;
+      continue;
+    }
+    uint32_t token = VP9Fuzzer::ONE_TOKEN;
+    if (ReadBool(prob[2])) {
+      token = ReadVP9Tree(VP9Fuzzer::coef_con_tree, VP9Fuzzer::pareto8_full[prob[2] - 1]);
+    }
+    int32_t level = ReadVP9CoefLevel(token);
+    transform_block->add_coef(ReadBool(128) ? -level : level);
+    tile_context.token_cache[scan[c]] = VP9Fuzzer::energy_class[token];
+    check_eob = true;
+    c++;
+  }
+  return c;
+}
+
+void ReadVP9Residual(Block* block, const VP9Fuzzer::VP9BlockInfo& info, uint32_t mi_row, uint32_t mi_col, uint32_t bwl,
+                     uint32_t bhl) {
+  // residual() in spec for an intra block, bwl and bhl are log2 of its size in 4x4 units (1 below 8x8)
+  uint32_t bw = 1 << (bwl - 1);
+  uint32_t bh = 1 << (bhl - 1);
+  for (uint32_t plane = 0; plane < 3; plane++) {
+    uint32_t ssx = plane > 0 ? block_frame_info.subsampling_x : 0;
+    uint32_t ssy = plane > 0 ? block_frame_info.subsampling_y : 0;
+    uint32_t n4_w = (bw << 1) >> ssx;
+    uint32_t n4_h = (bh << 1) >> ssy;
+    uint32_t x4 = (mi_col * 2) >> ssx;
+    uint32_t y4 = ((mi_row * 2) & 15) >> ssy;
+    // The above context has 16 columns past the frame, as in the writer no block is read past them
+    uint32_t above_size = tile_context.above_nonzero[plane].size();
+    if (info.skip) {
+      uint32_t clear_w = x4 < above_size ? std::min(n4_w, above_size - x4) : 0;
+      VP9Fuzzer::ClearVP9NonzeroContext(&tile_context, plane, x4, y4, clear_w, n4_h);
+      continue;
+    }
+    uint32_t tx_size = plane > 0 ? VP9Fuzzer::GetVP9UvTxSize(info.tx_size, bwl - ssx, bhl - ssy) : info.tx_size;
+    uint32_t step = 1 << tx_size;
+    // Transform blocks past the last 8x8 column or row of the frame aren't coded, in 64 bits and not below 0
+    int64_t right_edge = ((int64_t) block_frame_info.mi_cols - bw - mi_col) * 64;
+    int64_t bottom_edge = ((int64_t) block_frame_info.mi_rows - bh - mi_row) * 64;
+    uint32_t max_blocks_wide = std::max<int64_t>(n4_w + (right_edge >= 0 ? 0 : right_edge >> (5 + ssx)), 0);
+    uint32_t max_blocks_high = std::max<int64_t>(n4_h + (bottom_edge >= 0 ? 0 : bottom_edge >> (5 + ssy)), 0);
+    for (uint32_t row = 0; row < max_blocks_high; row += step) {
+      for (uint32_t col = 0; col < max_blocks_wide && x4 + col + step <= above_size; col += step) {
+        uint32_t mode = plane > 0 ? block->default_uv_mode() : info.sub_modes[info.sb_type < VP9Fuzzer::BLOCK_8X8 ? (row << 1) + col : 0];
+        uint32_t tx_type = (plane > 0 || block_frame_info.lossless) ? (uint32_t) VP9Fuzzer::DCT_DCT : (uint32_t) VP9Fuzzer::intra_mode_to_tx_type[mode];
+        uint32_t ctx = VP9Fuzzer::GetVP9NonzeroContext(&tile_context, plane, x4 + col, y4 + row, tx_size);
+        uint32_t eob = ReadVP9Tokens(block->add_transform_block(), plane, tx_size, tx_type, ctx);
+        VP9Fuzzer::SetVP9NonzeroContext(&tile_context, plane, x4 + col, y4 + row, tx_size,
+                                        max_blocks_wide - col, max_blocks_high - row, eob > 0);
+      }
+    }
+  }
+}
+
+void ReadVP9Block(Block* block, uint32_t mi_row, uint32_t mi_col, uint32_t bsize, uint32_t bwl, uint32_t bhl) {
+  // decode_block() with intra_frame_mode_info() in spec
+  const VP9Fuzzer::VP9FrameContext& probs = block_frame_info.probs;
+  const VP9Fuzzer::VP9BlockInfo* above = VP9Fuzzer::GetVP9AboveInfo(&tile_context, mi_row, mi_col);
+  const VP9Fuzzer::VP9BlockInfo* left = VP9Fuzzer::GetVP9LeftInfo(&tile_context, mi_row, mi_col);
+  VP9Fuzzer::VP9BlockInfo info;
+  info.sb_type = bsize;
+
+  if (block_frame_info.read_segment_id) {
+    info.segment_id = ReadVP9Tree(VP9Fuzzer::segment_tree, block_frame_info.segment_tree_probs);
+    block->set_segment_id(info.segment_id);
+  }
+  if (block_frame_info.segment_skip[info.segment_id]) {
+    info.skip = 1;
+  }
+  else {
+    info.skip = ReadBool(probs.skip_prob[VP9Fuzzer::GetVP9SkipContext(above, left)]);
+  }
+  block->set_skip((VP9BitField) info.skip);
+
+  uint32_t max_tx_size = VP9Fuzzer::max_txsize_lookup[bsize];
+  if (block_frame_info.tx_mode == CompressedHeader_TxMode_TX_MODE_SELECT && bsize >= VP9Fuzzer::BLOCK_8X8) {
+    const uint8_t* tx_probs = VP9Fuzzer::GetVP9TxProbs(probs, max_tx_size, VP9Fuzzer::GetVP9TxSizeContext(above, left, max_tx_size));
+    info.tx_size = ReadBool(tx_probs[0]);
+    if (info.tx_size != 0 && max_tx_size >= 2) {
+      info.tx_size += ReadBool(tx_probs[1]);
+      if (info.tx_size != 1 && max_tx_size >= 3) {
+        info.tx_size += ReadBool(tx_probs[2]);
+      }
+    }
+  }
+  else {
+    info.tx_size = std::min<uint32_t>(max_tx_size, VP9Fuzzer::tx_mode_to_biggest_tx_size[block_frame_info.tx_mode]);
+  }
+  block->set_tx_size(info.tx_size);
+
+  // 4x8 and 8x4 blocks code one mode per half, the modes of the 4x4 quarters below or to the right are copies
+  uint32_t step_x = bsize == VP9Fuzzer::BLOCK_4X4 || bsize == VP9Fuzzer::BLOCK_4X8 ? 1 : 2;
+  uint32_t step_y = bsize == VP9Fuzzer::BLOCK_4X4 || bsize == VP9Fuzzer::BLOCK_8X4 ? 1 : 2;
+  uint32_t y_mode = VP9Fuzzer::DC_PRED;
+  for (uint32_t idy = 0; idy < 2; idy += step_y) {
+    for (uint32_t idx = 0; idx < 2; idx += step_x) {
+      uint32_t b = idy * 2 + idx;
+      uint32_t above_mode = VP9Fuzzer::GetVP9AboveMode(info, above, b);
+      uint32_t left_mode = VP9Fuzzer::GetVP9LeftMode(info, left, b);
+      y_mode = ReadVP9Tree(VP9Fuzzer::intra_mode_tree, VP9Fuzzer::kf_y_mode_probs[above_mode][left_mode]);
+      block->add_default_intra_mode(y_mode);
+      for (uint32_t y = 0; y < step_y; y++) {
+        for (uint32_t x = 0; x < step_x; x++) {
+          info.sub_modes[b + y * 2 + x] = y_mode;
+        }
+      }
+    }
+  }
+  block->set_default_uv_mode(ReadVP9Tree(VP9Fuzzer::intra_mode_tree, VP9Fuzzer::kf_uv_mode_probs[y_mode]));
+
+  ReadVP9Residual(block, info, mi_row, mi_col, bwl, bhl);
+  VP9Fuzzer::StoreVP9BlockInfo(&tile_context, block_frame_info, mi_row, mi_col, 1 << (bwl - 1), 1 << (bhl - 1), info);
+}
+
+void ReadVP9Partition(Partition* partition, uint32_t mi_row, uint32_t mi_col, uint32_t n4x4_l2) {
+  // decode_partition() in spec, n4x4_l2 is log2 of the block size in 4x4 units, 4 for a superblock
+  uint32_t n8x8_l2 = n4x4_l2 - 1;
+  uint32_t num_8x8 = 1 << n8x8_l2;
+  uint32_t hbs = num_8x8 >> 1;
+  uint32_t bsize = VP9Fuzzer::BLOCK_8X8 + n8x8_l2 * 3;
+  bool has_rows = (mi_row + hbs) < block_frame_info.mi_rows;
+  bool has_cols = (mi_col + hbs) < block_frame_info.mi_cols;
+
+  const uint8_t* probs = VP9Fuzzer::kf_partition_probs[VP9Fuzzer::GetVP9PartitionContext(&tile_context, mi_row, mi_col, n8x8_l2)];
+  uint32_t partition_type = VP9Fuzzer::PARTITION_SPLIT;
+  if (has_rows && has_cols) {
+    partition_type = ReadVP9Tree(VP9Fuzzer::partition_tree, probs);
+  }
+  else if (has_cols) {
+    partition_type = ReadBool(probs[1]) ? VP9Fuzzer::PARTITION_SPLIT : VP9Fuzzer::PARTITION_HORZ;
+  }
+  else if (has_rows) {
+    partition_type = ReadBool(probs[2]) ? VP9Fuzzer::PARTITION_SPLIT : VP9Fuzzer::PARTITION_VERT;
+  }
+  partition->set_partition(partition_type);
+
+  uint32_t subsize = VP9Fuzzer::subsize_lookup[partition_type][bsize];
+  if (hbs == 0) {
+    ReadVP9Block(partition->add_block(), mi_row, mi_col, subsize, 1, 1);
+  }
+  else if (partition_type == VP9Fuzzer::PARTITION_NONE) {
+    ReadVP9Block(partition->add_block(), mi_row, mi_col, subsize, n4x4_l2, n4x4_l2);
+  }
+  else if (partition_type == VP9Fuzzer::PARTITION_HORZ) {
+    ReadVP9Block(partition->add_block(), mi_row, mi_col, subsize, n4x4_l2, n8x8_l2);
+    if (has_rows) {
+      ReadVP9Block(partition->add_block(), mi_row + hbs, mi_col, subsize, n4x4_l2, n8x8_l2);
+    }
+  }
+  else if (partition_type == VP9Fuzzer::PARTITION_VERT) {
+    ReadVP9Block(partition->add_block(), mi_row, mi_col, subsize, n8x8_l2, n4x4_l2);
+    if (has_cols) {
+      ReadVP9Block(partition->add_block(), mi_row, mi_col + hbs, subsize, n8x8_l2, n4x4_l2);
+    }
+  }
+  else {
+    for (uint32_t i = 0; i < 4; i++) {
+      uint32_t row = mi_row + (i >> 1) * hbs;
+      uint32_t col = mi_col + (i & 1) * hbs;
+      if (row < block_frame_info.mi_rows && col < block_frame_info.mi_cols) {
+        ReadVP9Partition(partition->add_split(), row, col, n8x8_l2);
+      }
+    }
+  }
+  if (bsize == VP9Fuzzer::BLOCK_8X8 || partition_type != VP9Fuzzer::PARTITION_SPLIT) {
+    VP9Fuzzer::UpdateVP9PartitionContext(&tile_context, mi_row, mi_col, subsize, num_8x8);
+  }
+}
+
+bool ReadVP9TileBlocks(Tile* tile, const VP9Fuzzer::VP9TileBounds& bounds) {
+  // decode_tile() in spec, false when the tile runs out of data
+  InitBool((const uint8_t*) tile->partition().data(), tile->partition().size());
+  tile_context.mi_col_start = bounds.mi_col_start;
+  for (uint32_t mi_row = bounds.mi_row_start; mi_row < bounds.mi_row_end; mi_row += 8) {
+    VP9Fuzzer::ClearVP9LeftContext(&tile_context);
+    for (uint32_t mi_col = bounds.mi_col_start; mi_col < bounds.mi_col_end; mi_col += 8) {
+      ReadVP9Partition(tile->add_superblock(), mi_row, mi_col, 4);
+    }
+  }
+  return ExitBool();
+}
+
+void ReadVP9FrameBlocks(LazyVP9Frame* lazy_frame) {
+  // Block level parse of a complete intra frame, after ApplyVP9FrameContext. Inter frames need the motion vectors
+  // of the neighbouring blocks and of the previous frame, and a context refreshed by backward adaptation isn't known,
+  // their tiles are only kept as bytes. A tile that runs out of data drops the blocks of the whole frame, the tiles
+  // after it depend on its contexts
+  VP9Frame* vp9_frame = lazy_frame->vp9_frame;
+  if (!FrameIsIntra || read_result.status != VP9_READ_OK || frame_contexts.frame_approximate ||
+      vp9_frame->tile_size() != (int32_t) lazy_frame->tile_layout.tiles.size()) {
+    return;
+  }
+  VP9Fuzzer::MakeVP9BlockFrameInfo(*vp9_frame, frame_contexts, ref_slots.current, tx_mode, Lossless, &block_frame_info);
+  VP9Fuzzer::ClearVP9AboveContext(&tile_context, block_frame_info.mi_cols);
+  uint32_t superblocks = 0;
+  for (int32_t i = 0; i < vp9_frame->tile_size(); i++) {
+    if (!ReadVP9TileBlocks(vp9_frame->mutable_tile(i), lazy_frame->tile_layout.tiles[i])) {
+      *reader_log << "Tile Blocks: tile " << i << " ran out of data" << std::endl;
+      for (int32_t j = 0; j <= i; j++) {
+        vp9_frame->mutable_tile(j)->clear_superblock();
+      }
+      return;
+    }
+    superblocks += vp9_frame->tile(i).superblock_size();
+  }
+  *reader_log << "Tile Blocks: " << superblocks << " superblocks" << std::endl;
+}
+
+VP9ReadStatus ReadVP9Frame(VP9Frame* vp9_frame, uint32_t frame_size) {
+  // Reads the whole frame, which is a lazy frame with every part accessed
+  LazyVP9Frame lazy_frame;
+  ReadVP9FrameLazy(&lazy_frame, vp9_frame, frame_size);
+  GetVP9CompressedHeader(&lazy_frame);
+  ReadVP9Tiles(&lazy_frame);
+  VP9Fuzzer::ApplyVP9FrameContext(&frame_contexts, *vp9_frame);
+  *reader_log << "Frame Context: " << frame_contexts.frame_context_idx << ", Prob Updates: " << frame_contexts.updates.size() << std::endl;
+  if (ParseBlocks) {
+    ReadVP9FrameBlocks(&lazy_frame);
+  }
+  *reader_log << "Bits Read: " << bit_reader.bit_counter << " / " << bit_reader.size_in_bits << std::endl;
+  return read_result.status;
+}
+
+VP9ReadResult ReadVP9Frames(VP9Fuzz* fuzz) {
   // https://wiki.multimedia.cx/index.php/Duck_IVF
-  // Reads the first frame of an IVF file
+  // Reads the first frame of an IVF file, only the IVF headers and then the frame itself are loaded
+  LoadVP9Window(0, IVF_FILE_HEADER_SIZE + IVF_FRAME_HEADER_SIZE);
   // Reads 32-byte IVF header
-  bit_counter += (32 * 8);
+  bit_reader.bit_counter += (32 * 8);
   // Read first IVF frame
   uint32_t frame_size = 0;
   std::string frame_size_bytes = ReadBitString(32);
   memcpy(&frame_size, frame_size_bytes.c_str(), sizeof(uint32_t));
   // Read rest of frame header
-  bit_counter += 64;
+  bit_reader.bit_counter += 64;
   // Read frame
   auto vp9_frame = new VP9Frame();
   auto ivf = new VP9IVF();
-  ReadVP9Frame(vp9_frame, frame_size);
+  if (VP9Fuzzer::BitReaderOverrun(&bit_reader)) {
+    SetVP9ReadError(VP9_READ_TRUNCATED_IVF_HEADER, bit_reader.size_in_bits);
+  }
+  else {
+    LoadVP9Window(IVF_FILE_HEADER_SIZE + IVF_FRAME_HEADER_SIZE, frame_size);
+    ReadVP9Frame(vp9_frame, frame_size);
+  }
   ivf->set_allocated_vp9_frame_1(vp9_frame);
-  fuzz->set_allocated_ivf(ivf);6
+  fuzz->set_allocated_ivf(ivf);
+  return read_result;
+}
+
+enum VP9StreamState {
+  VP9_STREAM_FILE_HEADER = 0,
+  VP9_STREAM_FRAME_HEADER,
+  VP9_STREAM_FRAME_DATA,
+  VP9_STREAM_RESYNC,
+};
+
+struct VP9StreamParser {
+  // Push-based IVF parser for data arriving in chunks of any size (pipes, sockets)
+  // Suspends between chunks with the bytes of the unfinished header or frame in pending,
+  // every byte is copied at most once and a frame is parsed exactly once, when its last byte arrives
+  VP9StreamState state = VP9_STREAM_FILE_HEADER;
+  std::string pending;
+  uint64_t needed = 32; // bytes pending has to reach before the state advances
+  uint64_t frame_count = 0;
+  uint64_t offset = 0; // stream offset of the next byte pushed
+  uint64_t frame_offset = 0; // stream offset of the current frame's data
+  // With resync a record that isn't plausible is skipped instead of parsed, pending then holds the bytes after it
+  // that are scanned for the next record with a key frame (vp9_resync.h)
+  bool resync = false;
+  uint64_t resync_start = 0; // stream offset of the skipped record
+  std::vector<VP9Fuzzer::VP9SkippedRange> skipped;
+};
+
+typedef std::function<void(VP9Frame* vp9_frame, uint64_t frame_index, VP9ReadStatus status)> VP9FrameCallback;
+
+void ParseVP9StreamFrame(VP9StreamParser* parser, const uint8_t* data, uint64_t size, uint32_t frame_size,
+                         const VP9FrameCallback& on_frame) {
+  // Runs the frame reader over the frame bytes, the reader globals are pointed at them for the duration
+  VP9Fuzzer::BitReader stream_reader = bit_reader;
+  bit_reader = VP9Fuzzer::MakeBitReader(data, size);
+  window_offset = parser->frame_offset;
+  read_result = VP9ReadResult();
+  auto vp9_frame = new VP9Frame();
+  VP9ReadStatus status = ReadVP9Frame(vp9_frame, frame_size);
+  bit_reader = stream_reader;
+  // The frame owns copies of its tiles, data can be reused once this returns
+  on_frame(vp9_frame, parser->frame_count++, status);
+}
+
+void StartVP9Resync(VP9StreamParser* parser, uint64_t record_offset) {
+  // Skips the record at record_offset, the bytes after its header are scanned for the next key frame record
+  parser->state = VP9_STREAM_RESYNC;
+  parser->resync_start = record_offset;
+  *reader_log << "Resync: corrupt record at byte " << record_offset << std::endl;
+}
+
+void PushVP9StreamBytes(VP9StreamParser* parser, const uint8_t* data, uint64_t size, const VP9FrameCallback& on_frame) {
+  // After a resync the bytes kept in pending are moved here with the rest of the chunk, and parsed from there
+  std::string replay;
+  while (size > 0 || (parser->state == VP9_STREAM_RESYNC && !parser->pending.empty())) {
+    if (parser->state == VP9_STREAM_RESYNC) {
+      // Looks for a key frame record, the bytes before it are skipped and parsing goes on from it. Only the bytes
+      // that could still start a record are kept between pushes
+      if (!parser->pending.empty()) {
+        parser->offset -= parser->pending.size();
+        parser->pending.append((const char*) data, size);
+        replay.swap(parser->pending);
+        parser->pending.clear();
+        data = (const uint8_t*) replay.data();
+        size = replay.size();
+      }
+      size_t checked = 0;
+      size_t record = VP9Fuzzer::FindVP9KeyFrameRecord(data, size, &checked);
+      if (record == std::string::npos) {
+        parser->pending.assign((const char*) data + checked, size - checked);
+        parser->offset += size;
+        return;
+      }
+      parser->skipped.push_back(VP9Fuzzer::VP9SkippedRange{parser->resync_start, parser->offset + record});
+      *reader_log << "Resync: key frame record at byte " << parser->offset + record << std::endl;
+      data += record;
+      size -= record;
+      parser->offset += record;
+      parser->state = VP9_STREAM_FRAME_HEADER;
+      parser->needed = 12;
+      continue;
+    }
+    // Frames that arrive whole in a chunk are parsed in place without going through pending
+    if (parser->state == VP9_STREAM_FRAME_DATA && parser->pending.empty() && size >= parser->needed) {
+      uint64_t frame_size = parser->needed;
+      if (parser->resync && !VP9Fuzzer::IsPlausibleVP9Frame(data, frame_size)) {
+        // The frame's bytes are scanned too, its size may be the corrupt part
+        StartVP9Resync(parser, parser->frame_offset - 12);
+        continue;
+      }
+      ParseVP9StreamFrame(parser, data, frame_size, frame_size, on_frame);
+      data += frame_size;
+      size -= frame_size;
+      parser->offset += frame_size;
+      parser->state = VP9_STREAM_FRAME_HEADER;
+      parser->needed = 12;
+      continue;
+    }
+
+    uint64_t take = std::min<uint64_t>(size, parser->needed - parser->pending.size());
+    parser->pending.append((const char*) data, take);
+    data += take;
+    size -= take;
+    parser->offset += take;
+    if (parser->pending.size() < parser->needed) {
+      // Out of input, resume here on the next push
+      return;
+    }
+
+    switch (parser->state) {
+      case VP9_STREAM_FILE_HEADER:
+        parser->state = VP9_STREAM_FRAME_HEADER;
+        parser->needed = 12;
+        break;
+      case VP9_STREAM_FRAME_HEADER: {
+        // 12-byte IVF frame header, frame size then the 64 bit timestamp
+        uint32_t frame_size = 0;
+        memcpy(&frame_size, parser->pending.data(), sizeof(uint32_t));
+        if (parser->resync && frame_size > VP9_RESYNC_MAX_FRAME_SIZE) {
+          StartVP9Resync(parser, parser->offset - 12);
+          parser->pending.clear();
+          continue;
+        }
+        parser->state = VP9_STREAM_FRAME_DATA;
+        parser->needed = frame_size;
+        parser->frame_offset = parser->offset;
+        if (frame_size == 0) {
+          ParseVP9StreamFrame(parser, nullptr, 0, 0, on_frame);
+          parser->state = VP9_STREAM_FRAME_HEADER;
+          parser->needed = 12;
+        }
+        break;
+      }
+      case VP9_STREAM_FRAME_DATA:
+        if (parser->resync && !VP9Fuzzer::IsPlausibleVP9Frame((const uint8_t*) parser->pending.data(), parser->pending.size())) {
+          // The frame's bytes are scanned before the rest of the chunk
+          StartVP9Resync(parser, parser->frame_offset - 12);
+          continue;
+        }
+        ParseVP9StreamFrame(parser, (const uint8_t*) parser->pending.data(), parser->pending.size(), parser->needed, on_frame);
+        parser->state = VP9_STREAM_FRAME_HEADER;
+        parser->needed = 12;
+        break;
+      case VP9_STREAM_RESYNC:
+        // Handled before any bytes are taken
+        break;
+    }
+    parser->pending.clear();
+  }
+}
+
+bool FinishVP9Stream(VP9StreamParser* parser, const VP9FrameCallback& on_frame) {
+  // Called once the input is closed, a frame cut off by the end of the stream is still emitted with
+  // a truncated status. False when the stream didn't end on a frame boundary
+  if (parser->state == VP9_STREAM_RESYNC) {
+    // No key frame after the last corrupt record, everything after it is skipped
+    parser->skipped.push_back(VP9Fuzzer::VP9SkippedRange{parser->resync_start, parser->offset});
+    parser->pending.clear();
+  }
+  bool complete = parser->pending.empty() && parser->state != VP9_STREAM_FRAME_DATA;
+  if (parser->state == VP9_STREAM_FRAME_DATA) {
+    ParseVP9StreamFrame(parser, (const uint8_t*) parser->pending.data(), parser->pending.size(), parser->needed, on_frame);
+  }
+  parser->state = VP9_STREAM_FRAME_HEADER;
+  parser->needed = 12;
+  parser->pending.clear();
+  return complete;
+}
+
+void WriteVP9FrameFile(VP9Frame* vp9_frame, const std::string& frame_file, bool compact) {
+  // Writes one frame as its own VP9Fuzz, or CompactVP9Frame with --compact, and takes ownership of vp9_frame
+  VP9Fuzz vp9_fuzz;
+  vp9_fuzz.mutable_ivf()->set_allocated_vp9_frame_1(vp9_frame);
+  std::ofstream ofs(frame_file, std::ios_base::out | std::ios_base::binary);
+  if (compact) {
+    CompactVP9Frame compact_frame;
+    VP9Fuzzer::PackVP9Frame(vp9_frame, &compact_frame);
+    compact_frame.SerializeToOstream(&ofs);
+  }
+  else {
+    vp9_fuzz.SerializeToOstream(&ofs);
+  }
+}
+
+struct VP9GopShard {
+  // Frames [first_frame, end_frame) of the IVF, the first one doesn't depend on any frame before it
+  uint64_t first_frame;
+  uint64_t end_frame;
+};
+
+bool StartsVP9Gop(const VP9Fuzzer::VP9IndexEntry& entry) {
+  // Key frames refresh every reference slot and reset every probability context, so the frames after them
+  // can't reach back past them. Intra-only frames can keep saved contexts and aren't split at
+  return entry.valid && entry.show_existing_frame == 0 && entry.frame_type == 0;
+}
+
+std::vector<VP9GopShard> SplitVP9Gops(const std::vector<VP9Fuzzer::VP9IndexEntry>& entries) {
+  // Frames before the first key frame go into a shard of their own
+  std::vector<VP9GopShard> shards;
+  for (uint64_t i = 0; i < entries.size(); i++) {
+    if (shards.empty() || StartsVP9Gop(entries[i])) {
+      shards.push_back(VP9GopShard{i, i});
+    }
+    shards.back().end_frame = i + 1;
+  }
+  return shards;
+}
+
+void ConvertVP9GopShard(const char* in_file, const std::vector<VP9Fuzzer::VP9IndexEntry>& entries, const VP9GopShard& shard,
+                        const VP9FrameCallback& on_frame) {
+  // Reads the shard's frames in order with this thread's reader state, file handle and window
+  // The first frame sets every piece of reader state the rest of the shard reads
+  file = std::ifstream(in_file, std::ios::binary);
+  for (uint64_t i = shard.first_frame; i < shard.end_frame; i++) {
+    const VP9Fuzzer::VP9IndexEntry& entry = entries[i];
+    read_result = VP9ReadResult();
+    LoadVP9Window(entry.offset, entry.size);
+    auto vp9_frame = new VP9Frame();
+    VP9ReadStatus status = ReadVP9Frame(vp9_frame, entry.size);
+    on_frame(vp9_frame, i, status);
+  }
+}
+
+void WriteVP9ProvenanceFile(const std::string& provenance_file, int64_t field_at_bit) {
+  // Writes the provenance table and prints the elements read from field_at_bit, if one was asked for
+  if (!VP9Fuzzer::WriteVP9Provenance(provenance, provenance_file.c_str())) {
+    std::cerr << "Failed to write provenance file: " << provenance_file << std::endl;
+  }
+  std::cout << "Provenance Entries: " << provenance->entries.size() << std::endl;
+  if (field_at_bit < 0) {
+    return;
+  }
+  for (const VP9Fuzzer::VP9ProvenanceEntry* entry : VP9Fuzzer::FindVP9ProvenanceEntries(provenance, field_at_bit)) {
+    std::cout << "Field At " << field_at_bit << ": " << provenance->paths[entry->path];
+    if (entry->index != VP9_PROVENANCE_NO_INDEX) {
+      std::cout << " [" << entry->index << "]";
+    }
+    if (entry->elements > 1) {
+      std::cout << " x" << entry->elements;
+    }
+    std::cout << ", bits " << entry->start_bit << " + " << entry->length_in_bits;
+    if (entry->bool_coded) {
+      std::cout << ", bool coded at p=" << (uint32_t) entry->prob;
+    }
+    std::cout << std::endl;
+  }
 }
 
 int main(int argc, char** argv) {
 
   // Check args
   if (argc < 3) {
-    std::cout << "usage: " << argv[0] << " <in_file> <out_file>" << std::endl;
+    std::cout << "usage: " << argv[0] << " <in_file> <out_file> [--compact] [--sparse] [--blocks] [--peek] [--stream] [--resync]"
+              << " [--provenance <file>] [--field-at <bit>]"
+              << " [--threads <n>] [--gop-threads <n>]" << std::endl;
     return 0;
   }
+  bool compact = false;
+  bool peek = false;
+  bool stream = false;
+  bool resync = false;
+  std::string provenance_file;
+  int64_t field_at_bit = -1;
+  uint32_t threads = 1;
+  uint32_t gop_threads = 0;
+  for (int i = 3; i < argc; i++) {
+    std::string option = argv[i];
+    // Write the bit-packed CompactVP9Frame (vp9_compact.proto) instead of VP9Fuzz
+    if (option == "--compact") compact = true;
+    // Only store the probability updates that are coded
+    if (option == "--sparse") SparseProbs = true;
+    // Also parse the partitions, modes and coefficient tokens of intra frame tiles
+    if (option == "--blocks") ParseBlocks = true;
+    // Only print the PeekFrameInfo summary of the first frame, nothing is written
+    if (option == "--peek") peek = true;
+    // Parse every frame as it is read (- reads stdin), frame n is written to <out_file>.<n> as soon as it is complete
+    if (option == "--stream") stream = true;
+    // With --stream, skip corrupt records and continue at the next key frame, the skipped byte ranges are reported
+    if (option == "--resync") resync = true;
+    // Record the bit offset, length and probability of every syntax element read (vp9_provenance.h)
+    if (option == "--provenance" && i + 1 < argc) provenance_file = argv[++i];
+    // With --provenance, print the syntax elements read from this bit of the file
+    if (option == "--field-at" && i + 1 < argc) field_at_bit = std::stoll(argv[++i]);
+    // Copy the tiles of a frame on n threads, the output is the same for any n
+    if (option == "--threads" && i + 1 < argc) threads = std::stoul(argv[++i]);
+    // Convert every frame, split into GOPs at key frames and converted on n threads, frame n is written to <out_file>.<n>
+    if (option == "--gop-threads" && i + 1 < argc) gop_threads = std::stoul(argv[++i]);
+  }
+  VP9Fuzzer::StartVP9ThreadPool(&tile_pool, threads);
+  VP9Fuzzer::VP9Provenance provenance_table;
+  if (!provenance_file.empty()) {
+    provenance = &provenance_table;
+  }
 
-  // Open file
-  file = std::ifstream(argv[1], std::ios::binary);
-  // Read into bit vector
-  bit_buffer = std::vector<bool>();
-  uint8_t data;
-  while (file.read((char *)&data, 1)) {
-    for (int i = 0; i < 8; i++) {
-      bit_buffer.push_back(((data >> (7 - i)) & 0b1));
+  if (stream) {
+    int fd = std::string(argv[1]) == "-" ? STDIN_FILENO : open(argv[1], O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Failed to read file: " << argv[1] << std::endl;
+      exit(0);
+    }
+    std::string out_file = argv[2];
+    VP9FrameCallback write_frame = [&](VP9Frame* vp9_frame, uint64_t frame_index, VP9ReadStatus status) {
+      if (status != VP9_READ_OK) {
+        std::cerr << "Truncated frame " << frame_index << " (status " << status << "), data ends at bit " << read_result.bit_offset << std::endl;
+      }
+      std::string frame_file = out_file + "." + std::to_string(frame_index);
+      WriteVP9FrameFile(vp9_frame, frame_file, compact);
+      std::cout << "Writing to file " << frame_file << std::endl;
+    };
+    // Takes whatever a pipe or socket has ready instead of waiting for a full chunk
+    VP9StreamParser parser;
+    parser.resync = resync;
+    uint8_t chunk[1 << 16];
+    ssize_t chunk_size;
+    while ((chunk_size = read(fd, chunk, sizeof(chunk))) > 0) {
+      PushVP9StreamBytes(&parser, chunk, chunk_size, write_frame);
+    }
+    if (!FinishVP9Stream(&parser, write_frame)) {
+      std::cerr << "Stream ended inside a header or frame" << std::endl;
+    }
+    if (resync) {
+      uint64_t skipped_bytes = 0;
+      for (const VP9Fuzzer::VP9SkippedRange& range : parser.skipped) {
+        std::cout << "Skipped Bytes: " << range.start << " - " << range.end << std::endl;
+        skipped_bytes += range.end - range.start;
+      }
+      std::cout << "Skipped Ranges: " << parser.skipped.size() << ", " << skipped_bytes << " bytes" << std::endl;
+    }
+    close(fd);
+    if (provenance != nullptr) {
+      WriteVP9ProvenanceFile(provenance_file, field_at_bit);
     }
+    return 0;
   }
+
+  // Open file, its bytes are loaded a window at a time
+  file = std::ifstream(argv[1], std::ios::binary | std::ios::ate);
+  file_size = file ? (uint64_t) file.tellg() : 0;
   // Check that we have data to parse
-  if (bit_buffer.empty()) {
+  if (file_size == 0) {
     std::cerr << "Failed to read file: " << argv[1] << std::endl; 
     exit(0);
   }
 
+  if (gop_threads > 0) {
+    if (provenance != nullptr) {
+      std::cerr << "--provenance reads frames in order and can't be used with --gop-threads" << std::endl;
+      return 1;
+    }
+    // Prescan of the frame headers to find where the GOPs start
+    std::vector<VP9Fuzzer::VP9IndexEntry> entries;
+    FILE* ivf = fopen(argv[1], "rb");
+    bool scanned = ivf != nullptr && VP9Fuzzer::ScanVP9Frames(ivf, [&](const VP9Fuzzer::VP9IndexEntry& entry) {
+      entries.push_back(entry);
+    });
+    if (ivf != nullptr) {
+      fclose(ivf);
+    }
+    if (!scanned) {
+      std::cerr << "Failed to read file: " << argv[1] << std::endl;
+      exit(0);
+    }
+    std::vector<VP9GopShard> shards = SplitVP9Gops(entries);
+    std::cout << "Frames: " << entries.size() << ", GOP Shards: " << shards.size() << std::endl;
+
+    std::string out_file = argv[2];
+    std::mutex log_mutex;
+    VP9Fuzzer::VP9ThreadPool shard_pool;
+    VP9Fuzzer::StartVP9ThreadPool(&shard_pool, gop_threads);
+    RunVP9ThreadPool(&shard_pool, shards.size(), [&](uint32_t shard_index) {
+      // A shard's log is printed in one piece once it is done, frame files are named by frame so order is kept
+      std::ostringstream shard_log;
+      reader_log = &shard_log;
+      ConvertVP9GopShard(argv[1], entries, shards[shard_index], [&](VP9Frame* vp9_frame, uint64_t frame_index, VP9ReadStatus status) {
+        if (status != VP9_READ_OK) {
+          shard_log << "Truncated frame " << frame_index << " (status " << status << "), data ends at bit " << read_result.bit_offset << std::endl;
+        }
+        std::string frame_file = out_file + "." + std::to_string(frame_index);
+        WriteVP9FrameFile(vp9_frame, frame_file, compact);
+        shard_log << "Writing to file " << frame_file << std::endl;
+      });
+      reader_log = &std::cout;
+      std::lock_guard<std::mutex> lock(log_mutex);
+      std::cout << shard_log.str();
+    });
+    return 0;
+  }
+
+  if (peek) {
+    // First IVF frame starts after the 32 byte file header and the 12 byte frame header
+    if (!LoadVP9Window(0, IVF_FILE_HEADER_SIZE + IVF_FRAME_HEADER_SIZE)) {
+      std::cerr << "No frame in file: " << argv[1] << std::endl;
+      exit(0);
+    }
+    uint32_t frame_size = 0;
+    memcpy(&frame_size, byte_buffer.data() + 32, sizeof(uint32_t));
+    // Only the start of the frame is needed to reach base_q_idx
+    LoadVP9Window(IVF_FILE_HEADER_SIZE + IVF_FRAME_HEADER_SIZE, std::min<uint32_t>(frame_size, VP9_INDEX_PEEK_SIZE));
+    VP9Fuzzer::FrameInfo info = VP9Fuzzer::PeekFrameInfo((const uint8_t*) byte_buffer.data(), byte_buffer.size());
+    std::cout << "Valid: " << info.valid << std::endl;
+    std::cout << "Profile: " << info.profile << std::endl;
+    std::cout << "Show Existing Frame: " << info.show_existing_frame << std::endl;
+    std::cout << "Frame Type: " << info.frame_type << std::endl;
+    std::cout << "Size: " << info.width << "x" << info.height << std::endl;
+    std::cout << "Base Q Index: " << info.base_q_idx << std::endl;
+    std::cout << "Refresh Frame Flags: " << info.refresh_frame_flags << std::endl;
+    return 0;
+  }
+
   // Create VP9 Protobuf Object
   auto vp9_fuzz = new VP9Fuzz();
-  // Convert vp9 binary frame to protobuf
-  ReadVP9Frames(vp9_fuzz);
+  // Convert vp9 binary frame to protobuf, a truncated frame still writes whatever was parsed
+  VP9ReadResult result = ReadVP9Frames(vp9_fuzz);
+  if (result.status != VP9_READ_OK) {
+    std::cerr << "Truncated frame (status " << result.status << "), data ends at bit " << result.bit_offset << std::endl;
+  }
 
   // Serialize protobuf and store to file
   std::ofstream ofs(argv[2], std::ios_base::out | std::ios_base::binary);
-  vp9_fuzz->SerializeToOstream(&ofs);
+  if (compact) {
+    CompactVP9Frame compact_frame;
+    VP9Fuzzer::PackVP9Frame(&vp9_fuzz->ivf().vp9_frame_1(), &compact_frame);
+    compact_frame.SerializeToOstream(&ofs);
+  }
+  else {
+    vp9_fuzz->SerializeToOstream(&ofs);
+  }
 
   std::cout << "Writing to file " << argv[2] << std::endl;
+  if (provenance != nullptr) {
+    WriteVP9ProvenanceFile(provenance_file, field_at_bit);
+  }
   return 0;
 }